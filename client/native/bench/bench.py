@@ -0,0 +1,134 @@
+"""
+Tap-to-unlock latency benchmark.
+
+Runs the native firmware (pio run -e native_bench) against the mock server
+with scripted taps, password entries and visitor batches, then collects the
+per-stage percentiles the firmware prints and saves them as JSON, so results
+can be compared across commits:
+
+	python native/bench/bench.py --latency 20 --output before.json
+	python native/bench/bench.py --latency 20 --baseline before.json
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+import mock_server
+
+POLL_INTERVAL = 50 # READER_POLL_INTERVAL in the firmware
+FIRST_TAP = 1000 # Leaves time for the sync at boot
+
+def uid(prefix, number):
+	return '%02x%06x' % (prefix, number)
+
+def write_script(file, iterations, visitors, step):
+	"""Writes the input script, returns how many ms it lasts"""
+	time = FIRST_TAP
+	card = 0
+	for i in range(iterations):
+		# Authorized card
+		card += 1
+		file.write('%d tap %d %s\n' % (time, i % 2, uid(0xa1, card)))
+		time += step
+
+		# Card that needs the password
+		card += 1
+		file.write('%d tap 0 %s\n' % (time, uid(0xa2, card)))
+		file.write('%d keys %s#\n' % (time + step, mock_server.PASSWORD))
+		time += 3 * step
+
+		# Visitors, then the card that lets them in
+		for visitor in range(visitors):
+			card += 1
+			file.write('%d tap 0 %s\n' % (time, uid(0xa3, card)))
+			time += step
+		if visitors > 0:
+			card += 1
+			file.write('%d tap 0 %s\n' % (time, uid(0xa2, card)))
+			file.write('%d keys %s#\n' % (time + step, mock_server.PASSWORD))
+			time += 4 * step
+
+	file.write('%d serial l\n' % time)
+	file.write('%d quit\n' % (time + step))
+	return time + step
+
+def run(args):
+	server = mock_server.start(latency=args.latency, jitter=args.jitter)
+	# Worst-case time for a tap to be read and answered
+	step = int(POLL_INTERVAL + args.latency + args.jitter + 100)
+
+	with tempfile.NamedTemporaryFile('w', suffix='.txt', delete=False) as script:
+		duration = write_script(script, args.iterations, args.visitors, step)
+	print('Running %d iterations, about %d s...' % (args.iterations, duration // 1000), file=sys.stderr)
+
+	env = dict(os.environ, NATIVE_SERVER='127.0.0.1:%d' % server.server_address[1])
+	env.pop('NATIVE_EEPROM', None) # Starts with an empty cache, every tap goes to the server
+	try:
+		output = subprocess.run([args.program, script.name], env=env, stdout=subprocess.PIPE,
+			universal_newlines=True, timeout=duration / 1000 + 30).stdout
+	finally:
+		os.unlink(script.name)
+		server.shutdown()
+
+	stages = {}
+	for line in output.splitlines():
+		fields = line.strip().split(',')
+		if fields[0] != 'latency' or fields[1] == 'stage':
+			continue
+		stages[fields[1]] = dict(zip(('samples', 'p50_us', 'p95_us', 'p99_us', 'max_us'), map(int, fields[2:])))
+	if not stages:
+		sys.exit('No latency report in the firmware output, was it built with -D LATENCY_BENCH?')
+	return stages
+
+def git_commit():
+	try:
+		return subprocess.check_output(['git', 'rev-parse', '--short', 'HEAD'], universal_newlines=True,
+			stderr=subprocess.DEVNULL).strip()
+	except (OSError, subprocess.CalledProcessError):
+		return None
+
+def print_stages(stages, baseline):
+	print('%-8s %8s %16s %16s %16s %16s' % ('stage', 'samples', 'p50 us', 'p95 us', 'p99 us', 'max us'))
+	for name, stage in stages.items():
+		columns = [stage['samples']]
+		for key in ('p50_us', 'p95_us', 'p99_us', 'max_us'):
+			value = '%d' % stage[key] if stage['samples'] > 0 else '-'
+			if stage['samples'] > 0 and baseline and name in baseline['stages'] and baseline['stages'][name][key] > 0:
+				value += ' (%+d%%)' % round(100.0 * stage[key] / baseline['stages'][name][key] - 100)
+			columns.append(value)
+		print('%-8s %8d %16s %16s %16s %16s' % tuple([name] + columns))
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+	parser.add_argument('--program', default='.pio/build/native_bench/program', help='native firmware to run')
+	parser.add_argument('--iterations', type=int, default=30, help='rounds of unlock, password and visitor flows')
+	parser.add_argument('--visitors', type=int, default=3, help='visitors per batch, 0 to skip the visitor flow')
+	parser.add_argument('--latency', type=float, default=20, help='delay the mock server adds to every response, in ms')
+	parser.add_argument('--jitter', type=float, default=0, help='random extra delay, up to this many ms')
+	parser.add_argument('--output', help='saves the results to this JSON file')
+	parser.add_argument('--baseline', help='JSON results of an earlier run to compare with')
+	args = parser.parse_args()
+
+	baseline = None
+	if args.baseline:
+		with open(args.baseline) as file:
+			baseline = json.load(file)
+
+	results = {
+		'commit': git_commit(),
+		'latency_ms': args.latency,
+		'jitter_ms': args.jitter,
+		'iterations': args.iterations,
+		'visitors': args.visitors,
+		'stages': run(args),
+	}
+	print_stages(results['stages'], baseline)
+	if args.output:
+		with open(args.output, 'w') as file:
+			json.dump(results, file, indent=2)
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,124 @@
+"""
+Mock of the access control API for the latency benchmark.
+
+Answers the endpoints the firmware uses after an injected delay, deciding by
+the first byte of the UID so no database is needed:
+
+	a1...	authorized
+	a2...	password required, the password is 1234
+	a3...	visitor
+	others	not found
+
+The authorization sync always answers "unchanged", so every tap goes to the
+server. Run on its own with: python mock_server.py --port 8000 --latency 20
+"""
+import argparse
+import hashlib
+import json
+import random
+import struct
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+# Must match server's accesscontrol/consts.py
+AUTHORIZED = 0
+RFID_NOT_FOUND = 1
+WRONG_PASSWORD = 3
+PASSWORD_REQUIRED = 4
+VISITOR_RFID_FOUND = 5
+VISITOR_AUTHORIZED = 6
+BINARY_PROTOCOL_VERSION = 1
+BINARY_HEADER_FORMAT = '<BBBB15s'
+BINARY_RESPONSE_FORMAT = '<Bb'
+
+PASSWORD = '1234'
+PASSWORD_HASH = hashlib.sha256(PASSWORD.encode()).hexdigest()
+
+UNLOCK_STATUS = {0xa1: AUTHORIZED, 0xa2: PASSWORD_REQUIRED, 0xa3: VISITOR_RFID_FOUND}
+
+def unlock_status(uid):
+	return UNLOCK_STATUS.get(uid[0] if uid else None, RFID_NOT_FOUND)
+
+def authenticate_status(uid, password):
+	if unlock_status(uid) != PASSWORD_REQUIRED:
+		return RFID_NOT_FOUND
+	return AUTHORIZED if password == PASSWORD_HASH else WRONG_PASSWORD
+
+def decode_binary(body):
+	header_size = struct.calcsize(BINARY_HEADER_FORMAT)
+	version, api, reader_position, uid_size, room_id = struct.unpack_from(BINARY_HEADER_FORMAT, body)
+	uid = body[header_size:header_size + uid_size]
+	return api, uid, body[header_size + uid_size:]
+
+class MockHandler(BaseHTTPRequestHandler):
+	protocol_version = 'HTTP/1.1' # Keeps the connection alive like Apache does
+	disable_nagle_algorithm = True
+	latency = 0
+	jitter = 0
+
+	def log_message(self, format, *args):
+		pass
+
+	def reply(self, body, content_type):
+		time.sleep((self.latency + random.uniform(0, self.jitter)) / 1000)
+		self.send_response(200)
+		self.send_header('Content-Type', content_type)
+		self.send_header('Content-Length', str(len(body)))
+		self.end_headers()
+		self.wfile.write(body)
+
+	def reply_json(self, data):
+		self.reply(json.dumps(data).encode(), 'application/json')
+
+	def reply_binary(self, status):
+		self.reply(struct.pack(BINARY_RESPONSE_FORMAT, BINARY_PROTOCOL_VERSION, status), 'application/octet-stream')
+
+	def do_POST(self):
+		body = self.rfile.read(int(self.headers.get('Content-Length', 0)))
+
+		if self.path.startswith('/api/bin/'):
+			api, uid, rest = decode_binary(body)
+			if self.path == '/api/bin/request-unlock':
+				self.reply_binary(unlock_status(uid))
+			elif self.path == '/api/bin/authenticate':
+				self.reply_binary(authenticate_status(uid, rest[:32].hex()))
+			else:
+				self.reply_binary(VISITOR_AUTHORIZED)
+			return
+
+		data = json.loads(body)
+		uid = bytes.fromhex(data.get('uid', ''))
+		if self.path == '/api/request-unlock':
+			self.reply_json({'status': unlock_status(uid)})
+		elif self.path == '/api/authenticate':
+			self.reply_json({'status': authenticate_status(uid, data['password'])})
+		elif self.path == '/api/authorize-visitor':
+			self.reply_json({'status': VISITOR_AUTHORIZED})
+		elif self.path == '/api/auth-sync':
+			self.reply_json({'status': AUTHORIZED, 'mode': 0, 'version': data['version'], 'roomLevel': 0,
+				'passwordRequired': False, 'serverTime': int(time.time())})
+		elif self.path == '/api/telemetry':
+			self.reply_json({'status': AUTHORIZED})
+		elif self.path == '/api/events/bulk':
+			self.reply_json({'status': AUTHORIZED, 'count': len(data['events']), 'version': 0})
+		else:
+			self.send_error(404)
+
+def start(port=0, latency=0, jitter=0):
+	"""Starts the server on a background thread, returns it. Port 0 picks a free one"""
+	handler = type('Handler', (MockHandler,), {'latency': latency, 'jitter': jitter})
+	server = ThreadingHTTPServer(('127.0.0.1', port), handler)
+	server.daemon_threads = True
+	threading.Thread(target=server.serve_forever, daemon=True).start()
+	return server
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+	parser.add_argument('--port', type=int, default=8000)
+	parser.add_argument('--latency', type=float, default=0, help='delay added to every response, in ms')
+	parser.add_argument('--jitter', type=float, default=0, help='random extra delay, up to this many ms')
+	args = parser.parse_args()
+	server = start(args.port, args.latency, args.jitter)
+	print('Mock server on 127.0.0.1:%d' % server.server_address[1])
+	threading.Event().wait()
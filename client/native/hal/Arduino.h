@@ -0,0 +1,130 @@
+/*
+ *  Native HAL: Arduino core
+ *
+ *  Just enough of the Arduino core for the firmware to build and run on the
+ *  host (PlatformIO "native" environment). Pins, time and Serial are backed
+ *  by NativeHal.cpp, which also replays the input script.
+ */
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define DEC 10
+#define HEX 16
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Interrupts are run from the loop thread, so there is nothing to mask
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+inline void interrupts(void) {}
+inline void noInterrupts(void) {}
+
+class Printable;
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	size_t write(const char *str) { return str == NULL ? 0 : write((const uint8_t *)str, strlen(str)); }
+
+	size_t print(const char *str) { return write(str); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(int n, int base = DEC) { return print((long)n, base); }
+	size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+	size_t print(long n, int base = DEC);
+	size_t print(unsigned long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+	size_t print(const Printable &printable);
+
+	size_t println(void) { return write("\r\n"); }
+	template <typename T>
+	size_t println(T value) { return print(value) + println(); }
+	template <typename T>
+	size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class Printable
+{
+public:
+	virtual ~Printable() {}
+	virtual size_t printTo(Print &p) const = 0;
+};
+
+class Stream : public Print
+{
+public:
+	Stream() : timeout(1000) {}
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+	void setTimeout(unsigned long ms) { timeout = ms; }
+	size_t readBytes(char *buffer, size_t length);
+	size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+protected:
+	int timedRead();
+	unsigned long timeout;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+	void begin(unsigned long baud) { (void)baud; }
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+	int available();
+	int read();
+	int peek();
+	operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress : public Printable
+{
+public:
+	IPAddress() { memset(octets, 0, sizeof(octets)); }
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+	{
+		octets[0] = a;
+		octets[1] = b;
+		octets[2] = c;
+		octets[3] = d;
+	}
+	uint8_t operator[](int index) const { return octets[index]; }
+	uint8_t &operator[](int index) { return octets[index]; }
+	size_t printTo(Print &p) const;
+
+private:
+	uint8_t octets[4];
+};
+
+#endif
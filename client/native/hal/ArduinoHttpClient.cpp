@@ -0,0 +1,69 @@
+#include <strings.h>
+#include "ArduinoHttpClient.h"
+
+HttpClient::HttpClient(Client &client, const char *serverName, uint16_t serverPort)
+	: client(client), serverName(serverName), serverPort(serverPort), keepAlive(false),
+	  statusCode(HTTP_ERROR_INVALID_RESPONSE), responseContentLength(-1)
+{
+	setTimeout(HTTP_RESPONSE_TIMEOUT);
+}
+
+int HttpClient::post(const char *path, const char *contentType, int contentLength, const byte body[])
+{
+	char header[256];
+
+	if (!client.connected() && !client.connect(serverName, serverPort))
+		return HTTP_ERROR_CONNECTION_FAILED;
+	snprintf(header, sizeof(header),
+			 "POST %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: Arduino/2.2.0\r\n%s"
+			 "Content-Type: %s\r\nContent-Length: %d\r\n\r\n",
+			 path, serverName, keepAlive ? "" : "Connection: close\r\n", contentType, contentLength);
+	client.write(header);
+	if (body != NULL)
+		client.write(body, contentLength);
+	statusCode = HTTP_ERROR_INVALID_RESPONSE;
+	responseContentLength = -1;
+	return 0;
+}
+
+bool HttpClient::ReadLine(char *line, size_t size)
+{
+	size_t length = 0;
+
+	while (true)
+	{
+		int c = timedRead();
+		if (c < 0)
+			return false;
+		if (c == '\n')
+			break;
+		if (c != '\r' && length < size - 1)
+			line[length++] = c;
+	}
+	line[length] = '\0';
+	return true;
+}
+
+/*
+ *  Reads the status line and all the headers, leaving the body to be read
+ */
+int HttpClient::responseStatusCode(void)
+{
+	char line[256];
+
+	responseContentLength = -1;
+	if (!ReadLine(line, sizeof(line)))
+		return statusCode = HTTP_ERROR_TIMED_OUT;
+	if (sscanf(line, "HTTP/%*d.%*d %d", &statusCode) != 1)
+		return statusCode = HTTP_ERROR_INVALID_RESPONSE;
+	while (true)
+	{
+		if (!ReadLine(line, sizeof(line)))
+			return statusCode = HTTP_ERROR_TIMED_OUT;
+		if (line[0] == '\0')
+			break;
+		if (strncasecmp(line, "Content-Length:", 15) == 0)
+			responseContentLength = atoi(line + 15);
+	}
+	return statusCode;
+}
@@ -0,0 +1,53 @@
+/*
+ *  Native HAL: ArduinoHttpClient
+ *
+ *  The part of HttpClient the firmware uses: keep-alive POSTs, whose body may
+ *  be streamed with write() between beginBody() and endRequest(), and responses
+ *  with a Content-Length.
+ */
+#ifndef NATIVE_ARDUINO_HTTP_CLIENT_H
+#define NATIVE_ARDUINO_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <Ethernet.h>
+
+#define HTTP_ERROR_CONNECTION_FAILED -1
+#define HTTP_ERROR_TIMED_OUT -3
+#define HTTP_ERROR_INVALID_RESPONSE -4
+#define HTTP_RESPONSE_TIMEOUT 30000
+
+class HttpClient : public Client
+{
+public:
+	HttpClient(Client &client, const char *serverName, uint16_t serverPort = 80);
+	void connectionKeepAlive(void) { keepAlive = true; }
+	void beginRequest(void) {}
+	int post(const char *path, const char *contentType, int contentLength, const byte body[]);
+	void beginBody(void) {}
+	void endRequest(void) {}
+	int responseStatusCode(void);
+	int skipResponseHeaders(void) { return statusCode < 0 ? statusCode : 0; }
+	int contentLength(void) { return responseContentLength; }
+
+	int connect(const char *host, uint16_t port) { return client.connect(host, port); }
+	uint8_t connected(void) { return client.connected(); }
+	void stop(void) { client.stop(); }
+	size_t write(uint8_t c) { return client.write(c); }
+	size_t write(const uint8_t *buffer, size_t size) { return client.write(buffer, size); }
+	using Print::write;
+	int available(void) { return client.available(); }
+	int read(void) { return client.read(); }
+	int peek(void) { return client.peek(); }
+
+private:
+	bool ReadLine(char *line, size_t size);
+
+	Client &client;
+	const char *serverName;
+	uint16_t serverPort;
+	bool keepAlive;
+	int statusCode;
+	int responseContentLength;
+};
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ *  Native HAL: EEPROM
+ *
+ *  4 KB like the Mega 2560, kept in the NATIVE_EEPROM file when it's set.
+ */
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <Arduino.h>
+#include "NativeHal.h"
+
+class EEPROMClass
+{
+public:
+	uint8_t read(int address) { return NativeHalEeprom()[address]; }
+	void write(int address, uint8_t value)
+	{
+		NativeHalEeprom()[address] = value;
+		NativeHalEepromChanged();
+	}
+	void update(int address, uint8_t value)
+	{
+		if (read(address) != value)
+			write(address, value);
+	}
+	uint16_t length(void) { return NATIVE_EEPROM_SIZE; }
+
+	template <typename T>
+	T &get(int address, T &value)
+	{
+		memcpy(&value, NativeHalEeprom() + address, sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	const T &put(int address, const T &value)
+	{
+		if (memcmp(NativeHalEeprom() + address, &value, sizeof(T)) != 0)
+		{
+			memcpy(NativeHalEeprom() + address, &value, sizeof(T));
+			NativeHalEepromChanged();
+		}
+		return value;
+	}
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,122 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Ethernet.h"
+#include "NativeHal.h"
+
+EthernetClass Ethernet;
+
+int EthernetClass::begin(uint8_t *mac, unsigned long timeout, unsigned long responseTimeout)
+{
+	(void)mac;
+	(void)responseTimeout;
+	ip = gateway = subnet = IPAddress();
+	if (!NativeHalDhcpAnswers())
+	{
+		delay(timeout);
+		return 0;
+	}
+	ip = IPAddress(192, 168, 88, 100);
+	gateway = IPAddress(192, 168, 88, 1);
+	subnet = IPAddress(255, 255, 255, 0);
+	return 1;
+}
+
+void EthernetClass::begin(uint8_t *mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet)
+{
+	(void)mac;
+	(void)dns;
+	this->ip = ip;
+	this->gateway = gateway;
+	this->subnet = subnet;
+}
+
+int EthernetClient::connect(const char *host, uint16_t port)
+{
+	struct addrinfo hints, *addresses;
+	char service[6];
+	int one = 1;
+
+	stop();
+	NativeHalServer(&host, &port);
+	snprintf(service, sizeof(service), "%u", port);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, service, &hints, &addresses) != 0)
+		return 0;
+
+	for (struct addrinfo *address = addresses; address != NULL; address = address->ai_next)
+	{
+		socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (socket < 0)
+			continue;
+		if (::connect(socket, address->ai_addr, address->ai_addrlen) == 0)
+			break;
+		close(socket);
+		socket = -1;
+	}
+	freeaddrinfo(addresses);
+	if (socket < 0)
+		return 0;
+	// The W5100 sends each write right away, small requests shouldn't wait for Nagle
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return 1;
+}
+
+uint8_t EthernetClient::connected(void)
+{
+	char c;
+
+	if (socket < 0)
+		return 0;
+	// Like the W5100, a closed connection still counts while there's data to read
+	ssize_t result = recv(socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return result > 0 || (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+void EthernetClient::stop(void)
+{
+	if (socket >= 0)
+		close(socket);
+	socket = -1;
+}
+
+size_t EthernetClient::write(const uint8_t *buffer, size_t size)
+{
+	if (socket < 0)
+		return 0;
+	ssize_t sent = send(socket, buffer, size, MSG_NOSIGNAL);
+	return sent < 0 ? 0 : sent;
+}
+
+int EthernetClient::available(void)
+{
+	int count = 0;
+
+	if (socket < 0 || ioctl(socket, FIONREAD, &count) < 0)
+		return 0;
+	return count;
+}
+
+int EthernetClient::read(void)
+{
+	unsigned char c;
+
+	if (available() <= 0 || recv(socket, &c, 1, 0) != 1)
+		return -1;
+	return c;
+}
+
+int EthernetClient::peek(void)
+{
+	unsigned char c;
+
+	if (available() <= 0 || recv(socket, &c, 1, MSG_PEEK) != 1)
+		return -1;
+	return c;
+}
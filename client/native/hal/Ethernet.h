@@ -0,0 +1,62 @@
+/*
+ *  Native HAL: Ethernet
+ *
+ *  EthernetClient is a plain TCP socket. Connections go to NATIVE_SERVER when
+ *  it's set, so the firmware can talk to a local development server. DHCP
+ *  answers with a fixed address, after NATIVE_DHCP attempts time out.
+ */
+#ifndef NATIVE_ETHERNET_H
+#define NATIVE_ETHERNET_H
+
+#include <Arduino.h>
+
+#define DHCP_CHECK_NONE 0
+#define DHCP_CHECK_RENEW_FAIL 1
+#define DHCP_CHECK_RENEW_OK 2
+#define DHCP_CHECK_REBIND_FAIL 3
+#define DHCP_CHECK_REBIND_OK 4
+
+class Client : public Stream
+{
+public:
+	virtual int connect(const char *host, uint16_t port) = 0;
+	virtual uint8_t connected(void) = 0;
+	virtual void stop(void) = 0;
+	using Print::write;
+};
+
+class EthernetClient : public Client
+{
+public:
+	EthernetClient() : socket(-1) {}
+	int connect(const char *host, uint16_t port);
+	uint8_t connected(void);
+	void stop(void);
+	size_t write(uint8_t c) { return write(&c, 1); }
+	size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+	int available(void);
+	int read(void);
+	int peek(void);
+
+private:
+	int socket;
+};
+
+class EthernetClass
+{
+public:
+	int begin(uint8_t *mac, unsigned long timeout = 60000, unsigned long responseTimeout = 4000);
+	void begin(uint8_t *mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet);
+	int maintain(void) { return DHCP_CHECK_NONE; }
+	IPAddress localIP(void) { return ip; }
+	IPAddress gatewayIP(void) { return gateway; }
+	IPAddress subnetMask(void) { return subnet; }
+
+private:
+	IPAddress ip, gateway, subnet;
+};
+
+extern EthernetClass Ethernet;
+
+#endif
@@ -0,0 +1,11 @@
+/*
+ *  Native HAL: IPAddress
+ *
+ *  IPAddress is declared along with the rest of the core in Arduino.h.
+ */
+#ifndef NATIVE_IP_ADDRESS_H
+#define NATIVE_IP_ADDRESS_H
+
+#include <Arduino.h>
+
+#endif
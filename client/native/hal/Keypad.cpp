@@ -0,0 +1,16 @@
+#include "Keypad.h"
+#include "NativeHal.h"
+
+Keypad::Keypad(char *userKeymap, byte *row, byte *col, byte numRows, byte numCols)
+{
+	(void)userKeymap;
+	(void)row;
+	(void)col;
+	(void)numRows;
+	(void)numCols;
+}
+
+char Keypad::getKey(void)
+{
+	return NativeHalTakeKey();
+}
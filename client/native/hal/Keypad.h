@@ -0,0 +1,21 @@
+/*
+ *  Native HAL: Keypad
+ *
+ *  Returns the keys typed by the script, one per call.
+ */
+#ifndef NATIVE_KEYPAD_H
+#define NATIVE_KEYPAD_H
+
+#include <Arduino.h>
+
+#define NO_KEY '\0'
+#define makeKeymap(x) ((char *)x)
+
+class Keypad
+{
+public:
+	Keypad(char *userKeymap, byte *row, byte *col, byte numRows, byte numCols);
+	char getKey(void);
+};
+
+#endif
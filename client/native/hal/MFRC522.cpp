@@ -0,0 +1,68 @@
+#include "MFRC522.h"
+#include "NativeHal.h"
+
+MFRC522::MFRC522() : reader(NATIVE_MAX_READERS), cardPresent(false), fifoLast(0)
+{
+	memset(&uid, 0, sizeof(uid));
+	memset(&card, 0, sizeof(card));
+	memset(registers, 0, sizeof(registers));
+}
+
+void MFRC522::PCD_Init(byte chipSelectPin, byte resetPowerDownPin)
+{
+	(void)chipSelectPin;
+	(void)resetPowerDownPin;
+	if (reader == NATIVE_MAX_READERS)
+		reader = NativeHalRegisterReader();
+}
+
+void MFRC522::PCD_DumpVersionToSerial(void)
+{
+	Serial.println("Firmware Version: native mock");
+}
+
+void MFRC522::PCD_WriteRegister(PCD_Register reg, byte value)
+{
+	switch (reg)
+	{
+	case ComIrqReg:
+		// Set1 cleared means the bits written as 1 are cleared
+		if ((value & 0x80) == 0)
+			NativeHalArmReader(reader, false);
+		break;
+	case FIFODataReg:
+		fifoLast = value;
+		break;
+	case BitFramingReg:
+		if ((value & 0x80) && registers[CommandReg >> 1] == PCD_Transceive && fifoLast == PICC_CMD_REQA)
+			NativeHalArmReader(reader, registers[ComIEnReg >> 1] & 0x20);
+		break;
+	default:
+		break;
+	}
+	registers[reg >> 1] = value;
+}
+
+byte MFRC522::PCD_ReadRegister(PCD_Register reg)
+{
+	return registers[reg >> 1];
+}
+
+bool MFRC522::PICC_IsNewCardPresent(void)
+{
+	if (!cardPresent)
+		cardPresent = NativeHalTakeCard(reader, card.uidByte, &card.size);
+	return cardPresent;
+}
+
+bool MFRC522::PICC_ReadCardSerial(void)
+{
+	// Without PICC_IsNewCardPresent, like after an IRQ, the card answered the REQA that armed the reader
+	if (!cardPresent)
+		cardPresent = NativeHalTakeCard(reader, card.uidByte, &card.size);
+	if (!cardPresent)
+		return false;
+	uid = card;
+	cardPresent = false;
+	return true;
+}
@@ -0,0 +1,67 @@
+/*
+ *  Native HAL: MFRC522
+ *
+ *  Each reader gets the cards the script taps on it, readers being numbered
+ *  in the order PCD_Init is called. Registers are only stored, except for
+ *  what arming a reader for the receive interrupt takes: enabling RxIEn and
+ *  starting a REQA transceive.
+ */
+#ifndef NATIVE_MFRC522_H
+#define NATIVE_MFRC522_H
+
+#include <Arduino.h>
+
+class MFRC522
+{
+public:
+	typedef struct
+	{
+		byte size;
+		byte uidByte[10];
+		byte sak;
+	} Uid;
+
+	enum PCD_Register : byte
+	{
+		CommandReg = 0x01 << 1,
+		ComIEnReg = 0x02 << 1,
+		DivIEnReg = 0x03 << 1,
+		ComIrqReg = 0x04 << 1,
+		DivIrqReg = 0x05 << 1,
+		FIFODataReg = 0x09 << 1,
+		FIFOLevelReg = 0x0A << 1,
+		BitFramingReg = 0x0D << 1,
+		TReloadRegH = 0x2C << 1,
+		TReloadRegL = 0x2D << 1
+	};
+
+	enum PCD_Command : byte
+	{
+		PCD_Idle = 0x00,
+		PCD_Transceive = 0x0C
+	};
+
+	enum PICC_Command : byte
+	{
+		PICC_CMD_REQA = 0x26
+	};
+
+	Uid uid;
+
+	MFRC522();
+	void PCD_Init(byte chipSelectPin, byte resetPowerDownPin);
+	void PCD_DumpVersionToSerial(void);
+	void PCD_WriteRegister(PCD_Register reg, byte value);
+	byte PCD_ReadRegister(PCD_Register reg);
+	bool PICC_IsNewCardPresent(void);
+	bool PICC_ReadCardSerial(void);
+
+private:
+	byte reader;
+	bool cardPresent;
+	Uid card;
+	byte registers[0x40];
+	byte fifoLast;
+};
+
+#endif
@@ -0,0 +1,493 @@
+#include <time.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "NativeHal.h"
+
+void setup(void);
+void loop(void);
+
+typedef struct
+{
+	unsigned long time;
+	std::string command;
+	std::string arguments;
+} ScriptLine;
+
+typedef struct
+{
+	byte size;
+	byte uid[10];
+} Card;
+
+static struct timespec startTime;
+static std::vector<ScriptLine> script;
+static size_t nextLine = 0;
+static bool running = true;
+
+static uint8_t pinLevels[NATIVE_NUM_PINS];
+static uint8_t pinModes[NATIVE_NUM_PINS];
+static bool pinTraced[NATIVE_NUM_PINS];
+static void (*pinHandlers[NATIVE_NUM_PINS])(void);
+static int pinHandlerModes[NATIVE_NUM_PINS];
+static byte readerCount = 0;
+static std::deque<Card> cards[NATIVE_MAX_READERS];
+static byte readerIrqPins[NATIVE_MAX_READERS];
+static bool readerArmed[NATIVE_MAX_READERS];
+static std::deque<char> keys;
+static std::deque<char> serialInput;
+
+static uint8_t eeprom[NATIVE_EEPROM_SIZE];
+static const char *eepromPath = NULL;
+
+static std::string serverHost;
+static uint16_t serverPort = 0;
+static int dhcpTimeouts = 0;
+
+HardwareSerial Serial;
+
+/*
+ *	Time and pins
+ */
+unsigned long micros(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - startTime.tv_sec) * 1000000UL + (now.tv_nsec - startTime.tv_nsec) / 1000;
+}
+
+unsigned long millis(void)
+{
+	return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+	usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	usleep(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	if (pin >= NATIVE_NUM_PINS)
+		return;
+	pinModes[pin] = mode;
+	if (mode == INPUT_PULLUP)
+		pinLevels[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	if (pin >= NATIVE_NUM_PINS)
+		return;
+	if (pinTraced[pin] && pinLevels[pin] != value)
+		fprintf(stderr, "[%lu] pin %u -> %u\n", millis(), pin, value);
+	pinLevels[pin] = value;
+}
+
+int digitalRead(uint8_t pin)
+{
+	return pin < NATIVE_NUM_PINS ? pinLevels[pin] : LOW;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode)
+{
+	if (interrupt >= NATIVE_NUM_PINS)
+		return;
+	pinHandlers[interrupt] = handler;
+	pinHandlerModes[interrupt] = mode;
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+	if (interrupt < NATIVE_NUM_PINS)
+		pinHandlers[interrupt] = NULL;
+}
+
+// Changes the level of an input pin, running its interrupt handler on a matching edge
+static void DriveInputPin(uint8_t pin, uint8_t level)
+{
+	uint8_t previous = pinLevels[pin];
+	pinLevels[pin] = level;
+	if (pinHandlers[pin] == NULL || previous == level)
+		return;
+	int mode = pinHandlerModes[pin];
+	if (mode == CHANGE || (mode == FALLING && level == LOW) || (mode == RISING && level == HIGH))
+		pinHandlers[pin]();
+}
+
+// Parses a comma separated list of pins, like NATIVE_TRACE and NATIVE_IRQ
+template <typename Callback>
+static void ForEachPin(const char *list, Callback callback)
+{
+	for (char *end; list != NULL && *list; list = *end ? end + 1 : end)
+	{
+		unsigned long pin = strtoul(list, &end, 10);
+		if (end == list)
+			break;
+		if (pin < NATIVE_NUM_PINS)
+			callback(pin);
+	}
+}
+
+/*
+ *	Print, Stream and Serial
+ */
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t written = 0;
+	while (size--)
+		written += write(*buffer++);
+	return written;
+}
+
+size_t Print::print(long n, int base)
+{
+	if (base == DEC && n < 0)
+		return print('-') + print((unsigned long)-n, base);
+	return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+	char buffer[8 * sizeof(long) + 1];
+	char *str = &buffer[sizeof(buffer) - 1];
+	*str = '\0';
+	if (base < 2)
+		base = 10;
+	do
+	{
+		unsigned long digit = n % base;
+		n /= base;
+		*--str = digit < 10 ? '0' + digit : 'A' + digit - 10;
+	} while (n);
+	return write(str);
+}
+
+size_t Print::print(double n, int digits)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+	return write(buffer);
+}
+
+size_t Print::print(const Printable &printable)
+{
+	return printable.printTo(*this);
+}
+
+int Stream::timedRead()
+{
+	unsigned long start = millis();
+	do
+	{
+		if (available() > 0)
+			return read();
+		usleep(100);
+	} while (millis() - start < timeout);
+	return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+	size_t count = 0;
+	while (count < length)
+	{
+		int c = timedRead();
+		if (c < 0)
+			break;
+		buffer[count++] = (char)c;
+	}
+	return count;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+	return fwrite(buffer, 1, size, stdout);
+}
+
+int HardwareSerial::available()
+{
+	return serialInput.size();
+}
+
+int HardwareSerial::read()
+{
+	if (serialInput.empty())
+		return -1;
+	char c = serialInput.front();
+	serialInput.pop_front();
+	return (unsigned char)c;
+}
+
+int HardwareSerial::peek()
+{
+	return serialInput.empty() ? -1 : (unsigned char)serialInput.front();
+}
+
+size_t IPAddress::printTo(Print &p) const
+{
+	size_t n = 0;
+	for (byte i = 0; i < 4; i++)
+	{
+		if (i > 0)
+			n += p.print('.');
+		n += p.print(octets[i], DEC);
+	}
+	return n;
+}
+
+/*
+ *	Script
+ */
+static void LoadScript(const char *path)
+{
+	char line[256];
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "native: can't open script %s\n", path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		char command[32] = "";
+		unsigned long time;
+		int consumed = 0;
+		if (line[0] == '#' || sscanf(line, "%lu %31s %n", &time, command, &consumed) < 2)
+			continue;
+		std::string arguments = line + consumed;
+		while (!arguments.empty() && (arguments.back() == '\n' || arguments.back() == '\r'))
+			arguments.pop_back();
+		script.push_back({time, command, arguments});
+	}
+	fclose(file);
+}
+
+static void RunScriptLine(const ScriptLine &line)
+{
+	if (line.command == "tap")
+	{
+		unsigned reader;
+		char hex[64];
+		Card card = {0, {0}};
+		if (sscanf(line.arguments.c_str(), "%u %63s", &reader, hex) != 2 || reader >= NATIVE_MAX_READERS)
+			return;
+		for (const char *digit = hex; digit[0] && digit[1] && card.size < sizeof(card.uid); digit += 2)
+		{
+			unsigned value;
+			sscanf(digit, "%2x", &value);
+			card.uid[card.size++] = value;
+		}
+		cards[reader].push_back(card);
+	}
+	else if (line.command == "keys")
+	{
+		for (char c : line.arguments)
+			if (c != ' ')
+				keys.push_back(c);
+	}
+	else if (line.command == "serial")
+		serialInput.insert(serialInput.end(), line.arguments.begin(), line.arguments.end());
+	else if (line.command == "pin")
+	{
+		unsigned pin, level;
+		if (sscanf(line.arguments.c_str(), "%u %u", &pin, &level) == 2 && pin < NATIVE_NUM_PINS)
+			DriveInputPin(pin, level ? HIGH : LOW);
+	}
+	else if (line.command == "quit")
+		running = false;
+	else
+		fprintf(stderr, "native: unknown command %s\n", line.command.c_str());
+}
+
+/*
+ *  void NativeHalBegin (int argc, char **argv);
+ *
+ *  Description:
+ *  - Loads the script, the EEPROM file and the server override
+ */
+void NativeHalBegin(int argc, char **argv)
+{
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	const char *scriptPath = argc > 1 ? argv[1] : getenv("NATIVE_SCRIPT");
+	if (scriptPath != NULL)
+		LoadScript(scriptPath);
+
+	ForEachPin(getenv("NATIVE_TRACE"), [](unsigned long pin) { pinTraced[pin] = true; });
+
+	byte irqReaders = 0;
+	memset(readerIrqPins, NATIVE_NUM_PINS, sizeof(readerIrqPins));
+	ForEachPin(getenv("NATIVE_IRQ"), [&irqReaders](unsigned long pin) {
+		if (irqReaders < NATIVE_MAX_READERS)
+			readerIrqPins[irqReaders++] = pin;
+	});
+
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	eepromPath = getenv("NATIVE_EEPROM");
+	if (eepromPath != NULL)
+	{
+		FILE *file = fopen(eepromPath, "rb");
+		if (file != NULL)
+		{
+			fread(eeprom, 1, sizeof(eeprom), file);
+			fclose(file);
+		}
+	}
+
+	const char *server = getenv("NATIVE_SERVER");
+	if (server != NULL)
+	{
+		const char *colon = strrchr(server, ':');
+		serverHost = colon != NULL ? std::string(server, colon - server) : server;
+		serverPort = colon != NULL ? atoi(colon + 1) : 0;
+	}
+
+	const char *dhcp = getenv("NATIVE_DHCP");
+	if (dhcp != NULL)
+		dhcpTimeouts = atoi(dhcp);
+}
+
+bool NativeHalRunning(void)
+{
+	return running;
+}
+
+/*
+ *  void NativeHalTick (void);
+ *
+ *  Description:
+ *  - Runs the script lines that are due, then raises the IRQ of the armed
+ *  readers that have a card waiting. Called before every loop() pass
+ */
+void NativeHalTick(void)
+{
+	unsigned long now = millis();
+	while (nextLine < script.size() && script[nextLine].time <= now)
+		RunScriptLine(script[nextLine++]);
+
+	for (byte reader = 0; reader < NATIVE_MAX_READERS; reader++)
+	{
+		if (readerArmed[reader] && !cards[reader].empty() && readerIrqPins[reader] < NATIVE_NUM_PINS)
+		{
+			readerArmed[reader] = false;
+			DriveInputPin(readerIrqPins[reader], LOW);
+		}
+	}
+}
+
+void NativeHalEnd(void)
+{
+	fflush(stdout);
+}
+
+/*
+ *	State used by the mocked libraries
+ */
+byte NativeHalRegisterReader(void)
+{
+	return readerCount < NATIVE_MAX_READERS ? readerCount++ : NATIVE_MAX_READERS - 1;
+}
+
+bool NativeHalTakeCard(byte reader, byte *uid, byte *uidSize)
+{
+	if (reader >= NATIVE_MAX_READERS || cards[reader].empty())
+		return false;
+	memcpy(uid, cards[reader].front().uid, cards[reader].front().size);
+	*uidSize = cards[reader].front().size;
+	cards[reader].pop_front();
+	return true;
+}
+
+/*
+ *  void NativeHalArmReader (byte reader, bool armed);
+ *
+ *  Description:
+ *  - An armed reader sent a REQA with the receive interrupt enabled. Disarming
+ *  it clears its interrupt requests, releasing the IRQ line
+ */
+void NativeHalArmReader(byte reader, bool armed)
+{
+	if (reader >= NATIVE_MAX_READERS)
+		return;
+	readerArmed[reader] = armed;
+	if (!armed && readerIrqPins[reader] < NATIVE_NUM_PINS)
+		DriveInputPin(readerIrqPins[reader], HIGH);
+}
+
+char NativeHalTakeKey(void)
+{
+	if (keys.empty())
+		return '\0';
+	char key = keys.front();
+	keys.pop_front();
+	return key;
+}
+
+uint8_t *NativeHalEeprom(void)
+{
+	return eeprom;
+}
+
+void NativeHalEepromChanged(void)
+{
+	if (eepromPath == NULL)
+		return;
+	FILE *file = fopen(eepromPath, "wb");
+	if (file != NULL)
+	{
+		fwrite(eeprom, 1, sizeof(eeprom), file);
+		fclose(file);
+	}
+}
+
+void NativeHalServer(const char **host, uint16_t *port)
+{
+	if (!serverHost.empty())
+		*host = serverHost.c_str();
+	if (serverPort != 0)
+		*port = serverPort;
+}
+
+/*
+ *  bool NativeHalDhcpAnswers (void);
+ *
+ *  Description:
+ *  - Tells if a DHCP attempt is answered, counting the ones set to time out
+ */
+bool NativeHalDhcpAnswers(void)
+{
+	if (dhcpTimeouts < 0)
+		return false;
+	if (dhcpTimeouts == 0)
+		return true;
+	dhcpTimeouts--;
+	return false;
+}
+
+int main(int argc, char **argv)
+{
+	NativeHalBegin(argc, argv);
+	setup();
+	while (NativeHalRunning())
+	{
+		NativeHalTick();
+		loop();
+		// Keeps an idle firmware from spinning a whole core
+		usleep(100);
+	}
+	NativeHalEnd();
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ *  Native HAL: simulated hardware
+ *
+ *  State shared by the mocked libraries and the input script that drives them.
+ *  The script is a text file given as first argument (or NATIVE_SCRIPT), one
+ *  command per line, each run once millis() reaches its time:
+ *
+ *    <ms> tap <reader> <uid hex>   card shows up on a reader (PCD_Init order)
+ *    <ms> keys <characters>        keys typed on the keypad
+ *    <ms> pin <number> <0|1>       level of an input pin, like the door sensor
+ *    <ms> serial <characters>      characters typed on the serial monitor
+ *    <ms> quit                     stops the firmware
+ *
+ *  Lines starting with '#' are ignored. Environment variables:
+ *
+ *    NATIVE_SERVER=host:port       where SERVER_IP connections go instead
+ *    NATIVE_EEPROM=path            file keeping the EEPROM between runs
+ *    NATIVE_TRACE=28,26            prints changes of these output pins to stderr
+ *    NATIVE_IRQ=2,3                IRQ pin of each reader (PCD_Init order). An
+ *                                  armed reader pulls it low when a card is tapped
+ *    NATIVE_DHCP=3                 DHCP attempts that time out before one is
+ *                                  answered, -1 for none ever
+ */
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <Arduino.h>
+
+#define NATIVE_NUM_PINS 70
+#define NATIVE_MAX_READERS 8
+#define NATIVE_EEPROM_SIZE 4096 // Same as the Mega 2560
+
+void NativeHalBegin(int argc, char **argv);
+bool NativeHalRunning(void);
+void NativeHalTick(void);
+void NativeHalEnd(void);
+
+byte NativeHalRegisterReader(void);
+bool NativeHalTakeCard(byte reader, byte *uid, byte *uidSize);
+void NativeHalArmReader(byte reader, bool armed);
+char NativeHalTakeKey(void);
+
+uint8_t *NativeHalEeprom(void);
+void NativeHalEepromChanged(void);
+
+void NativeHalServer(const char **host, uint16_t *port);
+bool NativeHalDhcpAnswers(void);
+
+#endif
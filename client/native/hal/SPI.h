@@ -0,0 +1,19 @@
+/*
+ *  Native HAL: SPI
+ *
+ *  Readers and Ethernet are mocked above the bus, so there is nothing to do.
+ */
+#ifndef NATIVE_SPI_H
+#define NATIVE_SPI_H
+
+#include <Arduino.h>
+
+class SPIClass
+{
+public:
+	void begin(void) {}
+};
+
+extern SPIClass SPI;
+
+#endif
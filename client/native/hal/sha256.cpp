@@ -0,0 +1,115 @@
+#include "sha256.h"
+
+static const uint32_t roundConstants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t initialState[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static uint32_t ror(uint32_t value, uint8_t bits)
+{
+	return value >> bits | value << (32 - bits);
+}
+
+void Sha256::init(void)
+{
+	memcpy(state, initialState, sizeof(state));
+	bufferOffset = 0;
+	byteCount = 0;
+}
+
+void Sha256::initHmac(const uint8_t *secret, int secretLength)
+{
+	memset(keyBuffer, 0, sizeof(keyBuffer));
+	if (secretLength > BLOCK_LENGTH)
+	{
+		init();
+		for (int i = 0; i < secretLength; i++)
+			write(secret[i]);
+		memcpy(keyBuffer, result(), HASH_LENGTH);
+	}
+	else
+		memcpy(keyBuffer, secret, secretLength);
+	init();
+	for (uint8_t i = 0; i < BLOCK_LENGTH; i++)
+		write((uint8_t)(keyBuffer[i] ^ 0x36));
+}
+
+void Sha256::hashBlock(void)
+{
+	uint32_t w[64], v[8];
+
+	for (uint8_t i = 0; i < 16; i++)
+		w[i] = (uint32_t)buffer[4 * i] << 24 | (uint32_t)buffer[4 * i + 1] << 16 | (uint32_t)buffer[4 * i + 2] << 8 | buffer[4 * i + 3];
+	for (uint8_t i = 16; i < 64; i++)
+	{
+		uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	memcpy(v, state, sizeof(v));
+	for (uint8_t i = 0; i < 64; i++)
+	{
+		uint32_t s1 = ror(v[4], 6) ^ ror(v[4], 11) ^ ror(v[4], 25);
+		uint32_t choice = (v[4] & v[5]) ^ (~v[4] & v[6]);
+		uint32_t t1 = v[7] + s1 + choice + roundConstants[i] + w[i];
+		uint32_t s0 = ror(v[0], 2) ^ ror(v[0], 13) ^ ror(v[0], 22);
+		uint32_t majority = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+		memmove(v + 1, v, 7 * sizeof(uint32_t));
+		v[4] += t1;
+		v[0] = t1 + s0 + majority;
+	}
+	for (uint8_t i = 0; i < 8; i++)
+		state[i] += v[i];
+}
+
+size_t Sha256::write(uint8_t data)
+{
+	byteCount++;
+	buffer[bufferOffset++] = data;
+	if (bufferOffset == BLOCK_LENGTH)
+	{
+		hashBlock();
+		bufferOffset = 0;
+	}
+	return 1;
+}
+
+uint8_t *Sha256::result(void)
+{
+	uint64_t bitCount = byteCount * 8;
+
+	write((uint8_t)0x80);
+	while (bufferOffset != BLOCK_LENGTH - 8)
+		write((uint8_t)0x00);
+	for (int8_t i = 7; i >= 0; i--)
+		write((uint8_t)(bitCount >> (8 * i)));
+
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		hash[4 * i] = state[i] >> 24;
+		hash[4 * i + 1] = state[i] >> 16;
+		hash[4 * i + 2] = state[i] >> 8;
+		hash[4 * i + 3] = state[i];
+	}
+	return hash;
+}
+
+uint8_t *Sha256::resultHmac(void)
+{
+	memcpy(innerHash, result(), HASH_LENGTH);
+	init();
+	for (uint8_t i = 0; i < BLOCK_LENGTH; i++)
+		write((uint8_t)(keyBuffer[i] ^ 0x5c));
+	for (uint8_t i = 0; i < HASH_LENGTH; i++)
+		write(innerHash[i]);
+	return result();
+}
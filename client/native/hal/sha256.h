@@ -0,0 +1,36 @@
+/*
+ *  Native HAL: Sha256
+ *
+ *  Same interface as the Cryptosuite library used on the board.
+ */
+#ifndef NATIVE_SHA256_H
+#define NATIVE_SHA256_H
+
+#include <Arduino.h>
+
+#define HASH_LENGTH 32
+#define BLOCK_LENGTH 64
+
+class Sha256 : public Print
+{
+public:
+	void init(void);
+	void initHmac(const uint8_t *secret, int secretLength);
+	uint8_t *result(void);
+	uint8_t *resultHmac(void);
+	size_t write(uint8_t data);
+	using Print::write;
+
+private:
+	void hashBlock(void);
+
+	uint32_t state[8];
+	uint8_t buffer[BLOCK_LENGTH];
+	uint8_t bufferOffset;
+	uint64_t byteCount;
+	uint8_t hash[HASH_LENGTH];
+	uint8_t keyBuffer[BLOCK_LENGTH];
+	uint8_t innerHash[HASH_LENGTH];
+};
+
+#endif
@@ -0,0 +1,417 @@
+#include <EEPROM.h>
+#include "AuthCache.h"
+
+static AuthCacheHeader header;
+static unsigned long ageMillis = 0; // millis() when header.staleHours was last counted
+static bool syncedThisBoot = false;
+
+/*
+ *  int CompareUID (const byte *a, byte aSize, const byte *b, byte bSize);
+ *
+ *  Description:
+ *  - Orders UIDs byte by byte, shorter UIDs first when one is a prefix of the other.
+ *  Must match the ordering used by the server when sending snapshots
+ *
+ *  Returns:
+ *  [int] Negative, zero or positive, like memcmp
+ */
+static int CompareUID(const byte *a, byte aSize, const byte *b, byte bSize)
+{
+	int cmp = memcmp(a, b, aSize < bSize ? aSize : bSize);
+	if (cmp != 0)
+		return cmp;
+	return (int)aSize - (int)bSize;
+}
+
+static int RecordAddress(uint16_t index)
+{
+	return AUTH_CACHE_RECORDS_BASE + index * sizeof(AuthCacheRecord);
+}
+
+static void ReadRecord(uint16_t index, AuthCacheRecord *record)
+{
+	EEPROM.get(RecordAddress(index), *record);
+}
+
+static void WriteRecord(uint16_t index, const AuthCacheRecord *record)
+{
+	// EEPROM.put only rewrites the bytes that changed
+	EEPROM.put(RecordAddress(index), *record);
+}
+
+static int PinAddress(uint16_t index)
+{
+	return AUTH_CACHE_PIN_EEPROM_BASE + index * sizeof(AuthCachePin);
+}
+
+static void ReadPin(uint16_t index, AuthCachePin *pin)
+{
+	EEPROM.get(PinAddress(index), *pin);
+}
+
+static void WritePin(uint16_t index, const AuthCachePin *pin)
+{
+	EEPROM.put(PinAddress(index), *pin);
+}
+
+static void WriteHeader(void)
+{
+	EEPROM.put(AUTH_CACHE_EEPROM_BASE, header);
+}
+
+/*
+ *  bool SearchRecord (const byte *uid, byte uidSize, uint16_t *position);
+ *
+ *  Description:
+ *  - Binary search over the stored records
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const byte *uid: the UID bytes
+ *  [INPUT] byte uidSize: number of bytes in the UID
+ *  [OUTPUT] uint16_t *position: index of the record, or where it should be inserted
+ *
+ *  Returns:
+ *  [bool] Was the UID found?
+ */
+static bool SearchRecord(const byte *uid, byte uidSize, uint16_t *position)
+{
+	AuthCacheRecord record;
+	uint16_t low = 0;
+	uint16_t high = header.count;
+	while (low < high)
+	{
+		uint16_t middle = low + (high - low) / 2;
+		ReadRecord(middle, &record);
+		int cmp = CompareUID(record.uid, record.uidSize, uid, uidSize);
+		if (cmp == 0)
+		{
+			*position = middle;
+			return true;
+		}
+		if (cmp < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	*position = low;
+	return false;
+}
+
+static unsigned long StaleMillis(void)
+{
+	return header.staleHours * AUTH_CACHE_AGE_STEP + (millis() - ageMillis);
+}
+
+/*
+ *  void AuthCacheBegin (void);
+ *
+ *  Description:
+ *  - Loads the cache header from EEPROM, formatting it if it was never written
+ *  or belongs to another layout. A cache persisted before the reboot is used
+ *  right away, but the reboot counts as an AUTH_CACHE_AGE_STEP of its age:
+ *  there is no clock to tell how long the power was off
+ */
+void AuthCacheBegin(void)
+{
+	EEPROM.get(AUTH_CACHE_EEPROM_BASE, header);
+	if (header.magic != AUTH_CACHE_MAGIC || header.count > AUTH_CACHE_CAPACITY)
+	{
+		memset(&header, 0, sizeof(header));
+		header.magic = AUTH_CACHE_MAGIC;
+		WriteHeader();
+	}
+	ageMillis = millis();
+	if (header.valid && header.staleHours < 255)
+	{
+		header.staleHours++;
+		WriteHeader();
+	}
+	syncedThisBoot = false;
+}
+
+/*
+ *  void AuthCacheTick (void);
+ *
+ *  Description:
+ *  - Keeps the age of the cache in EEPROM, an AUTH_CACHE_AGE_STEP at a time,
+ *  while it isn't synced. Called from the loop
+ */
+void AuthCacheTick(void)
+{
+	if (AuthCacheUsable() && millis() - ageMillis >= AUTH_CACHE_AGE_STEP)
+	{
+		header.staleHours++;
+		ageMillis += AUTH_CACHE_AGE_STEP;
+		WriteHeader();
+	}
+}
+
+/*
+ *  bool AuthCacheUsable (void);
+ *
+ *  Description:
+ *  - The cache can decide taps if it was completely synced, in this boot or
+ *  before, and hasn't gone AUTH_CACHE_MAX_AGE of uptime without a sync since
+ */
+bool AuthCacheUsable(void)
+{
+	return header.valid && StaleMillis() < AUTH_CACHE_MAX_AGE;
+}
+
+uint32_t AuthCacheVersion(void)
+{
+	return header.valid ? header.version : 0;
+}
+
+/*
+ *  uint32_t AuthCacheNow (void);
+ *
+ *  Description:
+ *  - Estimates server time from the last sync, since there is no RTC on board.
+ *  Until the next sync after a reboot it runs late by the time the power was off
+ *
+ *  Returns:
+ *  [uint32_t] Server epoch in seconds
+ */
+uint32_t AuthCacheNow(void)
+{
+	return header.syncTime + StaleMillis() / 1000;
+}
+
+/*
+ *  bool AuthCacheClockValid (void);
+ *
+ *  Description:
+ *  - AuthCacheNow can only be trusted after the server time was received in this boot
+ */
+bool AuthCacheClockValid(void)
+{
+	return syncedThisBoot;
+}
+
+/*
+ *  bool AuthCacheRoomKnown (byte door);
+ *
+ *  Description:
+ *  - The server sent the level of the door's room in the last sync. Servers that
+ *  predate multiple doors only send the first one's
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+bool AuthCacheRoomKnown(byte door)
+{
+	return door < header.roomCount;
+}
+
+byte AuthCacheRoomLevel(byte door)
+{
+	return AuthCacheRoomKnown(door) ? header.rooms[door].level : 0;
+}
+
+bool AuthCachePasswordRequired(byte door)
+{
+	return AuthCacheRoomKnown(door) && header.rooms[door].passwordRequired;
+}
+
+uint16_t AuthCacheCount(void)
+{
+	return header.count;
+}
+
+const byte *AuthCachePinSalt(void)
+{
+	return header.pinSalt;
+}
+
+/*
+ *  bool AuthCacheLookup (const byte *uid, byte uidSize, AuthCacheRecord *record);
+ *
+ *  Description:
+ *  - Finds the record of an UID. Expired records are reported as not found
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const byte *uid: the UID bytes
+ *  [INPUT] byte uidSize: number of bytes in the UID
+ *  [OUTPUT] AuthCacheRecord *record: the record found
+ *
+ *  Returns:
+ *  [bool] Is there a valid record for this UID?
+ */
+bool AuthCacheLookup(const byte *uid, byte uidSize, AuthCacheRecord *record)
+{
+	uint16_t position;
+	if (!AuthCacheUsable() || !SearchRecord(uid, uidSize, &position))
+		return false;
+	ReadRecord(position, record);
+	if (record->expires != AUTH_CACHE_NEVER_EXPIRES && record->expires <= AuthCacheNow())
+		return false;
+	return true;
+}
+
+/*
+ *  bool AuthCacheLookupPin (const byte *uid, byte uidSize, byte *verifier);
+ *
+ *  Description:
+ *  - Finds the PIN verifier of an UID, under the same rules as AuthCacheLookup
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const byte *uid: the UID bytes
+ *  [INPUT] byte uidSize: number of bytes in the UID
+ *  [OUTPUT] byte *verifier: the verifier, AUTH_CACHE_PIN_VERIFIER_SIZE bytes
+ *
+ *  Returns:
+ *  [bool] Is there a valid record with a verifier for this UID?
+ */
+bool AuthCacheLookupPin(const byte *uid, byte uidSize, byte *verifier)
+{
+	uint16_t position;
+	AuthCacheRecord record;
+	AuthCachePin pin;
+
+	if (!AuthCacheUsable() || !SearchRecord(uid, uidSize, &position))
+		return false;
+	ReadRecord(position, &record);
+	if (record.expires != AUTH_CACHE_NEVER_EXPIRES && record.expires <= AuthCacheNow())
+		return false;
+	ReadPin(position, &pin);
+	if (!pin.present)
+		return false;
+	memcpy(verifier, pin.verifier, AUTH_CACHE_PIN_VERIFIER_SIZE);
+	return true;
+}
+
+/*
+ *  void AuthCacheBeginUpdate (bool snapshot);
+ *
+ *  Description:
+ *  - Marks the cache as invalid until AuthCacheCommit is called, so a partially
+ *  applied update is never used (not even after a reset)
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] bool snapshot: drops every record when true
+ */
+void AuthCacheBeginUpdate(bool snapshot)
+{
+	header.valid = false;
+	if (snapshot)
+		header.count = 0;
+	WriteHeader();
+}
+
+/*
+ *  bool AuthCacheInsert (const AuthCacheRecord *record, const byte *pinVerifier);
+ *
+ *  Description:
+ *  - Inserts or replaces a record keeping the table sorted. Snapshots are sent
+ *  already sorted, so they are appended without shifting anything
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const AuthCacheRecord *record: the record
+ *  [INPUT] const byte *pinVerifier: its PIN verifier, NULL if it has none
+ *
+ *  Returns:
+ *  [bool] False if the UID is too long or the table is full
+ */
+bool AuthCacheInsert(const AuthCacheRecord *record, const byte *pinVerifier)
+{
+	uint16_t position;
+	AuthCacheRecord aux;
+	AuthCachePin pin;
+
+	if (record->uidSize == 0 || record->uidSize > AUTH_CACHE_UID_SIZE)
+		return false;
+	if (!SearchRecord(record->uid, record->uidSize, &position))
+	{
+		if (header.count >= AUTH_CACHE_CAPACITY)
+			return false;
+		for (uint16_t i = header.count; i > position; i--)
+		{
+			ReadRecord(i - 1, &aux);
+			WriteRecord(i, &aux);
+			ReadPin(i - 1, &pin);
+			WritePin(i, &pin);
+		}
+		header.count++;
+	}
+	WriteRecord(position, record);
+	memset(&pin, 0, sizeof(pin));
+	if (pinVerifier != NULL)
+	{
+		pin.present = true;
+		memcpy(pin.verifier, pinVerifier, AUTH_CACHE_PIN_VERIFIER_SIZE);
+	}
+	WritePin(position, &pin);
+	return true;
+}
+
+/*
+ *  bool AuthCacheRemove (const byte *uid, byte uidSize);
+ *
+ *  Description:
+ *  - Removes the record of an UID, if there is one
+ *
+ *  Returns:
+ *  [bool] Was the UID found?
+ */
+bool AuthCacheRemove(const byte *uid, byte uidSize)
+{
+	uint16_t position;
+	AuthCacheRecord aux;
+	AuthCachePin pin;
+
+	if (!SearchRecord(uid, uidSize, &position))
+		return false;
+	for (uint16_t i = position + 1; i < header.count; i++)
+	{
+		ReadRecord(i, &aux);
+		WriteRecord(i - 1, &aux);
+		ReadPin(i, &pin);
+		WritePin(i - 1, &pin);
+	}
+	header.count--;
+	WriteHeader();
+	return true;
+}
+
+/*
+ *  void AuthCacheCommit (uint32_t version, const AuthCacheRoom *rooms, byte roomCount, const byte *pinSalt, uint32_t serverTime);
+ *
+ *  Description:
+ *  - Finishes an update started by AuthCacheBeginUpdate, or just refreshes the
+ *  sync time when the server reports the table unchanged
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] uint32_t version: the table version reported by the server
+ *  [INPUT] const AuthCacheRoom *rooms: access level and password flag of each door's room
+ *  [INPUT] byte roomCount: number of rooms, up to AUTH_CACHE_MAX_ROOMS are kept
+ *  [INPUT] const byte *pinSalt: the rooms' salt for PIN verifiers, AUTH_CACHE_PIN_SALT_SIZE bytes
+ *  [INPUT] uint32_t serverTime: server epoch in seconds
+ */
+void AuthCacheCommit(uint32_t version, const AuthCacheRoom *rooms, byte roomCount, const byte *pinSalt, uint32_t serverTime)
+{
+	header.valid = true;
+	header.version = version;
+	header.roomCount = roomCount < AUTH_CACHE_MAX_ROOMS ? roomCount : AUTH_CACHE_MAX_ROOMS;
+	memset(header.rooms, 0, sizeof(header.rooms));
+	memcpy(header.rooms, rooms, header.roomCount * sizeof(AuthCacheRoom));
+	memcpy(header.pinSalt, pinSalt, AUTH_CACHE_PIN_SALT_SIZE);
+	header.syncTime = serverTime;
+	header.staleHours = 0;
+	WriteHeader();
+	ageMillis = millis();
+	syncedThisBoot = true;
+}
+
+/*
+ *  void AuthCacheInvalidate (void);
+ *
+ *  Description:
+ *  - Stops using the cache until the next complete sync
+ */
+void AuthCacheInvalidate(void)
+{
+	header.valid = false;
+	header.version = 0;
+	WriteHeader();
+}
@@ -0,0 +1,97 @@
+/*
+ *  Local authorization cache
+ *
+ *  Keeps a copy of the server's UID -> access level table in EEPROM so taps
+ *  that don't need a password can be decided without waiting for the server.
+ *  Records are fixed-size and kept sorted by UID, lookups use binary search.
+ *
+ *  The table is the same for every door. The header keeps the access level and
+ *  password flag of each door's room, in doorConfigs order. Users allowed into
+ *  one of the rooms that ask for a password also get a PIN verifier: the
+ *  SHA-256 of their PIN keyed with a salt the server derives for these rooms,
+ *  truncated. Verifiers live after the journal, one slot per record in the
+ *  same order, so a PIN can be checked without asking the server.
+ *
+ *  This only guards against casual access. The salt is stored here too and a
+ *  4-digit PIN takes 10^4 tries, so a dump of the EEPROM reveals the PIN of every
+ *  cached user, which works at every room and at /api/authenticate.
+ */
+#ifndef AUTH_CACHE_H
+#define AUTH_CACHE_H
+
+#include <Arduino.h>
+
+/*
+ *  Macros
+ */
+#define AUTH_CACHE_EEPROM_BASE 0
+#define AUTH_CACHE_EEPROM_SIZE 2048
+#define AUTH_CACHE_MAGIC 0xAC03
+#define AUTH_CACHE_UID_SIZE 10
+#define AUTH_CACHE_MAX_AGE 86400000UL // Cache is ignored after a day of uptime without a sync
+#define AUTH_CACHE_AGE_STEP 3600000UL // Uptime without a sync is kept in EEPROM in these steps
+#define AUTH_CACHE_NEVER_EXPIRES 0
+#define AUTH_CACHE_PIN_EEPROM_BASE 3072 // After the journal
+#define AUTH_CACHE_PIN_EEPROM_SIZE 1024
+#define AUTH_CACHE_PIN_SALT_SIZE 16 // Must match PIN_SALT_SIZE in the server's consts.py
+#define AUTH_CACHE_PIN_VERIFIER_SIZE 7 // Must match PIN_VERIFIER_SIZE in the server's consts.py
+#define AUTH_CACHE_MAX_ROOMS 8
+
+typedef struct
+{
+	byte uidSize;
+	byte uid[AUTH_CACHE_UID_SIZE];
+	byte accessLevel;
+	uint32_t expires; // Server epoch (seconds), AUTH_CACHE_NEVER_EXPIRES for no expiration
+} AuthCacheRecord;
+
+typedef struct
+{
+	byte level;
+	byte passwordRequired;
+} AuthCacheRoom;
+
+typedef struct
+{
+	uint16_t magic;
+	byte valid;
+	byte roomCount;
+	byte staleHours; // AUTH_CACHE_AGE_STEPs of uptime since the last commit, reboots included
+	uint16_t count;
+	uint32_t version;
+	uint32_t syncTime; // Server epoch (seconds) of the last commit
+	byte pinSalt[AUTH_CACHE_PIN_SALT_SIZE];
+	AuthCacheRoom rooms[AUTH_CACHE_MAX_ROOMS]; // One per door, the first roomCount are set
+} AuthCacheHeader;
+
+typedef struct
+{
+	byte present;
+	byte verifier[AUTH_CACHE_PIN_VERIFIER_SIZE];
+} AuthCachePin;
+
+#define AUTH_CACHE_RECORDS_BASE (AUTH_CACHE_EEPROM_BASE + sizeof(AuthCacheHeader))
+#define AUTH_CACHE_CAPACITY ((AUTH_CACHE_EEPROM_SIZE - sizeof(AuthCacheHeader)) / sizeof(AuthCacheRecord))
+
+static_assert(AUTH_CACHE_CAPACITY * sizeof(AuthCachePin) <= AUTH_CACHE_PIN_EEPROM_SIZE, "No PIN slot for every record");
+
+void AuthCacheBegin(void);
+void AuthCacheTick(void);
+bool AuthCacheUsable(void);
+uint32_t AuthCacheVersion(void);
+uint32_t AuthCacheNow(void);
+bool AuthCacheClockValid(void);
+bool AuthCacheRoomKnown(byte door);
+byte AuthCacheRoomLevel(byte door);
+bool AuthCachePasswordRequired(byte door);
+uint16_t AuthCacheCount(void);
+const byte *AuthCachePinSalt(void);
+bool AuthCacheLookup(const byte *uid, byte uidSize, AuthCacheRecord *record);
+bool AuthCacheLookupPin(const byte *uid, byte uidSize, byte *verifier);
+void AuthCacheBeginUpdate(bool snapshot);
+bool AuthCacheInsert(const AuthCacheRecord *record, const byte *pinVerifier);
+bool AuthCacheRemove(const byte *uid, byte uidSize);
+void AuthCacheCommit(uint32_t version, const AuthCacheRoom *rooms, byte roomCount, const byte *pinSalt, uint32_t serverTime);
+void AuthCacheInvalidate(void);
+
+#endif
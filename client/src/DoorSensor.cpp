@@ -0,0 +1,135 @@
+#include "DoorSensor.h"
+
+static_assert(DOOR_DEBOUNCE_TIME > 0 && DOOR_DEBOUNCE_TIME <= 255, "The integrators are bytes");
+
+static const FastPinRef *sensorPins = NULL;
+static byte sensorCount = 0;
+
+// Written by the sampler only
+static byte integrators[DOOR_SENSOR_MAX_DOORS];
+static volatile byte openDoors = 0; // One bit per door, debounced
+static DoorEdge queue[DOOR_SENSOR_QUEUE_SIZE];
+static volatile byte queueHead = 0;
+
+// Written by the loop only
+static volatile byte queueTail = 0;
+static byte reportedOpen = 0; // Doors whose open edge was handed to the loop
+
+static void PushEdge(byte door, bool open, unsigned long time)
+{
+	byte next = (queueHead + 1) % DOOR_SENSOR_QUEUE_SIZE;
+	// A full queue drops the edge, DoorSensorNextEdge catches up from openDoors
+	if (next == queueTail)
+		return;
+	queue[queueHead].door = door;
+	queue[queueHead].open = open;
+	queue[queueHead].time = time;
+	queueHead = next;
+}
+
+static void Sample(void)
+{
+	unsigned long now = millis();
+
+	for (byte d = 0; d < sensorCount; d++)
+	{
+		byte bit = 1 << d;
+		if (FastPinRead(&sensorPins[d]))
+		{
+			if (integrators[d] < DOOR_DEBOUNCE_TIME && ++integrators[d] == DOOR_DEBOUNCE_TIME && !(openDoors & bit))
+			{
+				openDoors |= bit;
+				PushEdge(d, true, now);
+			}
+		}
+		else if (integrators[d] > 0 && --integrators[d] == 0 && (openDoors & bit))
+		{
+			openDoors &= ~bit;
+			PushEdge(d, false, now);
+		}
+	}
+}
+
+#ifdef __AVR__
+ISR(TIMER0_COMPB_vect)
+{
+	Sample();
+}
+#endif
+
+/*
+ *  void DoorSensorBegin (const FastPinRef *sensors, byte count);
+ *
+ *  Description:
+ *  - Starts sampling the sensors. All doors start closed, so a door open at
+ *  boot shows up as an open edge
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const FastPinRef *sensors: the sensor pins, HIGH when the door is open. Must outlive the sampler
+ *  [INPUT] byte count: number of doors, at most DOOR_SENSOR_MAX_DOORS
+ */
+void DoorSensorBegin(const FastPinRef *sensors, byte count)
+{
+	sensorPins = sensors;
+	sensorCount = count > DOOR_SENSOR_MAX_DOORS ? DOOR_SENSOR_MAX_DOORS : count;
+#ifdef __AVR__
+	// Halfway through Timer0's count, away from the overflow that updates millis()
+	OCR0B = 0x80;
+	TIMSK0 |= _BV(OCIE0B);
+#endif
+}
+
+/*
+ *  void DoorSensorTick (void);
+ *
+ *  Description:
+ *  - Samples the sensors once per millisecond elapsed, where the timer
+ *  interrupt doesn't do it. Called on every loop pass
+ */
+void DoorSensorTick(void)
+{
+#ifndef __AVR__
+	static unsigned long lastSample = 0;
+	for (; millis() - lastSample >= 1; lastSample++)
+		Sample();
+#endif
+}
+
+/*
+ *  bool DoorSensorNextEdge (DoorEdge *edge);
+ *
+ *  Description:
+ *  - Takes the oldest edge not consumed yet. If edges were dropped because the
+ *  loop didn't keep up, a door whose state differs from the last edge consumed
+ *  gets an edge timed now
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] DoorEdge *edge: the edge
+ *
+ *  Returns:
+ *  [bool] Was there an edge?
+ */
+bool DoorSensorNextEdge(DoorEdge *edge)
+{
+	if (queueTail != queueHead)
+	{
+		*edge = queue[queueTail];
+		queueTail = (queueTail + 1) % DOOR_SENSOR_QUEUE_SIZE;
+	}
+	else
+	{
+		byte differing = openDoors ^ reportedOpen;
+		if (differing == 0)
+			return false;
+		edge->door = 0;
+		while (!(differing & (1 << edge->door)))
+			edge->door++;
+		edge->open = openDoors & (1 << edge->door);
+		edge->time = millis();
+	}
+	if (edge->open)
+		reportedOpen |= 1 << edge->door;
+	else
+		reportedOpen &= ~(1 << edge->door);
+	return true;
+}
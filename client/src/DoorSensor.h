@@ -0,0 +1,41 @@
+/*
+ *  Debounced door sensors
+ *
+ *  The TCRT5000 inputs are sampled about once a millisecond from the Timer0
+ *  compare B interrupt, which fires alongside the one driving millis() and
+ *  leaves Timer0 untouched. Each input goes through an integrator: the count
+ *  moves towards the level read on every sample and the door's state only
+ *  flips once it reaches an end, so the level must hold for DOOR_DEBOUNCE_TIME
+ *  and shorter glitches are absorbed. Every flip is queued as an edge with its
+ *  time, for the loop to consume instead of reading the sensors.
+ *
+ *  Where there's no timer interrupt (native build), DoorSensorTick samples
+ *  from the loop instead.
+ */
+#ifndef DOOR_SENSOR_H
+#define DOOR_SENSOR_H
+
+#include <Arduino.h>
+#include "FastPin.h"
+
+/*
+ *  Macros
+ */
+#ifndef DOOR_DEBOUNCE_TIME
+#define DOOR_DEBOUNCE_TIME 50 // Samples (~1 ms each) a level must hold, at most 255
+#endif
+#define DOOR_SENSOR_MAX_DOORS 8
+#define DOOR_SENSOR_QUEUE_SIZE 8
+
+typedef struct
+{
+	byte door;
+	bool open;
+	unsigned long time; // millis() when the new level was confirmed
+} DoorEdge;
+
+void DoorSensorBegin(const FastPinRef *sensors, byte count);
+void DoorSensorTick(void);
+bool DoorSensorNextEdge(DoorEdge *edge);
+
+#endif
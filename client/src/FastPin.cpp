@@ -0,0 +1,69 @@
+#include "FastPin.h"
+
+/*
+ *  void FastPinInit (FastPinRef *ref, uint8_t pin);
+ *
+ *  Description:
+ *  - Resolves the port registers of a pin only known at run time
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] FastPinRef *ref: the resolved pin
+ *  [INPUT] uint8_t pin: Arduino pin number
+ */
+void FastPinInit(FastPinRef *ref, uint8_t pin)
+{
+#ifdef FAST_PIN_DIRECT
+	// The core's PROGMEM tables, fastPinMap is only meant for compile time
+	ref->registers = portInputRegister(digitalPinToPort(pin));
+	ref->mask = digitalPinToBitMask(pin);
+#else
+	ref->pin = pin;
+#endif
+}
+
+/*
+ *  void FastRgbInit (FastRgb *rgb, const uint8_t pins[3]);
+ *
+ *  Description:
+ *  - Resolves the three pins of an RGB LED and checks if they share a port
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] FastRgb *rgb: the resolved LED
+ *  [INPUT] const uint8_t pins[3]: red, green and blue Arduino pin numbers
+ */
+void FastRgbInit(FastRgb *rgb, const uint8_t pins[3])
+{
+	for (uint8_t i = 0; i < 3; i++)
+		FastPinInit(&rgb->pins[i], pins[i]);
+#ifdef FAST_PIN_DIRECT
+	rgb->samePort = rgb->pins[0].registers == rgb->pins[1].registers && rgb->pins[0].registers == rgb->pins[2].registers;
+#else
+	rgb->samePort = false;
+#endif
+}
+
+/*
+ *  void FastRgbWrite (const FastRgb *rgb, const uint8_t color[3]);
+ *
+ *  Description:
+ *  - Writes a color, with a single port update if the pins share a port
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const FastRgb *rgb: the LED
+ *  [INPUT] const uint8_t color[3]: red, green and blue levels
+ */
+void FastRgbWrite(const FastRgb *rgb, const uint8_t color[3])
+{
+#ifdef FAST_PIN_DIRECT
+	if (rgb->samePort)
+	{
+		volatile uint8_t *port = &rgb->pins[0].registers[2];
+		uint8_t mask = rgb->pins[0].mask | rgb->pins[1].mask | rgb->pins[2].mask;
+		uint8_t set = (color[0] ? rgb->pins[0].mask : 0) | (color[1] ? rgb->pins[1].mask : 0) | (color[2] ? rgb->pins[2].mask : 0);
+		*port = (*port & ~mask) | set;
+		return;
+	}
+#endif
+	for (uint8_t i = 0; i < 3; i++)
+		FastPinWrite(&rgb->pins[i], color[i]);
+}
@@ -0,0 +1,173 @@
+/*
+ *  Direct port I/O
+ *
+ *  digitalWrite and digitalRead look the pin up in three PROGMEM tables and
+ *  disable interrupts on every call. The pins written on every reader poll
+ *  (SS, LEDs) and read on every sensor sample are accessed here through their
+ *  PORT/PIN registers instead:
+ *
+ *  - FastPin<PIN> for pins known at compile time: the port and bit are folded
+ *    into a single sbi/cbi/sbis instruction where the port allows it
+ *  - FastPinRef for pins from the door and reader tables, resolved once at boot
+ *  - FastRgb for an RGB LED, written with a single port update when its three
+ *    pins share a port
+ *
+ *  Ports are updated with a plain read-modify-write, so no interrupt handler
+ *  may write to them. Outside the Mega 2560 (native build) everything falls
+ *  back to digitalWrite/digitalRead.
+ */
+#ifndef FAST_PIN_H
+#define FAST_PIN_H
+
+#include <Arduino.h>
+
+#if defined(__AVR_ATmega2560__)
+#define FAST_PIN_DIRECT
+#endif
+
+#ifdef FAST_PIN_DIRECT
+/*
+ *  Mega 2560 pin map, same as the core's pins_arduino.h: port index << 3 | bit
+ */
+#define FAST_PORT_A 0
+#define FAST_PORT_B 1
+#define FAST_PORT_C 2
+#define FAST_PORT_D 3
+#define FAST_PORT_E 4
+#define FAST_PORT_F 5
+#define FAST_PORT_G 6
+#define FAST_PORT_H 7
+#define FAST_PORT_J 8
+#define FAST_PORT_K 9
+#define FAST_PORT_L 10
+#define FAST_PIN_ENTRY(port, bit) ((FAST_PORT_##port << 3) | (bit))
+
+constexpr uint8_t fastPinMap[] = {
+	FAST_PIN_ENTRY(E, 0), FAST_PIN_ENTRY(E, 1), FAST_PIN_ENTRY(E, 4), FAST_PIN_ENTRY(E, 5), FAST_PIN_ENTRY(G, 5), // 0-4
+	FAST_PIN_ENTRY(E, 3), FAST_PIN_ENTRY(H, 3), FAST_PIN_ENTRY(H, 4), FAST_PIN_ENTRY(H, 5), FAST_PIN_ENTRY(H, 6), // 5-9
+	FAST_PIN_ENTRY(B, 4), FAST_PIN_ENTRY(B, 5), FAST_PIN_ENTRY(B, 6), FAST_PIN_ENTRY(B, 7), FAST_PIN_ENTRY(J, 1), // 10-14
+	FAST_PIN_ENTRY(J, 0), FAST_PIN_ENTRY(H, 1), FAST_PIN_ENTRY(H, 0), FAST_PIN_ENTRY(D, 3), FAST_PIN_ENTRY(D, 2), // 15-19
+	FAST_PIN_ENTRY(D, 1), FAST_PIN_ENTRY(D, 0), FAST_PIN_ENTRY(A, 0), FAST_PIN_ENTRY(A, 1), FAST_PIN_ENTRY(A, 2), // 20-24
+	FAST_PIN_ENTRY(A, 3), FAST_PIN_ENTRY(A, 4), FAST_PIN_ENTRY(A, 5), FAST_PIN_ENTRY(A, 6), FAST_PIN_ENTRY(A, 7), // 25-29
+	FAST_PIN_ENTRY(C, 7), FAST_PIN_ENTRY(C, 6), FAST_PIN_ENTRY(C, 5), FAST_PIN_ENTRY(C, 4), FAST_PIN_ENTRY(C, 3), // 30-34
+	FAST_PIN_ENTRY(C, 2), FAST_PIN_ENTRY(C, 1), FAST_PIN_ENTRY(C, 0), FAST_PIN_ENTRY(D, 7), FAST_PIN_ENTRY(G, 2), // 35-39
+	FAST_PIN_ENTRY(G, 1), FAST_PIN_ENTRY(G, 0), FAST_PIN_ENTRY(L, 7), FAST_PIN_ENTRY(L, 6), FAST_PIN_ENTRY(L, 5), // 40-44
+	FAST_PIN_ENTRY(L, 4), FAST_PIN_ENTRY(L, 3), FAST_PIN_ENTRY(L, 2), FAST_PIN_ENTRY(L, 1), FAST_PIN_ENTRY(L, 0), // 45-49
+	FAST_PIN_ENTRY(B, 3), FAST_PIN_ENTRY(B, 2), FAST_PIN_ENTRY(B, 1), FAST_PIN_ENTRY(B, 0), FAST_PIN_ENTRY(F, 0), // 50-54
+	FAST_PIN_ENTRY(F, 1), FAST_PIN_ENTRY(F, 2), FAST_PIN_ENTRY(F, 3), FAST_PIN_ENTRY(F, 4), FAST_PIN_ENTRY(F, 5), // 55-59
+	FAST_PIN_ENTRY(F, 6), FAST_PIN_ENTRY(F, 7), FAST_PIN_ENTRY(K, 0), FAST_PIN_ENTRY(K, 1), FAST_PIN_ENTRY(K, 2), // 60-64
+	FAST_PIN_ENTRY(K, 3), FAST_PIN_ENTRY(K, 4), FAST_PIN_ENTRY(K, 5), FAST_PIN_ENTRY(K, 6), FAST_PIN_ENTRY(K, 7), // 65-69
+};
+
+#define FAST_PIN_COUNT (sizeof(fastPinMap) / sizeof(fastPinMap[0]))
+
+constexpr uint8_t FastPinPort(uint8_t pin)
+{
+	return fastPinMap[pin] >> 3;
+}
+
+constexpr uint8_t FastPinMask(uint8_t pin)
+{
+	return 1 << (fastPinMap[pin] & 7);
+}
+
+// PINx, DDRx and PORTx are consecutive on every port, so the PINx address is enough
+inline volatile uint8_t *FastPinInputRegister(uint8_t port)
+{
+	switch (port)
+	{
+	case FAST_PORT_A:
+		return &PINA;
+	case FAST_PORT_B:
+		return &PINB;
+	case FAST_PORT_C:
+		return &PINC;
+	case FAST_PORT_D:
+		return &PIND;
+	case FAST_PORT_E:
+		return &PINE;
+	case FAST_PORT_F:
+		return &PINF;
+	case FAST_PORT_G:
+		return &PING;
+	case FAST_PORT_H:
+		return &PINH;
+	case FAST_PORT_J:
+		return &PINJ;
+	case FAST_PORT_K:
+		return &PINK;
+	default:
+		return &PINL;
+	}
+}
+
+template <uint8_t Pin>
+struct FastPin
+{
+	static_assert(Pin < FAST_PIN_COUNT, "Not a Mega 2560 pin");
+	static constexpr uint8_t port = FastPinPort(Pin);
+	static constexpr uint8_t mask = FastPinMask(Pin);
+
+	static inline void High(void) { FastPinInputRegister(port)[2] |= mask; }
+	static inline void Low(void) { FastPinInputRegister(port)[2] &= ~mask; }
+	static inline void Write(bool level) { level ? High() : Low(); }
+	static inline bool Read(void) { return FastPinInputRegister(port)[0] & mask; }
+	static inline void Output(void) { FastPinInputRegister(port)[1] |= mask; }
+};
+
+typedef struct
+{
+	volatile uint8_t *registers; // PINx, followed by DDRx and PORTx
+	uint8_t mask;
+} FastPinRef;
+
+inline void FastPinWrite(const FastPinRef *ref, bool level)
+{
+	if (level)
+		ref->registers[2] |= ref->mask;
+	else
+		ref->registers[2] &= ~ref->mask;
+}
+
+inline bool FastPinRead(const FastPinRef *ref)
+{
+	return ref->registers[0] & ref->mask;
+}
+#else
+template <uint8_t Pin>
+struct FastPin
+{
+	static inline void High(void) { digitalWrite(Pin, HIGH); }
+	static inline void Low(void) { digitalWrite(Pin, LOW); }
+	static inline void Write(bool level) { digitalWrite(Pin, level ? HIGH : LOW); }
+	static inline bool Read(void) { return digitalRead(Pin) == HIGH; }
+	static inline void Output(void) { pinMode(Pin, OUTPUT); }
+};
+
+typedef struct
+{
+	uint8_t pin;
+} FastPinRef;
+
+inline void FastPinWrite(const FastPinRef *ref, bool level)
+{
+	digitalWrite(ref->pin, level ? HIGH : LOW);
+}
+
+inline bool FastPinRead(const FastPinRef *ref)
+{
+	return digitalRead(ref->pin) == HIGH;
+}
+#endif
+
+typedef struct
+{
+	FastPinRef pins[3]; // Red, green and blue
+	bool samePort;
+} FastRgb;
+
+void FastPinInit(FastPinRef *ref, uint8_t pin);
+void FastRgbInit(FastRgb *rgb, const uint8_t pins[3]);
+void FastRgbWrite(const FastRgb *rgb, const uint8_t color[3]);
+
+#endif
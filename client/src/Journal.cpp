@@ -0,0 +1,186 @@
+#include <EEPROM.h>
+#include <stddef.h>
+#include "Journal.h"
+
+static uint16_t headSlot = 0;
+static uint16_t pendingCount = 0;
+static uint32_t nextSequence = 1;
+static uint32_t bootSequence = 1;
+
+static int SlotAddress(uint16_t slot)
+{
+	return JOURNAL_EEPROM_BASE + slot * sizeof(JournalRecord);
+}
+
+static byte Checksum(const JournalRecord *record)
+{
+	const byte *bytes = (const byte *)record;
+	byte sum = JOURNAL_MAGIC;
+	for (byte i = 0; i < offsetof(JournalRecord, checksum); i++)
+		sum = (sum << 1 | sum >> 7) ^ bytes[i];
+	return sum;
+}
+
+static bool ReadSlot(uint16_t slot, JournalRecord *record)
+{
+	EEPROM.get(SlotAddress(slot), *record);
+	return record->checksum == Checksum(record);
+}
+
+static uint16_t OldestPendingSlot(void)
+{
+	return (headSlot + JOURNAL_CAPACITY - pendingCount) % JOURNAL_CAPACITY;
+}
+
+/*
+ *  void JournalBegin (void);
+ *
+ *  Description:
+ *  - Finds the newest record and counts the ones not uploaded yet
+ */
+void JournalBegin(void)
+{
+	JournalRecord record;
+	uint32_t newest = 0;
+	uint16_t newestSlot = 0;
+
+	for (uint16_t slot = 0; slot < JOURNAL_CAPACITY; slot++)
+	{
+		if (ReadSlot(slot, &record) && record.sequence > newest)
+		{
+			newest = record.sequence;
+			newestSlot = slot;
+		}
+	}
+
+	pendingCount = 0;
+	if (newest == 0)
+	{
+		// Picked on the first append, see JournalAppend
+		headSlot = 0;
+		nextSequence = 0;
+	}
+	else
+	{
+		headSlot = (newestSlot + 1) % JOURNAL_CAPACITY;
+		nextSequence = newest + 1;
+		// Pending records are the consecutive ones right before the head
+		for (uint16_t i = 0; i < JOURNAL_CAPACITY; i++)
+		{
+			uint16_t slot = (newestSlot + JOURNAL_CAPACITY - i) % JOURNAL_CAPACITY;
+			if (!ReadSlot(slot, &record) || record.sequence != newest - i || record.uploaded)
+				break;
+			pendingCount++;
+		}
+	}
+	bootSequence = nextSequence;
+}
+
+uint16_t JournalPending(void)
+{
+	return pendingCount;
+}
+
+/*
+ *  void JournalAppend (byte api, byte eventType, byte door, byte readerPosition, const byte *uid, byte uidSize);
+ *
+ *  Description:
+ *  - Writes an event to the journal. If it's full, the oldest record is lost
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte api: which API the event belongs to
+ *  [INPUT] byte eventType: server status code of the event
+ *  [INPUT] byte door: the door the event happened at
+ *  [INPUT] byte readerPosition: indicates if the person was entering or leaving the room
+ *  [INPUT] const byte *uid: the UID bytes, NULL if there's no card
+ *  [INPUT] byte uidSize: number of bytes in the UID
+ */
+void JournalAppend(byte api, byte eventType, byte door, byte readerPosition, const byte *uid, byte uidSize)
+{
+	JournalRecord record;
+
+	// The server skips events it already has from this room and door by sequence, so a
+	// blank journal doesn't start at 1, where a previous controller at the door did: the
+	// time of the first event, in microseconds, is as good a random start as the board has
+	if (nextSequence == 0)
+		nextSequence = (micros() & 0x3FFFFFFFUL) | 1;
+
+	memset(&record, 0, sizeof(record));
+	record.sequence = nextSequence++;
+	record.timeIsEpoch = AuthCacheClockValid();
+	record.time = record.timeIsEpoch ? AuthCacheNow() : millis() / 1000;
+	record.api = api;
+	record.eventType = eventType;
+	record.readerPosition = readerPosition;
+	record.door = door;
+	record.uidSize = uidSize > AUTH_CACHE_UID_SIZE ? AUTH_CACHE_UID_SIZE : uidSize;
+	if (uid != NULL)
+		memcpy(record.uid, uid, record.uidSize);
+	record.checksum = Checksum(&record);
+
+	// EEPROM.put only rewrites the bytes that changed
+	EEPROM.put(SlotAddress(headSlot), record);
+	headSlot = (headSlot + 1) % JOURNAL_CAPACITY;
+	if (pendingCount < JOURNAL_CAPACITY)
+		pendingCount++;
+}
+
+/*
+ *  void JournalPeek (uint16_t index, JournalRecord *record);
+ *
+ *  Description:
+ *  - Reads a record not uploaded yet, 0 being the oldest
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] uint16_t index: position among the pending records, less than JournalPending()
+ *  [OUTPUT] JournalRecord *record: the record read
+ */
+void JournalPeek(uint16_t index, JournalRecord *record)
+{
+	ReadSlot((OldestPendingSlot() + index) % JOURNAL_CAPACITY, record);
+}
+
+/*
+ *  uint32_t JournalRecordTime (const JournalRecord *record);
+ *
+ *  Description:
+ *  - Converts the record's time to server epoch. Records written before the
+ *  clock was synced can only be converted during the same boot
+ *
+ *  Returns:
+ *  [uint32_t] Server epoch in seconds, 0 if unknown
+ */
+uint32_t JournalRecordTime(const JournalRecord *record)
+{
+	if (record->timeIsEpoch)
+		return record->time;
+	if (record->sequence < bootSequence || !AuthCacheClockValid())
+		return 0;
+	return AuthCacheNow() - (millis() / 1000 - record->time);
+}
+
+/*
+ *  void JournalAck (uint32_t firstSequence, uint16_t count);
+ *
+ *  Description:
+ *  - Marks uploaded records. Only those in the range sent are marked, in case
+ *  older ones were overwritten while the upload was in flight
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] uint32_t firstSequence: sequence of the first record uploaded
+ *  [INPUT] uint16_t count: number of records uploaded
+ */
+void JournalAck(uint32_t firstSequence, uint16_t count)
+{
+	JournalRecord record;
+
+	while (pendingCount > 0)
+	{
+		uint16_t slot = OldestPendingSlot();
+		ReadSlot(slot, &record);
+		if (record.sequence >= firstSequence + count)
+			break;
+		EEPROM.update(SlotAddress(slot) + offsetof(JournalRecord, uploaded), 1);
+		pendingCount--;
+	}
+}
@@ -0,0 +1,52 @@
+/*
+ *  Offline event journal
+ *
+ *  Ring buffer in EEPROM, right after the authorization cache, holding the
+ *  events the server hasn't seen yet: unlocks decided by the cache, taps made
+ *  while the server was unreachable and door openings. Records are uploaded in
+ *  batches and marked as uploaded once the server acknowledges them.
+ *
+ *  There is no header to rewrite on every event: each record carries a
+ *  sequence number and the newest one is found by scanning at boot, so writes
+ *  are spread over the whole area.
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <Arduino.h>
+#include "AuthCache.h"
+
+/*
+ *  Macros
+ */
+#define JOURNAL_EEPROM_BASE (AUTH_CACHE_EEPROM_BASE + AUTH_CACHE_EEPROM_SIZE)
+#define JOURNAL_EEPROM_SIZE 1024
+#define JOURNAL_MAGIC 0x5B
+
+typedef struct
+{
+	uint32_t sequence;
+	uint32_t time;       // Server epoch (seconds) if timeIsEpoch, else seconds since boot
+	byte timeIsEpoch;
+	byte api;            // UNLOCK_API, AUTH_API, VISITOR_API or JOURNAL_API
+	byte eventType;      // Server status code
+	byte readerPosition;
+	byte door;           // Index of the door in the controller's configuration
+	byte uidSize;        // 0 for events without a card, like door openings
+	byte uid[AUTH_CACHE_UID_SIZE];
+	byte checksum;       // Covers all fields above, detects blank and torn records
+	byte uploaded;
+} JournalRecord;
+
+#define JOURNAL_CAPACITY (JOURNAL_EEPROM_SIZE / sizeof(JournalRecord))
+
+static_assert(JOURNAL_EEPROM_BASE + JOURNAL_EEPROM_SIZE <= AUTH_CACHE_PIN_EEPROM_BASE, "Journal overlaps the PIN verifiers");
+
+void JournalBegin(void);
+uint16_t JournalPending(void);
+void JournalAppend(byte api, byte eventType, byte door, byte readerPosition, const byte *uid, byte uidSize);
+void JournalPeek(uint16_t index, JournalRecord *record);
+uint32_t JournalRecordTime(const JournalRecord *record);
+void JournalAck(uint32_t firstSequence, uint16_t count);
+
+#endif
@@ -0,0 +1,85 @@
+#include "LatencyStats.h"
+
+#ifdef LATENCY_BENCH
+static const char *stageNames[LATENCY_STAGES] = {"detect", "payload", "network", "parse", "hash", "unlock"};
+static const byte percents[] = {50, 95, 99, 100};
+
+static unsigned long startedAt[LATENCY_STAGES];
+static bool started[LATENCY_STAGES];
+static uint32_t samples[LATENCY_STAGES][LATENCY_SAMPLES];
+static uint32_t sampleCount[LATENCY_STAGES];
+
+void LatencyStart(byte stage)
+{
+	startedAt[stage] = micros();
+	started[stage] = true;
+}
+
+/*
+ *  void LatencyStop (byte stage);
+ *
+ *  Description:
+ *  - Records the time since LatencyStart, if the stage was started. Once
+ *  LATENCY_SAMPLES are kept, the oldest ones are overwritten
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte stage: one of the LATENCY_* stages
+ */
+void LatencyStop(byte stage)
+{
+	if (!started[stage])
+		return;
+	started[stage] = false;
+	samples[stage][sampleCount[stage] % LATENCY_SAMPLES] = micros() - startedAt[stage];
+	sampleCount[stage]++;
+}
+
+/*
+ *  Nearest-rank percentile of a sorted array
+ */
+static uint32_t Percentile(const uint32_t *sorted, uint16_t count, byte percent)
+{
+	uint16_t rank = ((uint32_t)count * percent + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+ *  void LatencyReport (void);
+ *
+ *  Description:
+ *  - Prints one CSV line per stage with the percentiles of the kept samples,
+ *  in microseconds. Lines start with "latency," so they can be picked out of
+ *  the rest of the serial output
+ */
+void LatencyReport(void)
+{
+	uint32_t sorted[LATENCY_SAMPLES];
+
+	Serial.println("latency,stage,samples,p50_us,p95_us,p99_us,max_us");
+	for (byte stage = 0; stage < LATENCY_STAGES; stage++)
+	{
+		uint16_t count = sampleCount[stage] < LATENCY_SAMPLES ? sampleCount[stage] : LATENCY_SAMPLES;
+
+		// Insertion sort, the arrays are small
+		for (uint16_t i = 0; i < count; i++)
+		{
+			uint32_t value = samples[stage][i];
+			uint16_t j = i;
+			for (; j > 0 && sorted[j - 1] > value; j--)
+				sorted[j] = sorted[j - 1];
+			sorted[j] = value;
+		}
+
+		Serial.print("latency,");
+		Serial.print(stageNames[stage]);
+		Serial.print(",");
+		Serial.print(count);
+		for (byte p = 0; p < sizeof(percents); p++)
+		{
+			Serial.print(",");
+			Serial.print(count > 0 ? Percentile(sorted, count, percents[p]) : 0UL);
+		}
+		Serial.println();
+	}
+}
+#endif
@@ -0,0 +1,39 @@
+/*
+ *  Tap latency benchmark
+ *
+ *  Built only with -D LATENCY_BENCH. Each stage of a tap is timed with micros()
+ *  and its last LATENCY_SAMPLES durations are kept, so the percentiles can be
+ *  printed to serial in a machine-readable form. Without the flag the calls
+ *  below compile to nothing.
+ */
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <Arduino.h>
+
+/*
+ *  Stages
+ */
+#define LATENCY_DETECT 0  // ReadRFIDTags call that found a card
+#define LATENCY_PAYLOAD 1 // Writing the request body
+#define LATENCY_NETWORK 2 // From sending the request to having read the response
+#define LATENCY_PARSE 3   // Reading and parsing a status response body
+#define LATENCY_HASH 4    // HashedPassword
+#define LATENCY_UNLOCK 5  // From the last user input (tap or END_OF_PASSWORD) to the relay
+#define LATENCY_STAGES 6
+
+#ifndef LATENCY_SAMPLES
+#define LATENCY_SAMPLES 32 // Per stage, 768 bytes of SRAM in total
+#endif
+
+#ifdef LATENCY_BENCH
+void LatencyStart(byte stage);
+void LatencyStop(byte stage);
+void LatencyReport(void);
+#else
+#define LatencyStart(stage) ((void)0)
+#define LatencyStop(stage) ((void)0)
+#define LatencyReport() ((void)0)
+#endif
+
+#endif
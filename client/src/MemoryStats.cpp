@@ -0,0 +1,106 @@
+#include "MemoryStats.h"
+
+#ifdef __AVR__
+// avr-libc allocator internals, see malloc.c
+struct __freelist
+{
+	size_t sz;
+	struct __freelist *nx;
+};
+extern char __heap_start;
+extern char *__brkval;
+extern struct __freelist *__flp;
+#endif
+
+/*
+ *  void MemoryStatsRead (MemoryStats *stats);
+ *
+ *  Description:
+ *  - Walks the allocator's free list and measures the gap between heap and stack
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] MemoryStats *stats: the current heap usage
+ */
+void MemoryStatsRead(MemoryStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+#ifdef __AVR__
+	char stackTop;
+	char *heapEnd = __brkval != NULL ? __brkval : &__heap_start;
+	uint16_t gap = &stackTop - heapEnd;
+
+	stats->heapSize = heapEnd - &__heap_start;
+	stats->largestFreeBlock = gap;
+	for (struct __freelist *block = __flp; block != NULL; block = block->nx)
+	{
+		uint16_t size = block->sz + sizeof(size_t);
+		stats->freeListSize += size;
+		if (size > stats->largestFreeBlock)
+			stats->largestFreeBlock = size;
+	}
+	stats->freeMemory = gap + stats->freeListSize;
+	if (stats->freeMemory > 0)
+		stats->fragmentation = 100 - (uint32_t)stats->largestFreeBlock * 100 / stats->freeMemory;
+#endif
+}
+
+/*
+ *  void MemoryStatsPaint (void);
+ *
+ *  Description:
+ *  - Fills the free SRAM between heap and stack with MEMORY_STATS_PAINT. Called
+ *  once from setup()
+ */
+void MemoryStatsPaint(void)
+{
+#ifdef __AVR__
+	char stackTop;
+	char *heapEnd = __brkval != NULL ? __brkval : &__heap_start;
+	memset(heapEnd, MEMORY_STATS_PAINT, &stackTop - heapEnd - MEMORY_STATS_STACK_MARGIN);
+#endif
+}
+
+/*
+ *  uint16_t MemoryStatsLowWater (void);
+ *
+ *  Description:
+ *  - Counts the painted bytes the stack and heap never reached since boot
+ *
+ *  Returns:
+ *  [uint16_t] Lowest free SRAM seen, in bytes. 0 outside the AVR
+ */
+uint16_t MemoryStatsLowWater(void)
+{
+	uint16_t count = 0;
+#ifdef __AVR__
+	char stackTop;
+	char *heapEnd = __brkval != NULL ? __brkval : &__heap_start;
+	// The heap grows up, so the paint left is right after its top
+	for (char *p = heapEnd; p < &stackTop && *(byte *)p == MEMORY_STATS_PAINT; p++)
+		count++;
+#endif
+	return count;
+}
+
+/*
+ *  void PrintMemoryStats (void);
+ *
+ *  Description:
+ *  - Prints the current heap usage to serial
+ */
+void PrintMemoryStats(void)
+{
+	MemoryStats stats;
+	MemoryStatsRead(&stats);
+	Serial.print("-- Memory: ");
+	Serial.print(stats.freeMemory);
+	Serial.print(" free, heap ");
+	Serial.print(stats.heapSize);
+	Serial.print(", free list ");
+	Serial.print(stats.freeListSize);
+	Serial.print(", largest block ");
+	Serial.print(stats.largestFreeBlock);
+	Serial.print(", fragmentation ");
+	Serial.print(stats.fragmentation);
+	Serial.println("%");
+}
@@ -0,0 +1,33 @@
+/*
+ *  Heap usage report
+ *
+ *  Reads avr-libc's allocator state to tell how much SRAM is left and how
+ *  fragmented the heap is. The steady-state loop shouldn't allocate, so these
+ *  numbers must stay flat no matter how many taps are handled.
+ *
+ *  The free SRAM low-water mark comes from painting the gap between heap and
+ *  stack at boot and finding later how much of the paint is left.
+ */
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <Arduino.h>
+
+#define MEMORY_STATS_PAINT 0xC5
+#define MEMORY_STATS_STACK_MARGIN 32 // Left unpainted below the stack in use
+
+typedef struct
+{
+	uint16_t heapSize;         // Bytes between the start of the heap and its top
+	uint16_t freeListSize;     // Bytes in freed blocks below the heap top
+	uint16_t largestFreeBlock; // Biggest free block, including the gap up to the stack
+	uint16_t freeMemory;       // Gap between heap and stack plus the free list
+	byte fragmentation;        // Percent of free memory outside the largest block
+} MemoryStats;
+
+void MemoryStatsRead(MemoryStats *stats);
+void PrintMemoryStats(void);
+void MemoryStatsPaint(void);
+uint16_t MemoryStatsLowWater(void);
+
+#endif
@@ -0,0 +1,62 @@
+#include <EEPROM.h>
+#include <stddef.h>
+#include "NetConfig.h"
+
+static byte Checksum(const NetConfig *config)
+{
+	const byte *bytes = (const byte *)config;
+	byte sum = NET_CONFIG_MAGIC;
+	for (byte i = 0; i < offsetof(NetConfig, checksum); i++)
+		sum = (sum << 1 | sum >> 7) ^ bytes[i];
+	return sum;
+}
+
+/*
+ *  byte NetConfigLoad (NetConfig *config);
+ *
+ *  Description:
+ *  - Reads the stored configuration
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] NetConfig *config: the configuration read
+ *
+ *  Returns:
+ *  [byte] Its mode, NET_CONFIG_NONE if nothing valid is stored
+ */
+byte NetConfigLoad(NetConfig *config)
+{
+	EEPROM.get(NET_CONFIG_EEPROM_BASE, *config);
+	if (config->magic != NET_CONFIG_MAGIC || config->checksum != Checksum(config) ||
+		(config->mode != NET_CONFIG_LEASE && config->mode != NET_CONFIG_STATIC))
+		return NET_CONFIG_NONE;
+	return config->mode;
+}
+
+/*
+ *  void NetConfigSave (byte mode, IPAddress ip, IPAddress gateway, IPAddress subnet);
+ *
+ *  Description:
+ *  - Stores the configuration. Bytes that didn't change aren't rewritten, so
+ *  saving the same lease on every renewal doesn't wear the EEPROM
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte mode: NET_CONFIG_LEASE or NET_CONFIG_STATIC
+ *  [INPUT] IPAddress ip: the controller's address
+ *  [INPUT] IPAddress gateway: the gateway's address
+ *  [INPUT] IPAddress subnet: the subnet mask
+ */
+void NetConfigSave(byte mode, IPAddress ip, IPAddress gateway, IPAddress subnet)
+{
+	NetConfig config;
+
+	config.magic = NET_CONFIG_MAGIC;
+	config.mode = mode;
+	for (byte i = 0; i < 4; i++)
+	{
+		config.ip[i] = ip[i];
+		config.gateway[i] = gateway[i];
+		config.subnet[i] = subnet[i];
+	}
+	config.checksum = Checksum(&config);
+	EEPROM.put(NET_CONFIG_EEPROM_BASE, config);
+}
@@ -0,0 +1,46 @@
+/*
+ *  Network configuration
+ *
+ *  The address the controller comes up with, kept in the last bytes of EEPROM,
+ *  after the PIN verifiers, so doors don't wait on DHCP after a power cut:
+ *  - A lease: the last address DHCP gave. Used at boot until DHCP answers
+ *  again, and replaced whenever it does.
+ *  - A static address, set from the serial monitor. DHCP isn't used at all.
+ *  There is no DNS server: the server is reached by its IP address.
+ */
+#ifndef NET_CONFIG_H
+#define NET_CONFIG_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include "AuthCache.h"
+
+/*
+ *  Macros
+ */
+#define NET_CONFIG_EEPROM_BASE (AUTH_CACHE_PIN_EEPROM_BASE + AUTH_CACHE_CAPACITY * sizeof(AuthCachePin)) // Left over by the PIN slots
+#define NET_CONFIG_MAGIC 0x4E
+
+/*
+ *  Configuration modes
+ */
+#define NET_CONFIG_NONE 0
+#define NET_CONFIG_LEASE 1
+#define NET_CONFIG_STATIC 2
+
+typedef struct
+{
+	byte magic;
+	byte mode; // NET_CONFIG_LEASE or NET_CONFIG_STATIC
+	byte ip[4];
+	byte gateway[4];
+	byte subnet[4];
+	byte checksum; // Covers all fields above
+} NetConfig;
+
+static_assert(NET_CONFIG_EEPROM_BASE + sizeof(NetConfig) <= AUTH_CACHE_PIN_EEPROM_BASE + AUTH_CACHE_PIN_EEPROM_SIZE, "No room for the network configuration");
+
+byte NetConfigLoad(NetConfig *config);
+void NetConfigSave(byte mode, IPAddress ip, IPAddress gateway, IPAddress subnet);
+
+#endif
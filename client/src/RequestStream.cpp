@@ -0,0 +1,41 @@
+#include "RequestStream.h"
+
+size_t CountingPrint::write(uint8_t)
+{
+	length++;
+	return 1;
+}
+
+size_t CountingPrint::write(const uint8_t *, size_t size)
+{
+	length += size;
+	return size;
+}
+
+size_t ChunkedPrint::write(uint8_t c)
+{
+	chunk[used++] = c;
+	if (used == REQUEST_CHUNK_SIZE)
+		finish();
+	return 1;
+}
+
+size_t ChunkedPrint::write(const uint8_t *buffer, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		write(buffer[i]);
+	return size;
+}
+
+/*
+ *  void ChunkedPrint::finish (void);
+ *
+ *  Description:
+ *  - Sends what is left in the chunk. Must be called once the body is written
+ */
+void ChunkedPrint::finish(void)
+{
+	if (used > 0)
+		out.write(chunk, used);
+	used = 0;
+}
@@ -0,0 +1,47 @@
+/*
+ *  Streamed request bodies
+ *
+ *  Request bodies aren't built in a buffer. Their writers print them to any
+ *  Print: once to a CountingPrint, which only adds up the Content-Length, and
+ *  once more to a ChunkedPrint, which sends them to the Ethernet client
+ *  REQUEST_CHUNK_SIZE bytes at a time. Every write() on the client is a SPI
+ *  transfer and a TCP segment, so bytes are gathered into chunks rather than
+ *  sent as they're printed. Memory use doesn't depend on the body's size.
+ */
+#ifndef REQUEST_STREAM_H
+#define REQUEST_STREAM_H
+
+#include <Arduino.h>
+
+/*
+ *  Macros
+ */
+#define REQUEST_CHUNK_SIZE 64
+
+class CountingPrint : public Print
+{
+public:
+	CountingPrint(void) : length(0) {}
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+
+	size_t length;
+};
+
+class ChunkedPrint : public Print
+{
+public:
+	ChunkedPrint(Print &out) : out(out), used(0) {}
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+	void finish(void);
+
+private:
+	Print &out;
+	uint8_t chunk[REQUEST_CHUNK_SIZE];
+	uint8_t used;
+};
+
+#endif
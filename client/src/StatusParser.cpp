@@ -0,0 +1,230 @@
+#include <stddef.h>
+#include <string.h>
+#include "StatusParser.h"
+
+/*
+ *  Parser states
+ */
+#define PARSE_OBJECT 0    // Before the opening brace
+#define PARSE_FIRST_KEY 1 // After the opening brace, a key or the closing brace
+#define PARSE_KEY_START 2 // After a comma
+#define PARSE_KEY 3
+#define PARSE_COLON 4
+#define PARSE_VALUE 5
+#define PARSE_NUMBER 6 // Digits of a field that is decoded
+#define PARSE_SKIP 7   // Any other value
+#define PARSE_NEXT 8   // After a value, a comma or the closing brace
+#define PARSE_DONE 9
+#define PARSE_ERROR 10
+
+/*
+ *  Fields decoded, all non-negative integers. Add new ones to StatusResponse too
+ */
+static const struct
+{
+	const char *key;
+	byte offset;
+} fields[] = {
+	{"status", offsetof(StatusResponse, status)},
+	{"token", offsetof(StatusResponse, token)},
+};
+
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static uint32_t *FindField(StatusParser *parser)
+{
+	if (parser->keySize > STATUS_PARSER_KEY_SIZE)
+		return NULL;
+	parser->key[parser->keySize] = '\0';
+	for (byte i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+		if (strcmp(parser->key, fields[i].key) == 0)
+			return (uint32_t *)((byte *)parser->response + fields[i].offset);
+	return NULL;
+}
+
+static void EndValue(StatusParser *parser, char c)
+{
+	if (IsSpace(c))
+		parser->state = PARSE_NEXT;
+	else if (c == ',')
+		parser->state = PARSE_KEY_START;
+	else if (c == '}')
+		parser->state = PARSE_DONE;
+	else
+		parser->state = PARSE_ERROR;
+}
+
+static void Skip(StatusParser *parser, char c)
+{
+	if (parser->inString)
+	{
+		if (parser->escaped)
+			parser->escaped = false;
+		else if (c == '\\')
+			parser->escaped = true;
+		else if (c == '"')
+		{
+			parser->inString = false;
+			if (parser->depth == 0)
+				parser->state = PARSE_NEXT;
+		}
+	}
+	else if (c == '"')
+		parser->inString = true;
+	else if (c == '{' || c == '[')
+		parser->depth++;
+	else if (c == '}' || c == ']')
+	{
+		if (parser->depth == 0)
+			EndValue(parser, c);
+		else if (--parser->depth == 0)
+			parser->state = PARSE_NEXT;
+	}
+	else if (parser->depth == 0 && (c == ',' || IsSpace(c)))
+		EndValue(parser, c);
+}
+
+/*
+ *  void StatusParserBegin (StatusParser *parser, StatusResponse *response);
+ *
+ *  Description:
+ *  - Starts parsing a new response
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] StatusParser *parser: the parser
+ *  [OUTPUT] StatusResponse *response: where the fields are decoded. Set to their defaults
+ */
+void StatusParserBegin(StatusParser *parser, StatusResponse *response)
+{
+	memset(parser, 0, sizeof(StatusParser));
+	parser->response = response;
+	parser->state = PARSE_OBJECT;
+	response->status = STATUS_PARSER_MISSING;
+	response->token = 0;
+}
+
+/*
+ *  byte StatusParserFeed (StatusParser *parser, char c);
+ *
+ *  Description:
+ *  - Parses the next byte of the response
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] StatusParser *parser: the parser
+ *  [INPUT] char c: the byte
+ *
+ *  Returns:
+ *  [byte] STATUS_PARSER_BUSY until the object is closed, then STATUS_PARSER_DONE.
+ *  STATUS_PARSER_ERROR if the response isn't a JSON object
+ */
+byte StatusParserFeed(StatusParser *parser, char c)
+{
+	switch (parser->state)
+	{
+	case PARSE_OBJECT:
+		if (c == '{')
+			parser->state = PARSE_FIRST_KEY;
+		else if (!IsSpace(c))
+			parser->state = PARSE_ERROR;
+		break;
+	case PARSE_FIRST_KEY:
+	case PARSE_KEY_START:
+		if (c == '"')
+		{
+			parser->keySize = 0;
+			parser->escaped = false;
+			parser->state = PARSE_KEY;
+		}
+		else if (c == '}' && parser->state == PARSE_FIRST_KEY)
+			parser->state = PARSE_DONE;
+		else if (!IsSpace(c))
+			parser->state = PARSE_ERROR;
+		break;
+	case PARSE_KEY:
+		if (parser->escaped || c == '\\')
+		{
+			// Escaped keys aren't decoded
+			parser->escaped = !parser->escaped;
+			parser->keySize = STATUS_PARSER_KEY_SIZE + 1;
+		}
+		else if (c == '"')
+			parser->state = PARSE_COLON;
+		else if (parser->keySize < STATUS_PARSER_KEY_SIZE)
+			parser->key[parser->keySize++] = c;
+		else
+			parser->keySize = STATUS_PARSER_KEY_SIZE + 1;
+		break;
+	case PARSE_COLON:
+		if (c == ':')
+		{
+			parser->field = FindField(parser);
+			parser->state = PARSE_VALUE;
+		}
+		else if (!IsSpace(c))
+			parser->state = PARSE_ERROR;
+		break;
+	case PARSE_VALUE:
+		if (IsSpace(c))
+			break;
+		if (parser->field != NULL && c >= '0' && c <= '9')
+		{
+			*parser->field = c - '0';
+			parser->state = PARSE_NUMBER;
+		}
+		else
+		{
+			parser->depth = 0;
+			parser->inString = false;
+			parser->escaped = false;
+			parser->state = PARSE_SKIP;
+			Skip(parser, c);
+		}
+		break;
+	case PARSE_NUMBER:
+		if (c >= '0' && c <= '9')
+			*parser->field = *parser->field * 10 + (c - '0');
+		else
+			EndValue(parser, c);
+		break;
+	case PARSE_SKIP:
+		Skip(parser, c);
+		break;
+	case PARSE_NEXT:
+		if (!IsSpace(c))
+			EndValue(parser, c);
+		break;
+	}
+
+	if (parser->state == PARSE_DONE)
+		return STATUS_PARSER_DONE;
+	if (parser->state == PARSE_ERROR)
+		return STATUS_PARSER_ERROR;
+	return STATUS_PARSER_BUSY;
+}
+
+/*
+ *  byte StatusParserParse (const char *text, StatusResponse *response);
+ *
+ *  Description:
+ *  - Parses a response that is already in memory
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const char *text: the response, null-terminated
+ *  [OUTPUT] StatusResponse *response: the fields decoded
+ *
+ *  Returns:
+ *  [byte] STATUS_PARSER_DONE, or STATUS_PARSER_ERROR if it isn't a complete JSON object
+ */
+byte StatusParserParse(const char *text, StatusResponse *response)
+{
+	StatusParser parser;
+	byte result = STATUS_PARSER_BUSY;
+
+	StatusParserBegin(&parser, response);
+	for (; *text != '\0' && result == STATUS_PARSER_BUSY; text++)
+		result = StatusParserFeed(&parser, *text);
+	return result == STATUS_PARSER_DONE ? STATUS_PARSER_DONE : STATUS_PARSER_ERROR;
+}
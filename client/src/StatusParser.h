@@ -0,0 +1,52 @@
+/*
+ *  Streaming status response parser
+ *
+ *  The unlock, authenticate, visitor and telemetry APIs answer a flat JSON
+ *  object such as {"status": 5, "token": 1234}. Rather than reading it into a
+ *  buffer and building a JSON tree, its bytes are fed to StatusParserFeed as
+ *  they come off the socket. The integer fields in the table in StatusParser.cpp
+ *  are decoded into a StatusResponse and anything else is skipped. The parser
+ *  is done as soon as the object's closing brace arrives, so the caller can
+ *  stop reading there.
+ */
+#ifndef STATUS_PARSER_H
+#define STATUS_PARSER_H
+
+#include <Arduino.h>
+
+/*
+ *  Macros
+ */
+#define STATUS_PARSER_KEY_SIZE 8 // Longest key decoded, longer ones are skipped
+#define STATUS_PARSER_MISSING 255
+
+/*
+ *  StatusParserFeed results
+ */
+#define STATUS_PARSER_BUSY 0
+#define STATUS_PARSER_DONE 1
+#define STATUS_PARSER_ERROR 2
+
+typedef struct
+{
+	uint32_t status; // STATUS_PARSER_MISSING if not sent
+	uint32_t token;  // 0 if not sent
+} StatusResponse;
+
+typedef struct
+{
+	StatusResponse *response;
+	byte state;
+	byte depth; // Nesting of a value being skipped
+	bool inString;
+	bool escaped;
+	byte keySize;
+	char key[STATUS_PARSER_KEY_SIZE + 1];
+	uint32_t *field; // Where the number being read goes, NULL if it's skipped
+} StatusParser;
+
+void StatusParserBegin(StatusParser *parser, StatusResponse *response);
+byte StatusParserFeed(StatusParser *parser, char c);
+byte StatusParserParse(const char *text, StatusResponse *response);
+
+#endif
@@ -0,0 +1,142 @@
+#include <string.h>
+#include "TapFilter.h"
+
+typedef struct
+{
+	byte uid[AUTH_CACHE_UID_SIZE];
+	byte uidSize; // 0 if the entry is free
+	byte reader;
+	unsigned long time; // millis() of the last read, or of the server's answer
+	uint16_t repeats;
+} TapFilterEntry;
+
+static TapFilterEntry recentReads[RECENT_READS_SIZE];
+static TapFilterEntry rejected[NEGATIVE_CACHE_SIZE];
+
+static bool SameUid(const TapFilterEntry *entry, const byte *uid, byte uidSize)
+{
+	return entry->uidSize == uidSize && memcmp(entry->uid, uid, uidSize) == 0;
+}
+
+/*
+ *  Finds the entry for a UID (and reader, unless it's NULL), or the one to be
+ *  replaced by it: a free one, or else the oldest
+ */
+static TapFilterEntry *FindEntry(TapFilterEntry *table, byte size, const byte *uid, byte uidSize, const byte *reader, bool *found)
+{
+	TapFilterEntry *replaced = &table[0];
+	unsigned long now = millis();
+
+	for (byte i = 0; i < size; i++)
+	{
+		if (SameUid(&table[i], uid, uidSize) && (reader == NULL || table[i].reader == *reader))
+		{
+			*found = true;
+			return &table[i];
+		}
+		if (replaced->uidSize != 0 && (table[i].uidSize == 0 || now - table[i].time > now - replaced->time))
+			replaced = &table[i];
+	}
+	*found = false;
+	return replaced;
+}
+
+static void SetEntry(TapFilterEntry *entry, const byte *uid, byte uidSize, byte reader)
+{
+	if (uidSize > AUTH_CACHE_UID_SIZE)
+		uidSize = AUTH_CACHE_UID_SIZE;
+	memcpy(entry->uid, uid, uidSize);
+	entry->uidSize = uidSize;
+	entry->reader = reader;
+	entry->time = millis();
+	entry->repeats = 0;
+}
+
+/*
+ *  bool TapFilterRepeatedRead (byte reader, const byte *uid, byte uidSize);
+ *
+ *  Description:
+ *  - Records a card read and tells if it's a repeat of the one before: the same
+ *  UID on the same reader within DUPLICATE_READ_WINDOW
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte reader: the reader that read the card
+ *  [INPUT] const byte *uid: UID bytes read by the RFID module
+ *  [INPUT] byte uidSize: size of UID
+ *
+ *  Returns:
+ *  [bool] Should the read be dropped?
+ */
+bool TapFilterRepeatedRead(byte reader, const byte *uid, byte uidSize)
+{
+	bool found;
+	TapFilterEntry *entry = FindEntry(recentReads, RECENT_READS_SIZE, uid, uidSize, &reader, &found);
+
+	if (found && millis() - entry->time < DUPLICATE_READ_WINDOW)
+	{
+		entry->time = millis();
+		return true;
+	}
+	SetEntry(entry, uid, uidSize, reader);
+	return false;
+}
+
+/*
+ *  void TapFilterReject (const byte *uid, byte uidSize);
+ *
+ *  Description:
+ *  - Keeps a UID the server didn't find for NEGATIVE_CACHE_TTL
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const byte *uid: UID bytes read by the RFID module
+ *  [INPUT] byte uidSize: size of UID
+ */
+void TapFilterReject(const byte *uid, byte uidSize)
+{
+	bool found;
+	SetEntry(FindEntry(rejected, NEGATIVE_CACHE_SIZE, uid, uidSize, NULL, &found), uid, uidSize, 0);
+}
+
+/*
+ *  uint16_t TapFilterRejected (const byte *uid, byte uidSize);
+ *
+ *  Description:
+ *  - Checks if a UID was turned down by the server less than NEGATIVE_CACHE_TTL
+ *  ago, counting this tap as a repeat if it was. Expired entries are freed
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const byte *uid: UID bytes read by the RFID module
+ *  [INPUT] byte uidSize: size of UID
+ *
+ *  Returns:
+ *  [uint16_t] Number of repeats so far, this one included. 0 if the UID isn't cached
+ */
+uint16_t TapFilterRejected(const byte *uid, byte uidSize)
+{
+	bool found;
+	TapFilterEntry *entry = FindEntry(rejected, NEGATIVE_CACHE_SIZE, uid, uidSize, NULL, &found);
+
+	if (!found)
+		return 0;
+	if (millis() - entry->time >= NEGATIVE_CACHE_TTL)
+	{
+		entry->uidSize = 0;
+		return 0;
+	}
+	if (entry->repeats < 0xFFFF)
+		entry->repeats++;
+	return entry->repeats;
+}
+
+/*
+ *  void TapFilterForgetRejected (void);
+ *
+ *  Description:
+ *  - Empties the negative cache, once the authorization table has changed and
+ *  some of its UIDs may have been registered
+ */
+void TapFilterForgetRejected(void)
+{
+	for (byte i = 0; i < NEGATIVE_CACHE_SIZE; i++)
+		rejected[i].uidSize = 0;
+}
@@ -0,0 +1,37 @@
+/*
+ *  Repeated read suppression and negative cache
+ *
+ *  A card resting on a reader is read again on every poll, and a stray card
+ *  can be waved at it over and over. Two small RAM tables keep those from
+ *  reaching the server:
+ *  - The last UIDs read on each reader. A read of the same UID on the same
+ *  reader within DUPLICATE_READ_WINDOW of the previous one is dropped, and
+ *  refreshes the window, so a resting card is only read once.
+ *  - UIDs the server didn't find, for NEGATIVE_CACHE_TTL. Taps with them are
+ *  turned down locally, with a count of the repeats.
+ *  Both tables are fixed-size and replace their oldest entry when full.
+ */
+#ifndef TAP_FILTER_H
+#define TAP_FILTER_H
+
+#include <Arduino.h>
+#include "AuthCache.h"
+
+/*
+ *  Macros
+ */
+#ifndef DUPLICATE_READ_WINDOW
+#define DUPLICATE_READ_WINDOW 2000 // ms a card must be away from a reader before it's read again
+#endif
+#ifndef NEGATIVE_CACHE_TTL
+#define NEGATIVE_CACHE_TTL 60000 // ms an unknown UID is turned down locally after the server's answer
+#endif
+#define RECENT_READS_SIZE 4
+#define NEGATIVE_CACHE_SIZE 8
+
+bool TapFilterRepeatedRead(byte reader, const byte *uid, byte uidSize);
+void TapFilterReject(const byte *uid, byte uidSize);
+uint16_t TapFilterRejected(const byte *uid, byte uidSize);
+void TapFilterForgetRejected(void);
+
+#endif
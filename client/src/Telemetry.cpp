@@ -0,0 +1,117 @@
+#include "Telemetry.h"
+#include "MemoryStats.h"
+
+Telemetry telemetry;
+
+static const byte unitShift[TELEMETRY_HISTOGRAMS] = {4, 0, 0, 0, 4, 0};
+static const char *histogramNames[TELEMETRY_HISTOGRAMS] = {"poll (16us)", "unlock (ms)", "authenticate (ms)", "visitors (ms)", "parse (16us)", "door open (s)"};
+
+/*
+ *  void TelemetryCount (uint16_t *counter);
+ *
+ *  Description:
+ *  - Increments a counter, saturating instead of wrapping around
+ */
+void TelemetryCount(uint16_t *counter)
+{
+	if (*counter < 0xFFFF)
+		(*counter)++;
+}
+
+/*
+ *  void TelemetryRecord (byte histogram, uint32_t value);
+ *
+ *  Description:
+ *  - Adds a value to a histogram
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte histogram: one of the TELEMETRY_* histograms
+ *  [INPUT] uint32_t value: the value, in the histogram's unit
+ */
+void TelemetryRecord(byte histogram, uint32_t value)
+{
+	byte bucket = 0;
+
+	value >>= unitShift[histogram];
+	while (value > 0 && bucket < TELEMETRY_BUCKETS - 1)
+	{
+		value >>= 1;
+		bucket++;
+	}
+	TelemetryCount(&telemetry.histograms[histogram][bucket]);
+}
+
+/*
+ *  void TelemetryStatus (byte status);
+ *
+ *  Description:
+ *  - Counts a server response by status code, 255 being a failed request
+ */
+void TelemetryStatus(byte status)
+{
+	TelemetryCount(&telemetry.statusCounts[status < TELEMETRY_STATUS_CODES - 1 ? status : TELEMETRY_STATUS_CODES - 1]);
+}
+
+/*
+ *  void TelemetryReset (void);
+ *
+ *  Description:
+ *  - Starts a new report period. The dropped reports count is kept until a
+ *  report makes it to the server, the boot timings for good
+ */
+void TelemetryReset(void)
+{
+	uint16_t droppedReports = telemetry.droppedReports;
+	unsigned long bootTime = telemetry.bootTime;
+	unsigned long networkTime = telemetry.networkTime;
+	memset(&telemetry, 0, sizeof(telemetry));
+	telemetry.droppedReports = droppedReports;
+	telemetry.bootTime = bootTime;
+	telemetry.networkTime = networkTime;
+	telemetry.since = millis();
+}
+
+/*
+ *  void PrintTelemetry (void);
+ *
+ *  Description:
+ *  - Prints the telemetry of the current period to serial
+ */
+void PrintTelemetry(void)
+{
+	Serial.print("-- Telemetry for the last ");
+	Serial.print((millis() - telemetry.since) / 1000);
+	Serial.println(" s");
+	Serial.print("- Taps: ");
+	Serial.print(telemetry.taps);
+	Serial.print(", local unlocks: ");
+	Serial.print(telemetry.localUnlocks);
+	Serial.print(", dropped reports: ");
+	Serial.println(telemetry.droppedReports);
+	Serial.print("- Boot: ready after ");
+	Serial.print(telemetry.bootTime);
+	Serial.print(" ms, network after ");
+	Serial.print(telemetry.networkTime);
+	Serial.println(" ms");
+	Serial.print("- SRAM low-water mark: ");
+	Serial.println(MemoryStatsLowWater());
+	Serial.print("- Status codes:");
+	for (byte i = 0; i < TELEMETRY_STATUS_CODES; i++)
+	{
+		Serial.print(' ');
+		Serial.print(telemetry.statusCounts[i]);
+	}
+	Serial.println();
+	for (byte h = 0; h < TELEMETRY_HISTOGRAMS; h++)
+	{
+		Serial.print("- ");
+		Serial.print(histogramNames[h]);
+		Serial.print(':');
+		for (byte i = 0; i < TELEMETRY_BUCKETS; i++)
+		{
+			Serial.print(' ');
+			Serial.print(telemetry.histograms[h][i]);
+		}
+		Serial.println();
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ *  Health telemetry
+ *
+ *  Counters and fixed-bucket latency histograms for the hot paths, cheap
+ *  enough to be always on. Bucket i counts values from 2^(i-1) to 2^i - 1
+ *  units (bucket 0 counts zeros, the last one everything above). They cover
+ *  the current report period and are cleared once written to a report. The
+ *  boot timings are sent in every report.
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+/*
+ *  Histograms, recorded in the unit given. Must match server's accesscontrol/consts.py
+ */
+#define TELEMETRY_POLL 0        // Reader poll, us (16 us per unit)
+#define TELEMETRY_UNLOCK_RTT 1  // REQUEST_UNLOCK round-trip, ms
+#define TELEMETRY_AUTH_RTT 2    // AUTHENTICATE round-trip, ms
+#define TELEMETRY_VISITOR_RTT 3 // AUTHORIZE_VISITOR round-trip, ms
+#define TELEMETRY_PARSE 4       // Status response body read and parse, us (16 us per unit)
+#define TELEMETRY_DOOR_OPEN 5   // Door open duration, s
+#define TELEMETRY_HISTOGRAMS 6
+#define TELEMETRY_BUCKETS 12
+#define TELEMETRY_STATUS_CODES 16 // Server status codes 0 to 14, the last one counts failed requests
+
+typedef struct
+{
+	unsigned long since; // millis() when the period started
+	uint16_t taps;
+	uint16_t localUnlocks;
+	uint16_t droppedReports; // Reports lost since the last one the server got
+	unsigned long bootTime;    // ms from power-on to the end of setup()
+	unsigned long networkTime; // ms from power-on to the first network address, 0 until then
+	uint16_t statusCounts[TELEMETRY_STATUS_CODES];
+	uint16_t histograms[TELEMETRY_HISTOGRAMS][TELEMETRY_BUCKETS];
+} Telemetry;
+
+extern Telemetry telemetry;
+
+void TelemetryRecord(byte histogram, uint32_t value);
+void TelemetryStatus(byte status);
+void TelemetryCount(uint16_t *counter);
+void TelemetryReset(void);
+void PrintTelemetry(void);
+
+#endif
@@ -14,14 +14,24 @@
 #include <sha256.h>
 #include <ArduinoJson.h>
 #include <ArduinoHttpClient.h>
+#include "AuthCache.h"
+#include "DoorSensor.h"
+#include "FastPin.h"
+#include "MemoryStats.h"
+#include "Journal.h"
+#include "LatencyStats.h"
+#include "NetConfig.h"
+#include "RequestStream.h"
+#include "StatusParser.h"
+#include "TapFilter.h"
+#include "Telemetry.h"
 
 /*
  *  Macros
  */
 #define WHO_AM_I "ENSAIOS_REP"
-#define MEASURE_NUMBERS 10
 #define MAX_VISITOR_NUM 20
-#define SERIAL_SPEED 9600
+#define SERIAL_SPEED 115200 // At 9600 baud, printing a request body blocks the loop for ~100 ms
 #define MAC_ADDRESS                        \
 	{                                      \
 		0x00, 0xAA, 0xBB, 0xCC, 0xDE, 0x02 \
@@ -30,6 +40,12 @@
 #define REQUEST_UNLOCK "/api/request-unlock"
 #define AUTHENTICATE "/api/authenticate"
 #define AUTHORIZE_VISITOR "/api/authorize-visitor"
+#define AUTH_SYNC "/api/auth-sync"
+#define EVENTS_BULK "/api/events/bulk"
+#define TELEMETRY "/api/telemetry"
+#define BINARY_REQUEST_UNLOCK "/api/bin/request-unlock"
+#define BINARY_AUTHENTICATE "/api/bin/authenticate"
+#define BINARY_AUTHORIZE_VISITOR "/api/bin/authorize-visitor"
 #define REQUEST_PORT 80 //Standard HTTP port
 #define KEYPAD_LINES 4
 #define KEYPAD_COLUMNS 3
@@ -39,7 +55,6 @@
 	}
 #define END_OF_PASSWORD '#'
 #define QUIT_TYPING '*'
-#define NUM_READERS 2
 byte BLACK[] = {0, 0, 0}; //Turn LED off
 byte BLUE[] = {0, 0, HIGH};
 byte GREEN[] = {0, HIGH, 0};
@@ -57,6 +72,55 @@ byte WHITE[] = {HIGH, HIGH, HIGH};
 #define TIMEOUT_VISITOR 20000
 #define TIMEOUT_DOOR 60000
 #define TIMEOUT_PASSWORD 5000
+#define AUTH_SYNC_INTERVAL 300000 // Checks for authorization table changes every 5 minutes
+#define AUTH_SYNC_RETRY 30000
+#define ASK_SERVER 255
+#define NO_DECISION_TOKEN 0
+#define READER_POLL_IDLE 50
+#define READER_POLL_FAST 20 // Right after a tap, when visitors or a retry are likely to follow
+#define READER_ACTIVE_TIME 5000
+#define READER_REARM_INTERVAL 20 // A reader with an IRQ line only sees cards that answer a REQA sent while in the field
+#define READER_TIMER_RELOAD 200 // Card response timeout in 25 us ticks (5 ms). The library's default is 25 ms
+#define NO_READER 255
+#define NO_DOOR 255
+#define ERROR_DISPLAY_TIME 1000
+#define REQUEST_TIMEOUT 5000
+#define DHCP_TIMEOUT 3000 // A DHCP attempt blocks the loop this long at most. The library's default is 60 s
+#define DHCP_RESPONSE_TIMEOUT 1000
+#define DHCP_RETRY_MIN 2000 // Failed DHCP attempts are retried after this, twice as late every time
+#define DHCP_RETRY_MAX 120000
+#define JOURNAL_BATCH_SIZE 8
+#define JOURNAL_FLUSH_DELAY 10000 // Waits this long for a batch to fill up before uploading
+#define JOURNAL_RETRY 30000
+#define TELEMETRY_INTERVAL 600000 // Uploads a telemetry report every 10 minutes
+#define RESPONSE_BUFFER_SIZE 720 // A sync page with PIN verifiers and 8 rooms takes up to ~680 bytes
+#define RESPONSE_CHUNK_SIZE 16 // Status responses are read from the socket this many bytes at a time
+#define UID_HEX_SIZE (2 * AUTH_CACHE_UID_SIZE + 1)
+#define HASH_HEX_SIZE 65
+#define PIN_MAX_SIZE 16
+#define HEAP_SOAK_TAPS 100000UL
+#define HEAP_SOAK_REPORT 10000UL
+
+/*
+ *	Controller states
+ */
+#define STATE_IDLE 0
+#define STATE_AWAITING_SERVER 1
+#define STATE_AWAITING_PIN 2
+#define STATE_UNLOCKING 3
+#define STATE_DOOR_OPEN 4
+#define STATE_VISITOR_COLLECTION 5
+
+/*
+ *	Requests sent to the server, only one is in flight at a time
+ */
+#define REQ_NONE 0
+#define REQ_UNLOCK 1
+#define REQ_AUTHENTICATE 2
+#define REQ_VISITORS 3
+#define REQ_JOURNAL 4
+#define REQ_SYNC 5
+#define REQ_TELEMETRY 6
 
 /*
  *	Server Error Codes
@@ -72,6 +136,32 @@ byte WHITE[] = {HIGH, HIGH, HIGH};
 #define VISITOR_RFID_NOT_FOUND 7
 #define ROOM_NOT_FOUND 8
 #define OPEN_DOOR_TIMEOUT 9
+#define DOOR_OPENED 12
+#define SERVER_UNREACHABLE 13
+
+/*
+ *	Authorization sync modes
+ */
+#define SYNC_UNCHANGED 0
+#define SYNC_SNAPSHOT 1
+#define SYNC_DELTA 2
+#define AUTH_SYNC_PAGE_SIZE 8 // Must match server's AUTH_SYNC_PAGE_SIZE
+#define AUTH_SYNC_JSON_SIZE (JSON_OBJECT_SIZE(11) + 2 * JSON_ARRAY_SIZE(AUTH_SYNC_PAGE_SIZE) + AUTH_SYNC_PAGE_SIZE * JSON_ARRAY_SIZE(4) + JSON_ARRAY_SIZE(AUTH_CACHE_MAX_ROOMS) + AUTH_CACHE_MAX_ROOMS * JSON_ARRAY_SIZE(2))
+
+/*
+ *	Binary protocol, used instead of JSON when BINARY_PROTOCOL is defined.
+ *	Must match server's accesscontrol/consts.py
+ */
+#define BINARY_PROTOCOL_VERSION 1
+#define BINARY_HEADER_SIZE 19 // Version, API, reader position, UID size and room ID
+#define BINARY_ROOM_ID_SIZE 15
+#define BINARY_RESPONSE_SIZE 2 // Version and status, followed by the decision token if there is one
+#define BINARY_PASSWORD_SIZE 32
+#define BINARY_TOKEN_SIZE 4
+#define UNLOCK_API 0
+#define AUTH_API 1
+#define VISITOR_API 2
+#define JOURNAL_API 4
 
 /*
  *  Pins
@@ -105,19 +195,102 @@ const byte SS_PIN_ETHERNET = 10;
 const byte SS_PIN_OUTSIDE = 22;
 const byte SS_PIN_INSIDE = 24;
 
+//	IRQ pins, must be external interrupt pins (2, 3, 18, 19, 20 or 21). Readers without one are polled
+#define NO_IRQ_PIN 255
+#ifndef IRQ_PIN_OUTSIDE
+#define IRQ_PIN_OUTSIDE NO_IRQ_PIN
+#endif
+#ifndef IRQ_PIN_INSIDE
+#define IRQ_PIN_INSIDE NO_IRQ_PIN
+#endif
+
 //	Redefining Ethernet SS pin
 #ifdef ETHERNET_SHIELD_SPI_CS
 #undef ETHERNET_SHIELD_SPI_CS
 #endif
 #define ETHERNET_SHIELD_SPI_CS SS_PIN_ETHERNET
 
+//	Reader positions, as sent to the server
+#define READER_OUTSIDE 0
+#define READER_INSIDE 1
+
+/*
+ *	Doors and readers served by this controller. Each door has its own room, relay
+ *	and sensor, each reader its own SS, IRQ and LED pins. The RST pin, the keypad
+ *	and the buzzer are shared. To serve another door, add it to doorConfigs and
+ *	its readers to readerConfigs, e.g. {"ENSAIOS_LAB", 29, 31} and
+ *	{23, NO_IRQ_PIN, {32, 33, 34}, 1, READER_OUTSIDE}
+ */
+typedef struct
+{
+	const char *roomID; // WHO_AM_I of the room behind the door
+	byte relayPin;
+	byte sensorPin;
+} DoorConfig;
+
+typedef struct
+{
+	byte ssPin;
+	byte irqPin;
+	byte ledPins[3]; // Red, green and blue
+	byte door;       // Index in doorConfigs
+	byte position;   // READER_OUTSIDE or READER_INSIDE
+} ReaderConfig;
+
+const DoorConfig doorConfigs[] = {
+	{WHO_AM_I, DOOR_PIN, PIN_SENSOR},
+};
+
+const ReaderConfig readerConfigs[] = {
+	{SS_PIN_OUTSIDE, IRQ_PIN_OUTSIDE, {LED_OUT_R, LED_OUT_G, LED_OUT_B}, 0, READER_OUTSIDE},
+	{SS_PIN_INSIDE, IRQ_PIN_INSIDE, {LED_IN_R, LED_IN_G, LED_IN_B}, 0, READER_INSIDE},
+};
+
+#define NUM_DOORS (sizeof(doorConfigs) / sizeof(doorConfigs[0]))
+#define NUM_READERS (sizeof(readerConfigs) / sizeof(readerConfigs[0]))
+static_assert(NUM_READERS <= 8, "readersFired has one bit per reader");
+static_assert(NUM_DOORS <= 8, "passwordDoors has one bit per door");
+static_assert(NUM_DOORS <= AUTH_CACHE_MAX_ROOMS, "The authorization cache keeps the room of each door");
+
+/*
+ *  Pins of the tables above, resolved at boot for direct port access
+ */
+FastPinRef readerSS[NUM_READERS];
+FastRgb readerLEDs[NUM_READERS];
+FastPinRef doorRelays[NUM_DOORS];
+FastPinRef doorSensors[NUM_DOORS];
+
 /*
  *  Declaring the RFID modules
  */
-const byte ssPins[] = {SS_PIN_OUTSIDE, SS_PIN_INSIDE};
 MFRC522 readers[NUM_READERS];
-bool readers_locked[2] = {false, false};
-char readers_id[2] = {'o', 'i'};
+bool readers_locked[NUM_READERS];
+volatile byte readersFired = 0; // One bit per reader, set by its IRQ line
+unsigned long readerArmedAt[NUM_READERS];
+byte polledReaders = 0; // Readers without an IRQ line
+byte nextPolledReader = 0;
+
+template <byte i>
+void ReaderIRQ(void)
+{
+	readersFired |= 1 << i;
+}
+
+void (*const readerISRs[])(void) = {ReaderIRQ<0>, ReaderIRQ<1>, ReaderIRQ<2>, ReaderIRQ<3>, ReaderIRQ<4>, ReaderIRQ<5>, ReaderIRQ<6>, ReaderIRQ<7>};
+
+/*
+ *	State of each door
+ */
+typedef struct
+{
+	bool unlocked;
+	unsigned long unlockedAt;
+	bool open;
+	unsigned long openedAt;
+	bool alarm;
+} Door;
+
+Door doors[NUM_DOORS];
 
 /*
  *  Declaring IP, MAC and the ethernet client itself
@@ -137,814 +310,3043 @@ byte keyPadColPins[KEYPAD_COLUMNS] = KEYPAD_COL_PINS;
 Keypad keyPad = Keypad(makeKeymap(keys), keyPadLinPins, keyPadColPins, KEYPAD_LINES, KEYPAD_COLUMNS);
 
 /*
- *	Global vars for visitors
+ *	HTTP client kept alive between requests and its reuse counters
+ */
+EthernetClient ethClient;
+HttpClient httpClient(ethClient, SERVER_IP, REQUEST_PORT);
+unsigned long httpRequests = 0;
+unsigned long httpReused = 0;
+unsigned long httpConnects = 0;
+unsigned long httpConnectTime = 0;
+unsigned long httpFailures = 0;
+
+/*
+ *	Where the address in use came from (NET_CONFIG_NONE until there is one) and the DHCP retries
+ */
+byte networkMode = NET_CONFIG_NONE;
+bool dhcpBound = false;            // DHCP answered, the lease is renewed by Ethernet.maintain()
+unsigned long dhcpAttemptAt = 0;  // When the last attempt gave up
+unsigned long dhcpRetryDelay = 0; // 0 until an attempt fails
+
+/*
+ *	A card read: the UID as read by the module, the reader it came from and its door
+ */
+typedef struct
+{
+	MFRC522::Uid uid;
+	byte reader;
+	byte readerPosition; // READER_OUTSIDE or READER_INSIDE
+	byte door;
+} Tap;
+
+/*
+ *	State machine of each door, with the tap it is handling. Doors are handled
+ *	independently: a tap waiting for the server, a password or visitors at one
+ *	door doesn't hold back taps at the others
+ */
+typedef struct
+{
+	byte state;
+	Tap tap;
+	byte pendingRequest; // Request of the tap waiting for the connection, REQ_NONE if none
+	// Server-side session of the tap, sent back with its password and visitors
+	uint32_t decisionToken;
+	char hashedPin[HASH_HEX_SIZE];
+	byte visitorCount;
+	MFRC522::Uid visitorUids[MAX_VISITOR_NUM];
+	unsigned long visitorInitTime;
+	// LED feedback on the door's readers, played without blocking the loop
+	byte *ledBlinkColor;
+	byte *ledEndColor;
+	byte ledToggles;
+	unsigned int ledPeriod;
+	unsigned long ledLast;
+	bool ledHold;
+	unsigned long ledHoldStart;
+} DoorTap;
+
+DoorTap doorTaps[NUM_DOORS];
+
+/*
+ *	Global vars for the keypad, shared by the doors: it reads one door's password at a time
+ */
+byte pinDoor = NO_DOOR; // The door the keypad is read for
+Sha256 pinHash; // Fed each digit as it is typed
+byte pinLength = 0;
+bool pinEntered = false; // END_OF_PASSWORD was typed
+bool pinSpeculative = false; // Typed while REQUEST_UNLOCK is in flight, kept only if it asks for a password
+byte passwordDoors = 0; // One bit per door, set while its room is known to ask for a password
+unsigned long pinLastKey = 0;
+unsigned long lastReaderPoll = 0;
+unsigned long lastTagAt = 0;
+
+/*
+ *	Global vars for the buzzer feedback, played without blocking the loop
+ */
+byte buzzToggles = 0;
+unsigned int buzzPeriod = 0;
+unsigned int buzzFinal = 0;
+bool buzzFinalOn = false;
+unsigned int buzzWait = 0;
+unsigned long buzzLast = 0;
+
+/*
+ *	Global vars for the request in flight
+ */
+byte requestKind = REQ_NONE;
+byte requestDoor = 0; // Door of the tap the request belongs to
+byte nextRequestDoor = 0; // Doors with a tap request waiting are served in turn
+bool requestReused = false;
+bool requestBroken = false;
+byte requestAttempt = 0;
+unsigned long requestStartedAt = 0;
+unsigned long requestSentAt = 0;
+const char *requestPath = NULL;
+const char *requestContentType = NULL;
+char responseBody[RESPONSE_BUFFER_SIZE];
+
+/*
+ *	Global vars for the event journal upload
  */
-byte visitor_counter = 0;
-String tagsArray[MAX_VISITOR_NUM];
-unsigned long visitorInitTime = 0;
+unsigned long journalPendingSince = 0;
+bool journalRetrying = false;
+unsigned long journalFailedAt = 0;
+uint32_t journalBatchStart = 0;
+byte journalBatchCount = 0;
 
 /*
- *  void WriteRGB (byte color[], char inside_outside);
+ *	Global vars for the telemetry report in flight, kept so a retry sends the same one
+ */
+Telemetry telemetryReport;
+unsigned long telemetryReportAt = 0;
+uint16_t telemetryReportSramLow = 0;
+
+/*
+ *	Global vars for the authorization cache sync
+ */
+bool authSyncInProgress = false;
+unsigned long lastAuthSync = 0;
+unsigned long authSyncInterval = 0;
+uint32_t authSyncBase = 0;
+uint32_t authSyncTarget = 0;
+int authSyncOffset = 0;
+
+/*
+ *  void WriteRGB (byte color[], byte reader);
  *
  *  Description:
- *  - Procedure that changes the inside or outside LED color
+ *  - Procedure that changes a reader's LED color
  *
  *  Inputs/Outputs:
  *  [INPUT] byte color[]: array that contatins red, green and blue values
+ *  [INPUT] byte reader: the reader's index in readerConfigs
  *
  *  Returns:
  *  -
  */
-void WriteRGB(byte color[], char inside_outside)
+void WriteRGB(byte color[], byte reader)
 {
-	if (inside_outside == 'i')
-	{
-		byte pins[] = {LED_IN_R, LED_IN_G, LED_IN_B};
-		for (byte i = 0; i < 3; i++)
-			digitalWrite(pins[i], color[i]);
-	}
-	else if (inside_outside == 'o')
-	{
-		byte pins[] = {LED_OUT_R, LED_OUT_G, LED_OUT_B};
-		for (byte i = 0; i < 3; i++)
-			digitalWrite(pins[i], color[i]);
-	}
+	FastRgbWrite(&readerLEDs[reader], color);
 }
 
 /*
- *	Write function header
+ *  void WriteDoorLED (byte door, byte color[]);
+ *
+ *  Description:
+ *  - Shows a color on the readers of a door. Locked readers show ERROR_COLOR
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ *  [INPUT] byte color[]: array that contatins red, green and blue values
  */
-void WriteReaderLED(byte color[])
+void WriteDoorLED(byte door, byte color[])
 {
-	for (byte i = 0; i < 2; i++)
+	for (byte i = 0; i < NUM_READERS; i++)
 	{
-		if (readers_locked[i] == true)
-		{
-			WriteRGB(ERROR_COLOR, readers_id[i]);
-		}
-		else
-		{
-			WriteRGB(color, readers_id[i]);
-		}
+		if (readerConfigs[i].door == door)
+			WriteRGB(readers_locked[i] ? ERROR_COLOR : color, i);
 	}
 }
 
 /*
- *	void BlinkRGB (byte n_times, byte delay_time, byte blink_color [], byte end_color [], char readerPosition);
+ *  byte *StateColor (byte door);
  *
  *  Description:
- *  - Blinks RGB LED in "readerPosition" from "blink_color" to "end_color" "n_times" times within a "delay_time" time
+ *  - The LED color for a door's state
  *
  *  Inputs/Outputs:
- *  [INPUT] byte n_times: number of times the LED will blink
- * 	[INPUT] byte delay_time: time between blinks
- *  [INPUT] byte blink_color []: the LED color when blinking
- *  [INPUT] byte end_color []: the LED color when it ends
- *  [INPUT] char readerPosition: which LED should blink
+ *  [INPUT] byte door: the door's index in doorConfigs
  *
  *  Returns:
- *  -
+ *  [byte *] The color
  */
-void BlinkRGB(byte n_times, byte delay_time, byte blink_color[], byte end_color[], char readerPosition)
+byte *StateColor(byte door)
 {
-	for (byte i = 0; i < n_times; i++)
+	switch (doorTaps[door].state)
 	{
-		WriteReaderLED(blink_color);
-		delay(delay_time);
-		WriteReaderLED(end_color);
-		delay(delay_time);
+	case STATE_AWAITING_SERVER:
+		return WAITING_COLOR;
+	case STATE_AWAITING_PIN:
+	case STATE_VISITOR_COLLECTION:
+		return DO_SOMETHING_COLOR;
+	case STATE_UNLOCKING:
+		return OK_COLOR;
+	case STATE_DOOR_OPEN:
+		return ERROR_COLOR;
+	default:
+		return STANDBY_COLOR;
 	}
 }
 
 /*
- *  String UID_toStr (byte *buffer, byte bufferSize);
+ *  bool DoorAcceptingTaps (byte door);
  *
  *  Description:
- *  - Function that converts the UID read from the RFID module to hex string
+ *  - A door's readers are read unless a tap there is already being handled
  *
  *  Inputs/Outputs:
- *  [INPUT] byte *buffer: from RFID module
- * 	[INPUT] byte bufferSize: size of UID
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+bool DoorAcceptingTaps(byte door)
+{
+	return doorTaps[door].state != STATE_AWAITING_SERVER && doorTaps[door].state != STATE_AWAITING_PIN;
+}
+
+/*
+ *  bool TapInProgress (void);
  *
- *  Returns:
- *  [String] The UID tag itself
+ *  Description:
+ *  - Checks if any door is waiting for the server or a password
  */
-String UID_toStr(byte *buffer, byte bufferSize)
+bool TapInProgress(void)
 {
-	String aux = "";
-	for (byte i = 0; i < bufferSize; i++)
+	for (byte d = 0; d < NUM_DOORS; d++)
 	{
-		aux.concat(String(buffer[i] < 0x10 ? "0" : ""));
-		aux.concat(String(buffer[i], HEX));
+		if (!DoorAcceptingTaps(d))
+			return true;
 	}
-	return aux;
+	return false;
 }
 
 /*
- *	void Buzz (bool activate);
+ *  bool AnyDoorInState (byte doorState);
  *
  *  Description:
- *  - Switches buzzer on or off
+ *  - Checks if any door's state machine is in a state
  *
  *  Inputs/Outputs:
- *  [INPUT] bool activate: tells if it should be switched on or off
- *
- *  Returns:
- *  -
+ *  [INPUT] byte doorState: one of the STATE_* values
  */
-void Buzz(bool activate)
+bool AnyDoorInState(byte doorState)
 {
-	digitalWrite(PIN_BUZZER, activate);
+	for (byte d = 0; d < NUM_DOORS; d++)
+	{
+		if (doorTaps[d].state == doorState)
+			return true;
+	}
+	return false;
 }
 
 /*
- *	Build description (TODO)
+ *  bool AllDoorsIdle (void);
+ *
+ *  Description:
+ *  - Background work that can delay a tap, like DHCP and the sync, waits for this
  */
-void BlinkBuzzer(byte n_times, byte delay_time)
+bool AllDoorsIdle(void)
 {
-	for (byte i = 0; i < n_times; i++)
+	for (byte d = 0; d < NUM_DOORS; d++)
 	{
-		Buzz(true);
-		delay(delay_time);
-		Buzz(false);
-		delay(delay_time);
+		if (doorTaps[d].state != STATE_IDLE)
+			return false;
 	}
+	return true;
 }
 
 /*
- *  String ReadRFIDTags (char *entering_or_leaving);
+ *	void BlinkRGB (byte door, byte n_times, byte delay_time, byte blink_color [], byte end_color []);
  *
  *  Description:
- *  - Function to read UID tags from all readers
+ *  - Starts blinking the RGB LEDs of a door from "blink_color" to "end_color" "n_times" times within a "delay_time" time.
+ *  The blinking itself is done by UpdateFeedback, so this returns right away
  *
  *  Inputs/Outputs:
- *  [OUTPUT] char *entering_or_leaving: indicates if the person is entering or leaving the room
+ *  [INPUT] byte door: the door's index in doorConfigs
+ *  [INPUT] byte n_times: number of times the LED will blink
+ * 	[INPUT] byte delay_time: time between blinks
+ *  [INPUT] byte blink_color []: the LED color when blinking
+ *  [INPUT] byte end_color []: the LED color when it ends
  *
  *  Returns:
- *  [String] The UID tag itself in uppercase or empty string
+ *  -
  */
-String ReadRFIDTags(char *entering_or_leaving)
+void BlinkRGB(byte door, byte n_times, byte delay_time, byte blink_color[], byte end_color[])
 {
-	digitalWrite(SS_PIN_ETHERNET, HIGH);
-	*entering_or_leaving = 255;
-	String aux = "";
-	for (byte i = 0; i < NUM_READERS; i++)
-	{
-		if (readers_locked[i] == false)
-		{
-			digitalWrite(SS_PIN_INSIDE, HIGH);
-			digitalWrite(SS_PIN_OUTSIDE, HIGH);
-			digitalWrite(ssPins[i], LOW);
-			aux = "";
-			if (readers[i].PICC_IsNewCardPresent() && readers[i].PICC_ReadCardSerial())
-			{
-				aux = UID_toStr(readers[i].uid.uidByte, readers[i].uid.size);
-				BlinkBuzzer(1, 10);
-				*entering_or_leaving = i;
-			}
-			if (aux != "")
-				return aux;
-		}
-	}
-	return aux;
+	DoorTap *t = &doorTaps[door];
+
+	t->ledBlinkColor = blink_color;
+	t->ledEndColor = end_color;
+	t->ledToggles = 2 * n_times;
+	t->ledPeriod = delay_time;
+	t->ledLast = millis() - delay_time;
+	t->ledHold = false;
 }
 
 /*
- *	Build description (TODO)
+ *  void ShowError (byte door);
+ *
+ *  Description:
+ *  - Shows ERROR_COLOR on a door's readers for ERROR_DISPLAY_TIME, then goes back to its state color
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
  */
-void BuzzTimer(byte delayTime)
+void ShowError(byte door)
 {
-	Buzz(true);
-	delay(delayTime);
-	Buzz(false);
+	DoorTap *t = &doorTaps[door];
+
+	t->ledToggles = 0;
+	WriteDoorLED(door, ERROR_COLOR);
+	t->ledHold = true;
+	t->ledHoldStart = millis();
 }
 
 /*
- *  String GetPassword ();
+ *  void UID_toStr (const byte *buffer, byte bufferSize, char *hex);
  *
  *  Description:
- *  - Function to get a sequence of characters from keypad until the END_OF_PASSWORD
- *  or QUIT_TYPING characters are pressed
+ *  - Function that converts the UID read from the RFID module to hex string
  *
  *  Inputs/Outputs:
- *  -
- *
- *  Returns:
- *  [String] The password typed until the END_OF_PASSWORD character
+ *  [INPUT] const byte *buffer: from RFID module
+ * 	[INPUT] byte bufferSize: size of UID
+ *  [OUTPUT] char *hex: the UID tag itself in lowercase, at least 2 * bufferSize + 1 long
  */
-String GetPassword()
+void UID_toStr(const byte *buffer, byte bufferSize, char *hex)
 {
-	String aux = "";
-	char c = keyPad.getKey();
-	unsigned long initial_timer = millis();
-	while (c != END_OF_PASSWORD)
+	for (byte i = 0; i < bufferSize; i++)
 	{
-		if (millis() >= initial_timer + TIMEOUT_PASSWORD)
-		{
-			return "";
-		}
-		if (c == QUIT_TYPING)
-		{
-			BlinkBuzzer(1, 50);
-			return "";
-		}
-		if (c)
-		{
-			initial_timer = millis();
-			BlinkBuzzer(1, 50);
-			BlinkRGB(1, 75, BLACK, DO_SOMETHING_COLOR, 'o');
-			aux.concat(c);
-		}
-		c = keyPad.getKey();
+		*hex++ = "0123456789abcdef"[buffer[i] >> 4];
+		*hex++ = "0123456789abcdef"[buffer[i] & 0xf];
 	}
-	BlinkBuzzer(1, 50);
-	return aux;
+	*hex = '\0';
 }
 
 /*
- *  String readableHash(uint8_t* hash);
+ *  byte HexToBytes (const char *hex, byte *buffer, byte maxSize);
  *
  *  Description:
- *  - Function to convert hashed password to a readable string
+ *  - Function that converts an hex string back to bytes
  *
  *  Inputs/Outputs:
- *  [INPUT] String hash: the hashed password
+ *  [INPUT] const char *hex: the hex string
+ *  [OUTPUT] byte *buffer: the converted bytes
+ *  [INPUT] byte maxSize: size of buffer
  *
  *  Returns:
- *  [String] A 64-character long string with containing the hashed password
+ *  [byte] Number of bytes converted, 0 if the string isn't valid
  */
-String readableHash(uint8_t *hash)
+byte HexToBytes(const char *hex, byte *buffer, byte maxSize)
 {
-	String out = "";
-	for (byte i = 0; i < 32; i++)
+	byte size = 0;
+	if (hex == NULL)
+		return 0;
+	for (; hex[0] != '\0' && hex[1] != '\0'; hex += 2)
 	{
-		out.concat("0123456789abcdef"[hash[i] >> 4]);
-		out.concat("0123456789abcdef"[hash[i] & 0xf]);
+		char digits[3] = {hex[0], hex[1], '\0'};
+		char *end;
+		if (size >= maxSize)
+			return 0;
+		buffer[size++] = strtoul(digits, &end, 16);
+		if (*end != '\0')
+			return 0;
 	}
-	return out;
+	return hex[0] == '\0' ? size : 0;
 }
 
 /*
- *  String HashedPassword (String password);
+ *  byte StrToUID (const char *hex, byte *buffer);
  *
  *  Description:
- *  - Function to hash an existing password
+ *  - Function that converts an hex string sent by the server back to UID bytes
  *
  *  Inputs/Outputs:
- *  [INPUT] String password: the plain text password to be hashed
+ *  [INPUT] const char *hex: the UID as hex string
+ *  [OUTPUT] byte *buffer: the UID bytes, at least AUTH_CACHE_UID_SIZE long
  *
  *  Returns:
- *  [String] The hash function result
+ *  [byte] Size of the UID, 0 if it isn't valid
  */
-String HashedPassword(String password)
+byte StrToUID(const char *hex, byte *buffer)
 {
-	Sha256 hash_function;
-	uint8_t *hash;
-	hash_function.init();
-	hash_function.print(password);
-	hash = hash_function.result();
-	return readableHash(hash);
+	return HexToBytes(hex, buffer, AUTH_CACHE_UID_SIZE);
+}
+
+/*
+ *  bool AnyDoorAlarm (void);
+ *
+ *  Description:
+ *  - The buzzer is shared, it stays on while any door's alarm is on
+ */
+bool AnyDoorAlarm(void)
+{
+	for (byte d = 0; d < NUM_DOORS; d++)
+	{
+		if (doors[d].alarm)
+			return true;
+	}
+	return false;
 }
 
 /*
- *  String GenerateUnlockPostData (String uid, byte roomID, byte readerPosition);
+ *	void Buzz (bool activate);
  *
  *  Description:
- *  - Generates a JSON format text to send through HTTP POST to REQUEST_UNLOCK
+ *  - Switches buzzer on or off
  *
  *  Inputs/Outputs:
- *  [INPUT] String uid: the RFID Tag read by RFID module
- *  [INPUT] byte roomID: the ID of the room where this client is
- *  [INPUT] byte readerPosition: indicates if the person is entering or leaving the room
+ *  [INPUT] bool activate: tells if it should be switched on or off
  *
  *  Returns:
- *  [String] A JSON format text contatining the whole input data
+ *  -
  */
-String GenerateUnlockPostData(String uid, String roomID, byte readerPosition)
+void Buzz(bool activate)
 {
-	String aux = "{\n\t\"uid\":\"";
-	aux.concat(uid);
-	aux.concat("\",\n\t\"roomID\":\"");
-	aux.concat(roomID);
-	aux.concat("\",\n\t\"readerPosition\":");
-	aux.concat(String(readerPosition));
-	aux.concat("\n}");
-	return aux;
+	FastPin<PIN_BUZZER>::Write(activate);
 }
 
 /*
- *  String GenerateAuthenticatePostData (String uid, String password, String roomID);
+ *	void BlinkBuzzer (byte n_times, byte delay_time);
  *
  *  Description:
- *  - Generates a JSON format text to send through HTTP POST to REQUEST_UNLOCK
+ *  - Starts beeping "n_times" times within a "delay_time" time. Beeps are played
+ *  by UpdateFeedback, so this returns right away
  *
  *  Inputs/Outputs:
- *  [INPUT] String uid: the RFID Tag read by RFID module
- *	[INPUT] String password: the user's read password
- *
- *  Returns:
- *  [String] A JSON format text contatining the whole input data
+ *  [INPUT] byte n_times: number of beeps
+ *  [INPUT] byte delay_time: duration of each beep and of the silence after it
  */
-String GenerateAuthenticatePostData(String uid, String password, String roomID)
+void BlinkBuzzer(byte n_times, byte delay_time)
 {
-	String aux = "{\n\t\"uid\":\"";
-	aux.concat(uid);
-	aux.concat("\",\n\t\"password\":\"");
-	aux.concat(password);
-	aux.concat("\",\n\t\"roomID\":\"");
-	aux.concat(roomID);
-	aux.concat("\"\n}");
-	return aux;
+	buzzToggles = 2 * n_times;
+	buzzPeriod = delay_time;
+	buzzFinal = 0;
+	buzzFinalOn = false;
+	buzzWait = 0;
+	buzzLast = millis();
 }
 
 /*
- *  String GenerateVisitorPostData (String uid, String visitorsUids []);
+ *	void BuzzTimer (byte delayTime);
  *
  *  Description:
- *  - Generates a JSON format text to send through HTTP POST to AUTHORIZE_VISITOR
+ *  - Beeps once for "delayTime", after the beeps started by BlinkBuzzer if there are any
  *
  *  Inputs/Outputs:
- *  [INPUT] String uid: an employee RFID
- *	[INPUT] String visitorsUids []: an array with all the visitors' RFIDs
- *
- *  Returns:
- *  [String] A JSON format text contatining the whole input data
+ *  [INPUT] byte delayTime: duration of the beep
  */
-String GenerateVisitorPostData(String uid, String visitorsUids[], String roomID)
+void BuzzTimer(byte delayTime)
 {
-	StaticJsonBuffer<200> postDataBuffer;
-
-	JsonObject &jsonRoot = postDataBuffer.createObject();
-	jsonRoot["uid"] = uid;
-	jsonRoot["roomID"] = roomID;
-
-	JsonArray &VisUID = jsonRoot.createNestedArray("visitorsUids");
-	for (byte i = 0; i < visitor_counter; i++)
+	if (buzzToggles == 0)
 	{
-		VisUID.add(visitorsUids[i]);
+		buzzWait = 0;
+		buzzLast = millis();
 	}
-
-	String output;
-	jsonRoot.printTo(output);
-	return output;
+	buzzFinal = delayTime;
+	buzzFinalOn = false;
 }
 
 /*
- *  byte ParseResponse (String response);
+ *  void UpdateFeedback (void);
  *
  *  Description:
- *  - Parse the server's response to return numeric status
- *
- *  Inputs/Outputs:
- *  [INPUT] String response: Server's response
- *
- *  Returns:
- *  [byte] Numeric error code from server
+ *  - Advances the LED blinking and the buzzer beeps started by BlinkRGB,
+ *  ShowError, BlinkBuzzer and BuzzTimer. Called on every loop pass
  */
-byte ParseResponse(String response)
+void UpdateFeedback(void)
 {
-	DynamicJsonBuffer jsonBuffer(JSON_OBJECT_SIZE(1) + 20);
+	unsigned long now = millis();
 
-	byte status = 255;
-	JsonObject &root = jsonBuffer.parseObject(response);
-	if (!root.success())
+	for (byte d = 0; d < NUM_DOORS; d++)
 	{
-		Serial.println("Parsing response failed!");
-		status = 255;
+		DoorTap *t = &doorTaps[d];
+
+		if (t->ledToggles > 0)
+		{
+			if (now - t->ledLast >= t->ledPeriod)
+			{
+				t->ledLast = now;
+				WriteDoorLED(d, t->ledToggles % 2 == 0 ? t->ledBlinkColor : t->ledEndColor);
+				t->ledToggles--;
+			}
+		}
+		else if (t->ledHold && now - t->ledHoldStart >= ERROR_DISPLAY_TIME)
+		{
+			t->ledHold = false;
+			WriteDoorLED(d, StateColor(d));
+		}
+	}
+
+	// The door alarm keeps the buzzer on
+	if (AnyDoorAlarm() || (buzzToggles == 0 && buzzFinal == 0) || now - buzzLast < buzzWait)
+		return;
+	buzzLast = now;
+	if (buzzToggles > 0)
+	{
+		Buzz(buzzToggles % 2 == 0);
+		buzzWait = buzzPeriod;
+		buzzToggles--;
+	}
+	else if (!buzzFinalOn)
+	{
+		Buzz(true);
+		buzzWait = buzzFinal;
+		buzzFinalOn = true;
 	}
 	else
 	{
-		Serial.println("Parsing successful");
-		status = root["status"];
+		Buzz(false);
+		buzzFinal = 0;
+		buzzFinalOn = false;
 	}
-	return status;
 }
 
 /*
- *  byte SendPostRequest (String postData, String requestFrom);
+ *  unsigned long ReaderPollInterval (void);
  *
  *  Description:
- *  - Does a POST Request
- *
- *  Inputs/Outputs:
- *  [INPUT] String postData: the JSON format POST data
- *  [INPUT] String requestFrom: the API URL
+ *  - Readers without an IRQ line are polled faster for a while after a tap, and while collecting visitors
  *
  *  Returns:
- *  [byte] The server's response status
+ *  [unsigned long] Time between two polls of the same reader
  */
-byte SendPostRequest(String postData, String requestFrom)
+unsigned long ReaderPollInterval(void)
 {
-	// long thisTime = millis();
-
-	digitalWrite(SS_PIN_ETHERNET, LOW);
-	digitalWrite(SS_PIN_OUTSIDE, HIGH);
-	digitalWrite(SS_PIN_INSIDE, HIGH);
-
-	// Serial.print("Tempo de setar pinos: ");
-	// Serial.println(millis() - thisTime);
-	// thisTime = millis();
-
-	EthernetClient ethClient;
-	HttpClient httpClient = HttpClient(ethClient, SERVER_IP, REQUEST_PORT);
-
-	// Serial.print("Tempo de inicialização cliente HTTP: ");
-	// Serial.println(millis() - thisTime);
-	// thisTime = millis();
-
-	String response = "";
-	byte output = 255;
-	String contentType = "application/json";
-	Serial.println("Sending post...");
-
-	// Serial.print("Tempo até enviar o POST: ");
-	// Serial.println(millis() - thisTime);
-	// thisTime = millis();
-
-	httpClient.post(requestFrom, contentType, postData);
-
-	// Serial.print("Tempo para enviar o POST: ");
-	// Serial.println(millis() - thisTime);
-	// thisTime = millis();
-
-	response = httpClient.responseBody();
-	Serial.print("Response: ");
-	Serial.println(response);
-
-	// Serial.print("Tempo para pegar o response: ");
-	// Serial.println(millis() - thisTime);
-	// thisTime = millis();
-
-	output = ParseResponse(response);
-
-	// Serial.print("Tempo para parsear o response: ");
-	// Serial.println(millis() - thisTime);
-	// thisTime = millis();
+	if (AnyDoorInState(STATE_VISITOR_COLLECTION) || millis() - lastTagAt < READER_ACTIVE_TIME)
+		return READER_POLL_FAST;
+	return READER_POLL_IDLE;
+}
 
-	httpClient.endRequest();
-	return output;
+/*
+ *  bool PollSlotDue (void);
+ *
+ *  Description:
+ *  - Only one reader without an IRQ line is polled at a time, the interval being
+ *  split among them. Each one is still polled every ReaderPollInterval and a pass
+ *  of the loop never waits for more than one reader
+ */
+bool PollSlotDue(void)
+{
+	return polledReaders > 0 && millis() - lastReaderPoll >= ReaderPollInterval() / polledReaders;
 }
 
 /*
- *  bool BooleanMode (bool *array);
+ *  bool ReaderEnabled (byte i);
  *
  *  Description:
- *  - Returns the mode of a boolean array
+ *  - A reader is read unless another reader of its door is handling a tap, or
+ *  its own tap is waiting for the server or a password
  *
  *  Inputs/Outputs:
- *  [INPUT] bool *array: an array of booleans
- *
- *  Returns:
- *  [bool] The array's mode
+ *  [INPUT] byte i: the reader's index
  */
-bool BooleanMode(bool *array)
+bool ReaderEnabled(byte i)
 {
-	byte countTrue = 0;
-	byte countFalse = 0;
-	for (byte i = 0; i < MEASURE_NUMBERS; i++)
-	{
-		if (array[i] == true)
-			countTrue++;
-		else
-			countFalse++;
-	}
-	return countTrue > countFalse;
+	return !readers_locked[i] && DoorAcceptingTaps(readerConfigs[i].door);
 }
 
 /*
- *  bool DoorOpened ();
+ *  byte NextPolledReader (void);
  *
  *  Description:
- *  - Checks if the door is opened
- *
- *  Inputs/Outputs:
- *  -
+ *  - Picks the next enabled reader without an IRQ line, in turn
  *
  *  Returns:
- *  [bool] Is the door opened?
+ *  [byte] The reader's index, NO_READER if none is enabled
  */
-bool DoorOpened()
+byte NextPolledReader(void)
 {
-	bool measures[MEASURE_NUMBERS];
-	for (byte i = 0; i < MEASURE_NUMBERS; i++)
+	for (byte n = 0; n < NUM_READERS; n++)
 	{
-		measures[i] = digitalRead(PIN_SENSOR);
+		byte i = (nextPolledReader + n) % NUM_READERS;
+		if (readerConfigs[i].irqPin == NO_IRQ_PIN && ReaderEnabled(i))
+		{
+			nextPolledReader = (i + 1) % NUM_READERS;
+			return i;
+		}
 	}
-	return BooleanMode(measures);
+	return NO_READER;
 }
 
 /*
-  *	Write header
-  */
-void ResetStatus(void)
+ *  bool IrqReaderDue (byte i);
+ *
+ *  Description:
+ *  - Checks if a reader with an IRQ line fired or must be re-armed
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte i: the reader's index
+ */
+bool IrqReaderDue(byte i)
 {
-	readers_locked[0] = false;
-	readers_locked[1] = false;
-	visitor_counter = 0;
+	if (!ReaderEnabled(i) || readerConfigs[i].irqPin == NO_IRQ_PIN)
+		return false;
+	return (readersFired & (1 << i)) || millis() - readerArmedAt[i] >= READER_REARM_INTERVAL;
 }
 
 /*
- *	Write header
+ *  void SelectReader (byte i);
+ *
+ *  Description:
+ *  - Releases the SS pins of the other readers and selects this one
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte i: the reader's index
  */
-void CheckVisitorTimeout(void)
+void SelectReader(byte i)
 {
-	Serial.print("Time: ");
-	Serial.println(millis() - visitorInitTime);
-	if ((millis() - visitorInitTime) >= TIMEOUT_VISITOR)
-	{
-		ResetStatus();
-		Serial.println("Checou timeout");
-	}
+	for (byte j = 0; j < NUM_READERS; j++)
+		FastPinWrite(&readerSS[j], HIGH);
+	FastPinWrite(&readerSS[i], LOW);
 }
 
 /*
- *	Write header
+ *  void ArmReader (byte i);
+ *
+ *  Description:
+ *  - Sends a REQA without waiting for the answer. If a card answers, the reader pulls its IRQ line.
+ *  Same sequence as the library's PCD_CommunicateWithPICC. The reader must be selected
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte i: the reader's index
  */
-void CheckDoorTimeout(void)
+void ArmReader(byte i)
 {
-	bool opened = DoorOpened();
-	unsigned long timer = millis();
-	bool previous_lock[2] = {readers_locked[0], readers_locked[1]};
-	while (opened)
-	{
-		Serial.println("=== PORTA ABERTA! ===");
-		readers_locked[0] = true;
-		readers_locked[1] = true;
-		WriteReaderLED(ERROR_COLOR);
-		if (millis() >= timer + TIMEOUT_DOOR)
-		{
-			Buzz(true);
-		}
-		opened = DoorOpened();
-	}
-	digitalWrite(DOOR_PIN, HIGH);
-	WriteReaderLED(STANDBY_COLOR);
-	Serial.println("- Porta fechada...");
-	Buzz(false);
-	readers_locked[0] = previous_lock[0];
-	readers_locked[1] = previous_lock[1];
+	readers[i].PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);
+	readers[i].PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F); // Clears all interrupt requests, releasing the IRQ line
+	readers[i].PCD_WriteRegister(MFRC522::FIFOLevelReg, 0x80); // Flushes the FIFO
+	readers[i].PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+	readers[i].PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+	readers[i].PCD_WriteRegister(MFRC522::BitFramingReg, 0x87); // StartSend, REQA is a 7 bit frame
+	readerArmedAt[i] = millis();
 }
 
 /*
- *  void UnlockDoor (void);
+ *  bool ServiceReaderIRQ (byte i);
  *
  *  Description:
- *  - Procedure to unlock the door
+ *  - Reads the card of a reader that fired, then re-arms it. The reader must be selected
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte i: the reader's index
+ *
+ *  Returns:
+ *  [bool] Was a card read?
  */
-void UnlockDoor(void)
+bool ServiceReaderIRQ(byte i)
 {
-	digitalWrite(DOOR_PIN, LOW);
-	delay(DOOR_UNLOCK_TIME);
-	digitalWrite(DOOR_PIN, HIGH);
-	ResetStatus();
+	bool read = false;
+
+	if (readersFired & (1 << i))
+		read = readers[i].PICC_ReadCardSerial();
+	ArmReader(i);
+	// Also drops the interrupts raised while reading, the reader answers its own frames
+	noInterrupts();
+	readersFired &= ~(1 << i);
+	interrupts();
+	return read;
 }
 
 /*
- *	Write header
+ *  bool AcceptRead (byte i);
+ *
+ *  Description:
+ *  - Drops a read repeating the one before on the same reader, like a card left
+ *  resting on it, and beeps for the others
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte i: the reader that read the card
+ *
+ *  Returns:
+ *  [bool] Is it a new tap?
  */
-void ErrorExit(void)
+bool AcceptRead(byte i)
 {
-	WriteReaderLED(ERROR_COLOR);
-	BlinkBuzzer(3, 50);
-	BuzzTimer(200);
-	ResetStatus();
-	delay(1000);
+	if (TapFilterRepeatedRead(i, readers[i].uid.uidByte, readers[i].uid.size))
+		return false;
+	BlinkBuzzer(1, 10);
+	return true;
 }
 
 /*
- *  Setup
- */
-void setup()
+ *  bool ReadRFIDTags (byte *reader);
+ *
+ *  Description:
+ *  - Function to read UID tags: services the readers whose IRQ fired, then polls the next
+ *  reader without an IRQ line if its slot is due. The UID read is left in readers[*reader].uid
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] byte *reader: the index of the reader that read the card
+ *
+ *  Returns:
+ *  [bool] Was a card read?
+ */
+bool ReadRFIDTags(byte *reader)
+{
+	FastPin<SS_PIN_ETHERNET>::High();
+	*reader = NO_READER;
+	for (byte i = 0; i < NUM_READERS; i++)
+	{
+		if (IrqReaderDue(i))
+		{
+			SelectReader(i);
+			if (ServiceReaderIRQ(i) && AcceptRead(i))
+			{
+				*reader = i;
+				return true;
+			}
+		}
+	}
+
+	if (!PollSlotDue())
+		return false;
+	lastReaderPoll = millis();
+	byte i = NextPolledReader();
+	if (i == NO_READER)
+		return false;
+	SelectReader(i);
+	if (readers[i].PICC_IsNewCardPresent() && readers[i].PICC_ReadCardSerial() && AcceptRead(i))
+	{
+		*reader = i;
+		return true;
+	}
+	return false;
+}
+
+/*
+ *  bool ReadersDue (void);
+ *
+ *  Description:
+ *  - Checks if any reader fired, needs to be re-armed or polled, so the loop only touches the SPI bus when needed
+ *
+ *  Returns:
+ *  [bool] Should ReadRFIDTags be called?
+ */
+bool ReadersDue(void)
+{
+	if (PollSlotDue())
+		return true;
+	for (byte i = 0; i < NUM_READERS; i++)
+	{
+		if (IrqReaderDue(i))
+			return true;
+	}
+	return false;
+}
+
+/*
+ *  void readableHash (uint8_t *hash, char *out);
+ *
+ *  Description:
+ *  - Function to convert hashed password to a readable string
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] uint8_t *hash: the hashed password
+ *  [OUTPUT] char *out: a 64-character long string containing the hashed password, HASH_HEX_SIZE long
+ */
+void readableHash(uint8_t *hash, char *out)
+{
+	UID_toStr(hash, 32, out);
+}
+
+/*
+ *  void HashedPassword (const char *password, char *out);
+ *
+ *  Description:
+ *  - Function to hash an existing password
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const char *password: the plain text password to be hashed
+ *  [OUTPUT] char *out: the hash function result as hex string, HASH_HEX_SIZE long
+ */
+void HashedPassword(const char *password, char *out)
+{
+	Sha256 hash_function;
+	hash_function.init();
+	hash_function.print(password);
+	readableHash(hash_function.result(), out);
+}
+
+/*
+ *  void WriteUnlockPostData (Print &out, const char *uid, const char *roomID, byte readerPosition);
+ *
+ *  Description:
+ *  - Writes a JSON format text to send through HTTP POST to REQUEST_UNLOCK
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ *  [INPUT] const char *uid: the RFID Tag read by RFID module
+ *  [INPUT] const char *roomID: the ID of the room where this client is
+ *  [INPUT] byte readerPosition: indicates if the person is entering or leaving the room
+ */
+void WriteUnlockPostData(Print &out, const char *uid, const char *roomID, byte readerPosition)
+{
+	out.print("{\n\t\"uid\":\"");
+	out.print(uid);
+	out.print("\",\n\t\"roomID\":\"");
+	out.print(roomID);
+	out.print("\",\n\t\"readerPosition\":");
+	out.print(readerPosition);
+	out.print("\n}");
+}
+
+/*
+ *  void WriteAuthenticatePostData (Print &out, const char *uid, const char *password, const char *roomID, uint32_t token, byte visitors);
+ *
+ *  Description:
+ *  - Writes a JSON format text to send through HTTP POST to AUTHENTICATE
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ *  [INPUT] const char *uid: the RFID Tag read by RFID module
+ *	[INPUT] const char *password: the user's hashed password
+ *  [INPUT] const char *roomID: the ID of the room where this client is
+ *  [INPUT] uint32_t token: the decision token sent with PASSWORD_REQUIRED, NO_DECISION_TOKEN if none
+ *  [INPUT] byte visitors: number of visitors collected, sent to AUTHORIZE_VISITOR next. Without
+ *  any, the server logs the tap and closes its decision session at once
+ */
+void WriteAuthenticatePostData(Print &out, const char *uid, const char *password, const char *roomID, uint32_t token, byte visitors)
+{
+	out.print("{\n\t\"uid\":\"");
+	out.print(uid);
+	out.print("\",\n\t\"password\":\"");
+	out.print(password);
+	out.print("\",\n\t\"roomID\":\"");
+	out.print(roomID);
+	out.print("\",\n\t\"token\":");
+	out.print((unsigned long)token);
+	out.print(",\n\t\"visitors\":");
+	out.print(visitors);
+	out.print("\n}");
+}
+
+/*
+ *  void WriteVisitorPostData (Print &out, const char *uid, MFRC522::Uid visitors [], byte count, const char *roomID, uint32_t token);
+ *
+ *  Description:
+ *  - Writes a JSON format text to send through HTTP POST to AUTHORIZE_VISITOR
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ *  [INPUT] const char *uid: an employee RFID
+ *	[INPUT] MFRC522::Uid visitors []: an array with all the visitors' RFIDs
+ *  [INPUT] byte count: number of visitors
+ *  [INPUT] const char *roomID: the ID of the room where this client is
+ *  [INPUT] uint32_t token: the tap's decision token, NO_DECISION_TOKEN if none
+ */
+void WriteVisitorPostData(Print &out, const char *uid, MFRC522::Uid visitors[], byte count, const char *roomID, uint32_t token)
+{
+	char hex[UID_HEX_SIZE];
+
+	out.print("{\"uid\":\"");
+	out.print(uid);
+	out.print("\",\"roomID\":\"");
+	out.print(roomID);
+	out.print("\",\"token\":");
+	out.print((unsigned long)token);
+	out.print(",\"visitorsUids\":[");
+	for (byte i = 0; i < count; i++)
+	{
+		UID_toStr(visitors[i].uidByte, visitors[i].size, hex);
+		out.print(i == 0 ? "\"" : ",\"");
+		out.print(hex);
+		out.print('"');
+	}
+	out.print("]}");
+}
+
+/*
+ *  void WriteSyncPostData (Print &out, const DoorConfig *doors, byte doorCount, uint32_t version, uint32_t target, int offset);
+ *
+ *  Description:
+ *  - Writes a JSON format text to send through HTTP POST to AUTH_SYNC, with
+ *  the room of every door so the server sends each one's level
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ *  [INPUT] const DoorConfig *doors: the doors served by this client, the first one's room goes in roomID
+ *  [INPUT] byte doorCount: number of doors
+ *  [INPUT] uint32_t version: version of the table in cache, 0 if none
+ *  [INPUT] uint32_t target: version being synced to, 0 on the first page
+ *  [INPUT] int offset: index of the first change to be sent
+ */
+void WriteSyncPostData(Print &out, const DoorConfig *doors, byte doorCount, uint32_t version, uint32_t target, int offset)
+{
+	out.print("{\n\t\"roomID\":\"");
+	out.print(doors[0].roomID);
+	out.print("\",\n\t\"rooms\":[");
+	for (byte i = 0; i < doorCount; i++)
+	{
+		out.print(i == 0 ? "\"" : ",\"");
+		out.print(doors[i].roomID);
+		out.print('"');
+	}
+	out.print("],\n\t\"version\":");
+	out.print((unsigned long)version);
+	out.print(",\n\t\"target\":");
+	out.print((unsigned long)target);
+	out.print(",\n\t\"offset\":");
+	out.print(offset);
+	out.print("\n}");
+}
+
+/*
+ *  void WriteJournalPostData (Print &out);
+ *
+ *  Description:
+ *  - Writes a JSON format text with the oldest events in the journal to send
+ *  through HTTP POST to EVENTS_BULK. A batch only holds events of one door, sent
+ *  with its index and room ID; the server skips the sequences it already logged
+ *  for them, so a batch whose response was lost can be sent again. The batch
+ *  sent is kept in journalBatchStart and journalBatchCount so it can be
+ *  acknowledged. There must be events pending
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ */
+void WriteJournalPostData(Print &out)
+{
+	JournalRecord record;
+	char uid[UID_HEX_SIZE];
+
+	JournalPeek(0, &record);
+	byte door = record.door < NUM_DOORS ? record.door : 0;
+	out.print("{\"roomID\":\"");
+	out.print(doorConfigs[door].roomID);
+	out.print("\",\"door\":");
+	out.print(door);
+	out.print(",\"events\":[");
+
+	journalBatchStart = record.sequence;
+	journalBatchCount = 0;
+	for (byte i = 0; i < JOURNAL_BATCH_SIZE && i < JournalPending(); i++)
+	{
+		JournalPeek(i, &record);
+		if ((record.door < NUM_DOORS ? record.door : 0) != door)
+			break;
+		UID_toStr(record.uid, record.uidSize, uid);
+		out.print(i == 0 ? "[" : ",[");
+		out.print((unsigned long)record.sequence);
+		out.print(',');
+		out.print((unsigned long)JournalRecordTime(&record));
+		out.print(',');
+		out.print(record.api);
+		out.print(',');
+		out.print(record.eventType);
+		out.print(',');
+		out.print(record.readerPosition);
+		out.print(",\"");
+		out.print(uid);
+		out.print("\"]");
+		journalBatchCount++;
+	}
+	out.print("]}");
+}
+
+/*
+ *  void WriteCounts (Print &out, const uint16_t *counts, byte count);
+ *
+ *  Description:
+ *  - Writes a JSON array of counters
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ *  [INPUT] const uint16_t *counts: the counters
+ *  [INPUT] byte count: number of counters
+ */
+void WriteCounts(Print &out, const uint16_t *counts, byte count)
+{
+	for (byte i = 0; i < count; i++)
+	{
+		out.print(i == 0 ? '[' : ',');
+		out.print(counts[i]);
+	}
+	out.print(']');
+}
+
+/*
+ *  void WriteTelemetryPostData (Print &out, const Telemetry *report, unsigned long reportAt, uint16_t sramLow, const char *roomID);
+ *
+ *  Description:
+ *  - Writes a JSON format text with a telemetry report to send through HTTP
+ *  POST to TELEMETRY. Histograms are sent in the order of their TELEMETRY_* index
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ *  [INPUT] const Telemetry *report: the counters of the period reported
+ *  [INPUT] unsigned long reportAt: millis() when the period ended
+ *  [INPUT] uint16_t sramLow: lowest free SRAM seen when the period ended
+ *  [INPUT] const char *roomID: the ID of the room where this client is
+ */
+void WriteTelemetryPostData(Print &out, const Telemetry *report, unsigned long reportAt, uint16_t sramLow, const char *roomID)
+{
+	out.print("{\"roomID\":\"");
+	out.print(roomID);
+	out.print("\",\"uptime\":");
+	out.print(reportAt / 1000);
+	out.print(",\"period\":");
+	out.print((reportAt - report->since) / 1000);
+	out.print(",\"sramLow\":");
+	out.print(sramLow);
+	out.print(",\"taps\":");
+	out.print(report->taps);
+	out.print(",\"localUnlocks\":");
+	out.print(report->localUnlocks);
+	out.print(",\"dropped\":");
+	out.print(report->droppedReports);
+	out.print(",\"bootTime\":");
+	out.print(report->bootTime);
+	out.print(",\"networkTime\":");
+	out.print(report->networkTime);
+	out.print(",\"statusCounts\":");
+	WriteCounts(out, report->statusCounts, TELEMETRY_STATUS_CODES);
+	for (byte i = 0; i < TELEMETRY_HISTOGRAMS; i++)
+	{
+		out.print(i == 0 ? ",\"histograms\":[" : ",");
+		WriteCounts(out, report->histograms[i], TELEMETRY_BUCKETS);
+	}
+	out.print("]}");
+}
+
+/*
+ *  void WriteBinaryHeader (Print &out, byte api, byte readerPosition, const byte *uid, byte uidSize, const char *roomID);
+ *
+ *  Description:
+ *  - Writes the fixed binary protocol header followed by the raw UID bytes
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ *  [INPUT] byte api: UNLOCK_API, AUTH_API or VISITOR_API
+ *  [INPUT] byte readerPosition: indicates if the person is entering or leaving the room
+ *  [INPUT] const byte *uid: UID bytes read by the RFID module
+ *  [INPUT] byte uidSize: size of UID
+ *  [INPUT] const char *roomID: the ID of the room behind the door, padded with zeros
+ */
+void WriteBinaryHeader(Print &out, byte api, byte readerPosition, const byte *uid, byte uidSize, const char *roomID)
+{
+	byte roomIDSize = strnlen(roomID, BINARY_ROOM_ID_SIZE);
+
+	out.write(BINARY_PROTOCOL_VERSION);
+	out.write(api);
+	out.write(readerPosition);
+	out.write(uidSize);
+	out.write((const uint8_t *)roomID, roomIDSize);
+	for (byte i = roomIDSize; i < BINARY_ROOM_ID_SIZE; i++)
+		out.write((uint8_t)0);
+	out.write(uid, uidSize);
+}
+
+/*
+ *  void WriteBinaryToken (Print &out, uint32_t token);
+ *
+ *  Description:
+ *  - Writes the decision token that ends AUTH_API and VISITOR_API requests, little endian
+ */
+void WriteBinaryToken(Print &out, uint32_t token)
+{
+	for (byte i = 0; i < BINARY_TOKEN_SIZE; i++)
+		out.write((uint8_t)(token >> (8 * i)));
+}
+
+/*
+ *  void WriteRequestBody (Print &out);
+ *
+ *  Description:
+ *  - Writes the body of the request in flight, from the state it was started
+ *  with (the tap at requestDoor, the journal, the sync position or the
+ *  telemetry report). Called once to count the body's length and once to send it, so it
+ *  must write the same bytes every time
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] Print &out: where the POST data is written
+ */
+void WriteRequestBody(Print &out)
+{
+	DoorTap *t = &doorTaps[requestDoor];
+	const char *roomID = doorConfigs[requestDoor].roomID;
+#ifdef BINARY_PROTOCOL
+	byte password[BINARY_PASSWORD_SIZE];
+
+	if (requestKind == REQ_UNLOCK)
+		WriteBinaryHeader(out, UNLOCK_API, t->tap.readerPosition, t->tap.uid.uidByte, t->tap.uid.size, roomID);
+	else if (requestKind == REQ_AUTHENTICATE)
+	{
+		memset(password, 0, sizeof(password));
+		HexToBytes(t->hashedPin, password, BINARY_PASSWORD_SIZE);
+		WriteBinaryHeader(out, AUTH_API, 0, t->tap.uid.uidByte, t->tap.uid.size, roomID);
+		out.write(password, BINARY_PASSWORD_SIZE);
+		WriteBinaryToken(out, t->decisionToken);
+		out.write(t->visitorCount);
+	}
+	else if (requestKind == REQ_VISITORS)
+	{
+		WriteBinaryHeader(out, VISITOR_API, 0, t->tap.uid.uidByte, t->tap.uid.size, roomID);
+		out.write(t->visitorCount);
+		for (byte i = 0; i < t->visitorCount; i++)
+		{
+			out.write(t->visitorUids[i].size);
+			out.write(t->visitorUids[i].uidByte, t->visitorUids[i].size);
+		}
+		WriteBinaryToken(out, t->decisionToken);
+	}
+#else
+	char uid[UID_HEX_SIZE];
+
+	UID_toStr(t->tap.uid.uidByte, t->tap.uid.size, uid);
+	if (requestKind == REQ_UNLOCK)
+		WriteUnlockPostData(out, uid, roomID, t->tap.readerPosition);
+	else if (requestKind == REQ_AUTHENTICATE)
+		WriteAuthenticatePostData(out, uid, t->hashedPin, roomID, t->decisionToken, t->visitorCount);
+	else if (requestKind == REQ_VISITORS)
+		WriteVisitorPostData(out, uid, t->visitorUids, t->visitorCount, roomID, t->decisionToken);
+#endif
+	else if (requestKind == REQ_JOURNAL)
+		WriteJournalPostData(out);
+	else if (requestKind == REQ_SYNC)
+		WriteSyncPostData(out, doorConfigs, NUM_DOORS, authSyncBase, authSyncTarget, authSyncOffset);
+	else if (requestKind == REQ_TELEMETRY)
+		WriteTelemetryPostData(out, &telemetryReport, telemetryReportAt, telemetryReportSramLow, doorConfigs[0].roomID);
+}
+
+/*
+ *  bool HttpConnect (void);
+ *
+ *  Description:
+ *  - Opens the connection to the server, timing how long it takes. Fails at
+ *  once while the Ethernet module has no address
+ *
+ *  Returns:
+ *  [bool] Is the client connected?
+ */
+bool HttpConnect(void)
+{
+	if (networkMode == NET_CONFIG_NONE)
+	{
+		Serial.println("No network address yet!");
+		return false;
+	}
+
+	unsigned long thisTime = millis();
+	bool connected = ethClient.connect(SERVER_IP, REQUEST_PORT) > 0;
+	httpConnectTime += millis() - thisTime;
+	httpConnects++;
+	if (!connected)
+	{
+		Serial.println("Connection to server failed!");
+		ethClient.stop();
+	}
+	return connected;
+}
+
+/*
+ *  void PrintConnectionStats (void);
+ *
+ *  Description:
+ *  - Prints the connection reuse counters, so we know how much of the
+ *  request latency is spent on connection setup
+ */
+void PrintConnectionStats(void)
+{
+	Serial.print("-- HTTP: ");
+	Serial.print(httpRequests);
+	Serial.print(" requests, ");
+	Serial.print(httpReused);
+	Serial.print(" reused, ");
+	Serial.print(httpConnects);
+	Serial.print(" connects (");
+	Serial.print(httpConnects > 0 ? httpConnectTime / httpConnects : 0);
+	Serial.print(" ms avg), ");
+	Serial.print(httpFailures);
+	Serial.println(" failures");
+}
+
+/*
+ *  void SelectEthernet (void);
+ *
+ *  Description:
+ *  - Releases the RFID modules' SS pins and selects the Ethernet module
+ */
+void SelectEthernet(void)
+{
+	FastPin<SS_PIN_ETHERNET>::Low();
+	for (byte i = 0; i < NUM_READERS; i++)
+		FastPinWrite(&readerSS[i], HIGH);
+}
+
+/*
+ *  void SendRequestAttempt (void);
+ *
+ *  Description:
+ *  - Sends the request in flight over the kept-alive connection, reconnecting
+ *  only when the server has closed it. The body is written twice: once to count
+ *  the Content-Length and once straight onto the socket, so it's never held in
+ *  memory. Doesn't wait for the response, which is polled by NetworkTick
+ */
+void SendRequestAttempt(void)
+{
+	CountingPrint counter;
+
+	SelectEthernet();
+	requestReused = ethClient.connected();
+	if (!requestReused && !HttpConnect())
+	{
+		requestBroken = true;
+		return;
+	}
+	if (requestAttempt == 0)
+		LatencyStart(LATENCY_PAYLOAD);
+	WriteRequestBody(counter);
+	httpClient.beginRequest();
+	httpClient.post(requestPath, requestContentType, counter.length, NULL);
+	httpClient.beginBody();
+	ChunkedPrint body(httpClient);
+	WriteRequestBody(body);
+	body.finish();
+	httpClient.endRequest();
+	if (requestAttempt == 0)
+		LatencyStop(LATENCY_PAYLOAD);
+	requestSentAt = millis();
+}
+
+/*
+ *  void BeginPost (byte kind, const char *requestFrom, const char *contentType);
+ *
+ *  Description:
+ *  - Starts a POST Request, whose body is written by WriteRequestBody. Its
+ *  response is handled by OnResponse once it arrives
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte kind: which request this is (REQ_UNLOCK, REQ_SYNC, ...)
+ *  [INPUT] const char *requestFrom: the API URL
+ *  [INPUT] const char *contentType: the body's content type
+ */
+void BeginPost(byte kind, const char *requestFrom, const char *contentType)
+{
+	Serial.println("Sending post...");
+	httpRequests++;
+	requestKind = kind;
+	requestPath = requestFrom;
+	requestContentType = contentType;
+	requestAttempt = 0;
+	requestBroken = false;
+	requestStartedAt = millis();
+	LatencyStart(LATENCY_NETWORK);
+	SendRequestAttempt();
+}
+
+/*
+ *  void BeginJsonPost (byte kind, const char *requestFrom);
+ *
+ *  Description:
+ *  - Starts a JSON POST Request, echoing its POST data to serial
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte kind: which request this is (REQ_UNLOCK, REQ_SYNC, ...)
+ *  [INPUT] const char *requestFrom: the API URL
+ */
+void BeginJsonPost(byte kind, const char *requestFrom)
+{
+	requestKind = kind;
+	WriteRequestBody(Serial);
+	Serial.println();
+	BeginPost(kind, requestFrom, "application/json");
+}
+
+/*
+ *  int ReadResponseBody (void);
+ *
+ *  Description:
+ *  - Reads the response body into responseBody, which is kept null-terminated.
+ *  Only for the sync and journal responses, status responses are read by ReadJsonStatus
+ *
+ *  Returns:
+ *  [int] Size of the body, -1 if it didn't fit in responseBody
+ */
+int ReadResponseBody(void)
+{
+	int length = httpClient.contentLength();
+	responseBody[0] = '\0';
+	if (length < 0 || length >= RESPONSE_BUFFER_SIZE)
+	{
+		// Without a usable Content-Length the connection can't be kept alive
+		httpClient.stop();
+		Serial.println("Unexpected response size!");
+		return -1;
+	}
+	if ((int)httpClient.readBytes((byte *)responseBody, length) != length)
+	{
+		httpClient.stop();
+		Serial.println("Response truncated!");
+		return -1;
+	}
+	responseBody[length] = '\0';
+	return length;
+}
+
+/*
+ *  byte ReadBinaryResponse (uint32_t *token);
+ *
+ *  Description:
+ *  - Reads the fixed-size response of the binary protocol
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] uint32_t *token: the decision token, NO_DECISION_TOKEN if none was sent
+ *
+ *  Returns:
+ *  [byte] The server's response status
+ */
+byte ReadBinaryResponse(uint32_t *token)
+{
+	byte response[BINARY_RESPONSE_SIZE + BINARY_TOKEN_SIZE];
+	int length = httpClient.contentLength();
+
+	*token = NO_DECISION_TOKEN;
+	if (length != BINARY_RESPONSE_SIZE && length != BINARY_RESPONSE_SIZE + BINARY_TOKEN_SIZE)
+	{
+		// Not an answer in binary format, drains it to keep the connection usable
+		ReadResponseBody();
+		Serial.println("Unexpected binary response!");
+		return 255;
+	}
+	if (httpClient.readBytes(response, length) != (size_t)length || response[0] != BINARY_PROTOCOL_VERSION)
+	{
+		httpClient.stop();
+		Serial.println("Unexpected binary response!");
+		return 255;
+	}
+	for (byte i = BINARY_TOKEN_SIZE; length > BINARY_RESPONSE_SIZE && i > 0; i--)
+		*token = *token << 8 | response[BINARY_RESPONSE_SIZE + i - 1];
+	Serial.print("Response status: ");
+	Serial.println(response[1]);
+	return response[1];
+}
+
+/*
+ *  byte ReadJsonStatus (uint32_t *token);
+ *
+ *  Description:
+ *  - Reads a JSON status response straight from the socket, RESPONSE_CHUNK_SIZE
+ *  bytes at a time, and stops as soon as its object is closed. Nothing is
+ *  buffered, so the body may be of any size
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] uint32_t *token: the decision token, NO_DECISION_TOKEN if none was sent. May be NULL
+ *
+ *  Returns:
+ *  [byte] The server's response status, 255 if it couldn't be read
+ */
+byte ReadJsonStatus(uint32_t *token)
+{
+	StatusParser parser;
+	StatusResponse response;
+	char chunk[RESPONSE_CHUNK_SIZE];
+	int length = httpClient.contentLength();
+	byte result = STATUS_PARSER_BUSY;
+
+	StatusParserBegin(&parser, &response);
+	while (length > 0 && result == STATUS_PARSER_BUSY)
+	{
+		int size = httpClient.readBytes(chunk, length < RESPONSE_CHUNK_SIZE ? length : RESPONSE_CHUNK_SIZE);
+		if (size <= 0)
+			break;
+		length -= size;
+		for (int i = 0; i < size && result == STATUS_PARSER_BUSY; i++)
+			result = StatusParserFeed(&parser, chunk[i]);
+	}
+	// Anything left unread, after the object or for lack of a Content-Length, drops the connection
+	if (length != 0)
+		httpClient.stop();
+	if (result != STATUS_PARSER_DONE)
+	{
+		Serial.println("Parsing response failed!");
+		return 255;
+	}
+	if (token != NULL)
+		*token = response.token;
+	return response.status > 255 ? 255 : response.status;
+}
+
+/*
+ *  byte ReadStatusResponse (uint32_t *token);
+ *
+ *  Description:
+ *  - Reads the status sent back by the unlock, authenticate and visitor APIs
+ *
+ *  Inputs/Outputs:
+ *  [OUTPUT] uint32_t *token: the decision token, NO_DECISION_TOKEN if none was sent
+ *
+ *  Returns:
+ *  [byte] The server's response status
+ */
+byte ReadStatusResponse(uint32_t *token)
+{
+	*token = NO_DECISION_TOKEN;
+#ifdef BINARY_PROTOCOL
+	byte status = ReadBinaryResponse(token);
+	LatencyStop(LATENCY_NETWORK);
+	return status;
+#else
+	LatencyStop(LATENCY_NETWORK);
+	unsigned long parseStart = micros();
+	LatencyStart(LATENCY_PARSE);
+	byte status = ReadJsonStatus(token);
+	LatencyStop(LATENCY_PARSE);
+	TelemetryRecord(TELEMETRY_PARSE, micros() - parseStart);
+	Serial.print("Response status: ");
+	Serial.println(status);
+	return status;
+#endif
+}
+
+/*
+ *  void BeginRequestUnlock (void);
+ *
+ *  Description:
+ *  - Asks REQUEST_UNLOCK if the door may be opened for the tap at requestDoor, in JSON or binary format
+ */
+void BeginRequestUnlock(void)
+{
+#ifdef BINARY_PROTOCOL
+	BeginPost(REQ_UNLOCK, BINARY_REQUEST_UNLOCK, "application/octet-stream");
+#else
+	BeginJsonPost(REQ_UNLOCK, REQUEST_UNLOCK);
+#endif
+}
+
+/*
+ *  void BeginRequestAuthenticate (void);
+ *
+ *  Description:
+ *  - Sends the password typed for the tap at requestDoor to AUTHENTICATE, in JSON or binary format
+ */
+void BeginRequestAuthenticate(void)
+{
+#ifdef BINARY_PROTOCOL
+	BeginPost(REQ_AUTHENTICATE, BINARY_AUTHENTICATE, "application/octet-stream");
+#else
+	BeginJsonPost(REQ_AUTHENTICATE, AUTHENTICATE);
+#endif
+}
+
+/*
+ *  void BeginRequestVisitors (void);
+ *
+ *  Description:
+ *  - Sends the UIDs of the tap at requestDoor and of the visitors collected there
+ *  to AUTHORIZE_VISITOR, in JSON or binary format
+ */
+void BeginRequestVisitors(void)
+{
+#ifdef BINARY_PROTOCOL
+	BeginPost(REQ_VISITORS, BINARY_AUTHORIZE_VISITOR, "application/octet-stream");
+#else
+	BeginJsonPost(REQ_VISITORS, AUTHORIZE_VISITOR);
+#endif
+}
+
+/*
+ *  void AuthSyncFailed (void);
+ *
+ *  Description:
+ *  - Aborts the sync in progress. A partially applied update leaves the cache
+ *  invalid, so the next attempt asks the server for a full snapshot
+ */
+void AuthSyncFailed(void)
+{
+	Serial.println("-- Authorization sync failed");
+	if (authSyncInProgress)
+		AuthCacheInvalidate();
+	authSyncInProgress = false;
+	authSyncOffset = 0;
+	authSyncTarget = 0;
+	authSyncInterval = AUTH_SYNC_RETRY;
+}
+
+/*
+ *  bool AuthSyncDue (void);
+ *
+ *  Description:
+ *  - Tells if the authorization cache should be synced now
+ *
+ *  Returns:
+ *  [bool] Is there a sync page to be fetched?
+ */
+bool AuthSyncDue(void)
+{
+	return authSyncInProgress || (millis() - lastAuthSync) >= authSyncInterval;
+}
+
+/*
+ *  void RequestAuthSync (void);
+ *
+ *  Description:
+ *  - Schedules a sync for the next idle loop pass
+ */
+void RequestAuthSync(void)
+{
+	authSyncInterval = 0;
+}
+
+/*
+ *  void BeginAuthSyncStep (void);
+ *
+ *  Description:
+ *  - Asks AUTH_SYNC for the next page of the authorization table. Only one page
+ *  is fetched at a time so a tap is never held back by a whole sync
+ */
+void BeginAuthSyncStep(void)
+{
+	if (!authSyncInProgress)
+		authSyncBase = AuthCacheVersion();
+	lastAuthSync = millis();
+	BeginJsonPost(REQ_SYNC, AUTH_SYNC);
+}
+
+/*
+ *  void ApplyAuthSyncPage (char *response);
+ *
+ *  Description:
+ *  - Applies a page of the authorization table sent by AUTH_SYNC
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] char *response: Server's response, parsed in place
+ */
+void ApplyAuthSyncPage(char *response)
+{
+	AuthCacheRecord record;
+	AuthCacheRoom rooms[AUTH_CACHE_MAX_ROOMS];
+	byte roomCount;
+	byte pinSalt[AUTH_CACHE_PIN_SALT_SIZE];
+	byte verifier[AUTH_CACHE_PIN_VERIFIER_SIZE];
+
+	StaticJsonBuffer<AUTH_SYNC_JSON_SIZE> jsonBuffer;
+	JsonObject &root = jsonBuffer.parseObject(response);
+	if (!root.success() || root["status"].as<int>() != AUTHORIZED)
+	{
+		AuthSyncFailed();
+		return;
+	}
+
+	byte mode = root["mode"];
+	uint32_t version = root["version"];
+	uint32_t serverTime = root["serverTime"];
+	memset(pinSalt, 0, sizeof(pinSalt));
+	HexToBytes(root["pinSalt"], pinSalt, AUTH_CACHE_PIN_SALT_SIZE);
+	// Servers that predate multiple doors only send the first door's room
+	JsonArray &roomList = root["rooms"].as<JsonArray>();
+	if (roomList.success())
+	{
+		roomCount = roomList.size() < AUTH_CACHE_MAX_ROOMS ? roomList.size() : AUTH_CACHE_MAX_ROOMS;
+		for (byte i = 0; i < roomCount; i++)
+		{
+			JsonArray &room = roomList[i].as<JsonArray>();
+			rooms[i].level = room[0];
+			rooms[i].passwordRequired = room[1].as<bool>();
+		}
+	}
+	else
+	{
+		roomCount = 1;
+		rooms[0].level = root["roomLevel"];
+		rooms[0].passwordRequired = root["passwordRequired"];
+	}
+
+	if (!authSyncInProgress)
+	{
+		// The salt changes with the doors' rooms, verifiers of the old ones would never match
+		if (mode != SYNC_SNAPSHOT && AuthCacheVersion() != 0 && memcmp(pinSalt, AuthCachePinSalt(), AUTH_CACHE_PIN_SALT_SIZE) != 0)
+		{
+			Serial.println("-- Rooms changed, syncing the whole cache");
+			AuthCacheInvalidate();
+			RequestAuthSync();
+			return;
+		}
+		if (mode == SYNC_UNCHANGED)
+		{
+			AuthCacheCommit(version, rooms, roomCount, pinSalt, serverTime);
+			authSyncInterval = AUTH_SYNC_INTERVAL;
+			return;
+		}
+		AuthCacheBeginUpdate(mode == SYNC_SNAPSHOT);
+		authSyncInProgress = true;
+		authSyncTarget = version;
+	}
+
+	JsonArray &removed = root["del"].as<JsonArray>();
+	for (byte i = 0; i < removed.size(); i++)
+	{
+		record.uidSize = StrToUID(removed[i], record.uid);
+		AuthCacheRemove(record.uid, record.uidSize);
+	}
+
+	JsonArray &added = root["add"].as<JsonArray>();
+	for (byte i = 0; i < added.size(); i++)
+	{
+		JsonArray &entry = added[i].as<JsonArray>();
+		record.uidSize = StrToUID(entry[0], record.uid);
+		record.accessLevel = entry[1];
+		record.expires = entry[2];
+		// Only users allowed into a room that asks for a password get a verifier
+		bool hasPin = entry.size() > 3 && HexToBytes(entry[3], verifier, AUTH_CACHE_PIN_VERIFIER_SIZE) == AUTH_CACHE_PIN_VERIFIER_SIZE;
+		if (!AuthCacheInsert(&record, hasPin ? verifier : NULL))
+		{
+			Serial.println("-- Could not store UID in cache");
+			AuthSyncFailed();
+			return;
+		}
+	}
+
+	int next = root["next"];
+	if (next >= 0)
+	{
+		authSyncOffset = next;
+		return;
+	}
+
+	AuthCacheCommit(version, rooms, roomCount, pinSalt, serverTime);
+	TapFilterForgetRejected();
+	Serial.print("-- Authorization cache synced, UIDs: ");
+	Serial.println(AuthCacheCount());
+	authSyncInProgress = false;
+	authSyncOffset = 0;
+	authSyncTarget = 0;
+	authSyncInterval = AUTH_SYNC_INTERVAL;
+}
+
+/*
+ *  byte LocalUnlockDecision (byte *uid, byte uidSize, byte door, byte readerPosition);
+ *
+ *  Description:
+ *  - Decides a tap from the authorization cache. Only unlocks that need nothing
+ *  else from the server are decided locally, or that only need a password the
+ *  cache holds a verifier for, against the level of the door's room
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte *uid: UID bytes read by the RFID module
+ *  [INPUT] byte uidSize: size of UID
+ *  [INPUT] byte door: the door tapped at
+ *  [INPUT] byte readerPosition: indicates if the person is entering or leaving the room
+ *
+ *  Returns:
+ *  [byte] AUTHORIZED, PASSWORD_REQUIRED (to be checked by LocalPasswordMatches) or ASK_SERVER
+ */
+byte LocalUnlockDecision(byte *uid, byte uidSize, byte door, byte readerPosition)
+{
+	AuthCacheRecord record;
+	byte verifier[AUTH_CACHE_PIN_VERIFIER_SIZE];
+
+	if (!AuthCacheLookup(uid, uidSize, &record))
+		return ASK_SERVER;
+	// Always authorize from inside
+	if (readerPosition == READER_INSIDE)
+		return AUTHORIZED;
+	// Visitors, insufficient privileges and rooms the server didn't send are left for the server
+	if (!AuthCacheRoomKnown(door) || record.accessLevel == 0 || record.accessLevel < AuthCacheRoomLevel(door))
+		return ASK_SERVER;
+	if (AuthCachePasswordRequired(door))
+		return AuthCacheLookupPin(uid, uidSize, verifier) ? PASSWORD_REQUIRED : ASK_SERVER;
+	return AUTHORIZED;
+}
+
+/*
+ *  bool LocalPasswordMatches (const Tap *tap, const char *hashed);
+ *
+ *  Description:
+ *  - Checks a password against the tapped card's verifier in the cache: the
+ *  HMAC-SHA256 of the password hash keyed with the rooms' salt, truncated the
+ *  same way the server does. Verifiers are sent to users allowed into any of the
+ *  doors' rooms that ask for a password, so the level of this door's room is checked too
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const Tap *tap: the tap the password was typed for
+ *  [INPUT] const char *hashed: the password hash, from HashedPassword
+ *
+ *  Returns:
+ *  [bool] Does the password match? False if there is no verifier to compare with
+ */
+bool LocalPasswordMatches(const Tap *tap, const char *hashed)
+{
+	AuthCacheRecord record;
+	byte verifier[AUTH_CACHE_PIN_VERIFIER_SIZE];
+	byte digest[HASH_LENGTH];
+	Sha256 hmac;
+
+	if (tap->readerPosition != READER_OUTSIDE || !AuthCacheRoomKnown(tap->door))
+		return false;
+	if (!AuthCacheLookup(tap->uid.uidByte, tap->uid.size, &record) || record.accessLevel < AuthCacheRoomLevel(tap->door))
+		return false;
+	if (!AuthCacheLookupPin(tap->uid.uidByte, tap->uid.size, verifier))
+		return false;
+	HexToBytes(hashed, digest, HASH_LENGTH);
+	hmac.initHmac(AuthCachePinSalt(), AUTH_CACHE_PIN_SALT_SIZE);
+	hmac.write(digest, HASH_LENGTH);
+	return memcmp(hmac.resultHmac(), verifier, AUTH_CACHE_PIN_VERIFIER_SIZE) == 0;
+}
+
+/*
+ *  void LogEvent (byte api, byte eventType, byte door, byte readerPosition, const byte *uid, byte uidSize);
+ *
+ *  Description:
+ *  - Writes an event the server didn't see to the journal, to be uploaded later
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte api: which API the event belongs to
+ *  [INPUT] byte eventType: server status code of the event
+ *  [INPUT] byte door: the door the event happened at
+ *  [INPUT] byte readerPosition: indicates if the person was entering or leaving the room
+ *  [INPUT] const byte *uid: the UID bytes, NULL if there's no card
+ *  [INPUT] byte uidSize: number of bytes in the UID
+ */
+void LogEvent(byte api, byte eventType, byte door, byte readerPosition, const byte *uid, byte uidSize)
+{
+	if (JournalPending() == 0)
+		journalPendingSince = millis();
+	JournalAppend(api, eventType, door, readerPosition, uid, uidSize);
+}
+
+/*
+ *  bool JournalUploadDue (void);
+ *
+ *  Description:
+ *  - Events are uploaded once a batch is full or the oldest one has waited
+ *  JOURNAL_FLUSH_DELAY. After a failure, waits JOURNAL_RETRY before trying again
+ *
+ *  Returns:
+ *  [bool] Should the journal be uploaded now?
+ */
+bool JournalUploadDue(void)
+{
+	if (JournalPending() == 0)
+		return false;
+	if (journalRetrying && millis() - journalFailedAt < JOURNAL_RETRY)
+		return false;
+	return JournalPending() >= JOURNAL_BATCH_SIZE || millis() - journalPendingSince >= JOURNAL_FLUSH_DELAY;
+}
+
+/*
+ *  void JournalUploadFailed (void);
+ *
+ *  Description:
+ *  - Keeps the events in the journal and backs off
+ */
+void JournalUploadFailed(void)
+{
+	Serial.println("-- Journal upload failed");
+	journalRetrying = true;
+	journalFailedAt = millis();
+}
+
+/*
+ *  void ApplyJournalResponse (char *response);
+ *
+ *  Description:
+ *  - Marks the batch sent as uploaded. The server also reports the version of the
+ *  authorization table, so the cache is synced as soon as it falls behind
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] char *response: Server's response, parsed in place
+ */
+void ApplyJournalResponse(char *response)
+{
+	StaticJsonBuffer<JSON_OBJECT_SIZE(3)> jsonBuffer;
+
+	JsonObject &root = jsonBuffer.parseObject(response);
+	if (!root.success() || root["status"].as<int>() != AUTHORIZED)
+	{
+		JournalUploadFailed();
+		return;
+	}
+	JournalAck(journalBatchStart, journalBatchCount);
+	journalRetrying = false;
+	Serial.print("-- Journal events uploaded: ");
+	Serial.println(journalBatchCount);
+	if (root["version"].as<uint32_t>() != AuthCacheVersion() && !authSyncInProgress)
+		RequestAuthSync();
+}
+
+/*
+ *  bool TelemetryUploadDue (void);
+ *
+ *  Description:
+ *  - A report is uploaded every TELEMETRY_INTERVAL
+ *
+ *  Returns:
+ *  [bool] Should the telemetry be uploaded now?
+ */
+bool TelemetryUploadDue(void)
+{
+	return millis() - telemetry.since >= TELEMETRY_INTERVAL;
+}
+
+/*
+ *  void BeginTelemetryUpload (void);
+ *
+ *  Description:
+ *  - Sends the telemetry of the current period to TELEMETRY and starts a new
+ *  period, so nothing recorded while the report is in flight is lost. The
+ *  report is kept until the request ends, so a retry sends the same one
+ */
+void BeginTelemetryUpload(void)
+{
+	telemetryReport = telemetry;
+	telemetryReportAt = millis();
+	telemetryReportSramLow = MemoryStatsLowWater();
+	TelemetryReset();
+	BeginJsonPost(REQ_TELEMETRY, TELEMETRY);
+}
+
+/*
+ *  void TelemetryUploadFailed (void);
+ *
+ *  Description:
+ *  - The report is lost, only the count of lost reports goes in the next one
+ */
+void TelemetryUploadFailed(void)
+{
+	Serial.println("-- Telemetry upload failed");
+	TelemetryCount(&telemetry.droppedReports);
+}
+
+/*
+ *  bool KeypadFree (byte door);
+ *
+ *  Description:
+ *  - The keypad reads one door's password at a time. A door typing ahead gives
+ *  it up to another door that needs it, as long as nothing was typed yet
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door that needs the keypad
+ *
+ *  Returns:
+ *  [bool] May the door start reading a password?
+ */
+bool KeypadFree(byte door)
+{
+	return pinDoor == NO_DOOR || pinDoor == door || (pinSpeculative && pinLength == 0 && !pinEntered);
+}
+
+/*
+ *  void BeginPinCapture (byte door, bool speculative);
+ *
+ *  Description:
+ *  - Starts reading a new password from the keypad
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door it is read for
+ *  [INPUT] bool speculative: is it read before the server asked for it?
+ */
+void BeginPinCapture(byte door, bool speculative)
+{
+	pinDoor = door;
+	pinHash.init();
+	pinLength = 0;
+	pinEntered = false;
+	pinSpeculative = speculative;
+	pinLastKey = millis();
+}
+
+/*
+ *  void CancelPinCapture (byte door);
+ *
+ *  Description:
+ *  - Drops what was typed for a door, so the keypad stops being read and
+ *  nothing of it is taken for the password of a later tap. Nothing is done if
+ *  the keypad is read for another door
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void CancelPinCapture(byte door)
+{
+	if (pinDoor != door)
+		return;
+	pinDoor = NO_DOOR;
+	pinSpeculative = false;
+	pinEntered = false;
+	pinLength = 0;
+}
+
+/*
+ *  void ResetStatus (byte door);
+ *
+ *  Description:
+ *  - Unlocks the door's readers and drops the visitors collected there
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void ResetStatus(byte door)
+{
+	DoorTap *t = &doorTaps[door];
+
+	for (byte i = 0; i < NUM_READERS; i++)
+	{
+		if (readerConfigs[i].door == door)
+			readers_locked[i] = false;
+	}
+	t->visitorCount = 0;
+	t->decisionToken = NO_DECISION_TOKEN;
+	CancelPinCapture(door);
+}
+
+/*
+ *  void UnlockDoor (byte door);
+ *
+ *  Description:
+ *  - Procedure to unlock the door. The lock is released again by DoorTick
+ *  after DOOR_UNLOCK_TIME
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void UnlockDoor(byte door)
+{
+	FastPinWrite(&doorRelays[door], LOW);
+	LatencyStop(LATENCY_UNLOCK);
+	doors[door].unlocked = true;
+	doors[door].unlockedAt = millis();
+}
+
+/*
+ *  void EnterState (byte door, byte newState);
+ *
+ *  Description:
+ *  - Switches a door's state, showing its color on the door's readers' LEDs
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ *  [INPUT] byte newState: one of the STATE_* values
+ */
+void EnterState(byte door, byte newState)
+{
+	DoorTap *t = &doorTaps[door];
+
+	t->state = newState;
+	t->ledToggles = 0;
+	t->ledHold = false;
+	WriteDoorLED(door, StateColor(door));
+}
+
+/*
+ *  void EnterRestState (byte door);
+ *
+ *  Description:
+ *  - Goes back to the state the door is in once its tap has been handled
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void EnterRestState(byte door)
+{
+	if (doors[door].open)
+		EnterState(door, STATE_DOOR_OPEN);
+	else if (doors[door].unlocked)
+		EnterState(door, STATE_UNLOCKING);
+	else if (doorTaps[door].visitorCount > 0)
+		EnterState(door, STATE_VISITOR_COLLECTION);
+	else
+		EnterState(door, STATE_IDLE);
+}
+
+/*
+ *  void GrantAccess (byte door);
+ *
+ *  Description:
+ *  - Unlocks the door for its tap
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void GrantAccess(byte door)
+{
+	UnlockDoor(door);
+	ResetStatus(door);
+	EnterState(door, STATE_UNLOCKING);
+}
+
+/*
+ *  void ErrorExit (byte door);
+ *
+ *  Description:
+ *  - Gives up on the door's tap, showing the error on its LEDs and the buzzer
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void ErrorExit(byte door)
+{
+	ResetStatus(door);
+	EnterRestState(door);
+	ShowError(door);
+	BlinkBuzzer(3, 50);
+	BuzzTimer(200);
+}
+
+/*
+ *  void CheckVisitorTimeout (byte door);
+ *
+ *  Description:
+ *  - Drops the visitors collected at a door if the employee doesn't show up in TIMEOUT_VISITOR
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void CheckVisitorTimeout(byte door)
+{
+	if ((millis() - doorTaps[door].visitorInitTime) >= TIMEOUT_VISITOR)
+	{
+		Serial.println("-- Visitor timeout");
+		ResetStatus(door);
+		EnterRestState(door);
+	}
+}
+
+/*
+ *  void PasswordAccepted (byte door);
+ *
+ *  Description:
+ *  - Unlocks once the password is accepted, unless there are visitors to be
+ *  sent to AUTHORIZE_VISITOR first
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void PasswordAccepted(byte door)
+{
+	if (doorTaps[door].visitorCount == 0)
+		GrantAccess(door);
+	else
+	{
+		doorTaps[door].pendingRequest = REQ_VISITORS;
+		EnterState(door, STATE_AWAITING_SERVER);
+	}
+}
+
+/*
+ *  bool PasswordLikely (const Tap *tap);
+ *
+ *  Description:
+ *  - Tells if the server will probably ask for a password after this tap: the
+ *  cache knows if the door's room does, and any room is known once it asked
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const Tap *tap: the card read
+ *
+ *  Returns:
+ *  [bool] Should the keypad be read while REQUEST_UNLOCK is in flight?
+ */
+bool PasswordLikely(const Tap *tap)
+{
+	if (tap->readerPosition != READER_OUTSIDE)
+		return false;
+	if (AuthCacheUsable() && AuthCachePasswordRequired(tap->door))
+		return true;
+	return passwordDoors & (1 << tap->door);
+}
+
+/*
+ *  void SubmitPassword (void);
+ *
+ *  Description:
+ *  - Finishes the hash of the password typed for pinDoor, then checks it against
+ *  the cache's verifier, or sends it to AUTHENTICATE if there's none or it
+ *  doesn't match (the cache may be behind a password change). The keypad is
+ *  free for the other doors from then on
+ */
+void SubmitPassword(void)
+{
+	byte door = pinDoor;
+	DoorTap *t = &doorTaps[door];
+
+	if (pinLength == 0)
+	{
+		Serial.println("-- Empty password");
+		ErrorExit(door);
+		return;
+	}
+	LatencyStart(LATENCY_HASH);
+	readableHash(pinHash.result(), t->hashedPin);
+	LatencyStop(LATENCY_HASH);
+	CancelPinCapture(door);
+	Serial.print("-- Hashed password (SHA-256): ");
+	Serial.println(t->hashedPin);
+	if (LocalPasswordMatches(&t->tap, t->hashedPin))
+	{
+		Serial.println("-- Password checked by local cache");
+		TelemetryCount(&telemetry.localUnlocks);
+		PasswordAccepted(door);
+		LogEvent(AUTH_API, AUTHORIZED, door, t->tap.readerPosition, t->tap.uid.uidByte, t->tap.uid.size);
+		return;
+	}
+	t->pendingRequest = REQ_AUTHENTICATE;
+	EnterState(door, STATE_AWAITING_SERVER);
+	// Blinks WAITING_COLOR once password is read
+	BlinkRGB(door, 2, 250, BLACK, WAITING_COLOR);
+}
+
+/*
+ *  void AwaitPassword (byte door);
+ *
+ *  Description:
+ *  - Blinks DO_SOMETHING_COLOR and waits for the password to be typed. What was
+ *  typed while REQUEST_UNLOCK was in flight is kept, and submitted right away if
+ *  it's complete. The tap fails if the keypad is taken by another door
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte door: the door's index in doorConfigs
+ */
+void AwaitPassword(byte door)
+{
+	if (pinDoor != door)
+	{
+		if (!KeypadFree(door))
+		{
+			Serial.println("-- Keypad in use at another door");
+			ErrorExit(door);
+			return;
+		}
+		BeginPinCapture(door, false);
+	}
+	pinSpeculative = false;
+	pinLastKey = millis();
+	EnterState(door, STATE_AWAITING_PIN);
+	BlinkRGB(door, 1, 50, BLACK, DO_SOMETHING_COLOR);
+	Serial.println("-- Waiting for password...");
+	if (pinEntered)
+		SubmitPassword();
+}
+
+/*
+ *  void OnResponse (byte kind, byte door, byte status);
+ *
+ *  Description:
+ *  - Moves a door's state machine forward with the server's answer to a request
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte kind: which request was answered
+ *  [INPUT] byte door: the door of the tap the request was sent for
+ *  [INPUT] byte status: the server's response status, 255 if the request failed
+ */
+void OnResponse(byte kind, byte door, byte status)
+{
+	DoorTap *t = &doorTaps[door];
+
+	Serial.print("-- Status: ");
+	Serial.println(status);
+
+	if (kind == REQ_UNLOCK)
+	{
+		// Remembers which rooms ask for a password, an outside unlock without one means it doesn't
+		if (status == PASSWORD_REQUIRED)
+			passwordDoors |= 1 << door;
+		else if (status == AUTHORIZED && t->tap.readerPosition == READER_OUTSIDE)
+			passwordDoors &= ~(1 << door);
+		// Typing ahead is only kept if the server asks for a password
+		if (status != PASSWORD_REQUIRED)
+			CancelPinCapture(door);
+
+		// If already authorized, unlocks door
+		if (status == AUTHORIZED)
+			GrantAccess(door);
+		else if (status == PASSWORD_REQUIRED)
+			AwaitPassword(door);
+		else if (status == VISITOR_RFID_FOUND)
+		{
+			if (t->visitorCount < MAX_VISITOR_NUM)
+			{
+				t->visitorInitTime = millis();
+				Serial.println("Registering visitor...");
+				t->visitorUids[t->visitorCount] = t->tap.uid;
+				t->visitorCount++;
+			}
+			EnterRestState(door);
+		}
+		else
+		{
+			if (status == RFID_NOT_FOUND)
+				TapFilterReject(t->tap.uid.uidByte, t->tap.uid.size);
+			ErrorExit(door);
+		}
+	}
+	else if (kind == REQ_AUTHENTICATE)
+	{
+		if (status != AUTHORIZED)
+			ErrorExit(door);
+		else
+			PasswordAccepted(door);
+	}
+	else if (kind == REQ_VISITORS)
+	{
+		if (status == VISITOR_AUTHORIZED)
+			GrantAccess(door);
+		else
+			ErrorExit(door);
+	}
+}
+
+/*
+ *  void FinishRequest (byte status);
+ *
+ *  Description:
+ *  - Frees the connection for the next request and handles the response
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte status: the server's response status
+ */
+void FinishRequest(byte status)
+{
+	byte kind = requestKind;
+	requestKind = REQ_NONE;
+	TelemetryStatus(status);
+	OnResponse(kind, requestDoor, status);
+}
+
+/*
+ *  void FailRequest (void);
+ *
+ *  Description:
+ *  - Gives up on the request in flight
+ */
+void FailRequest(void)
+{
+	const Tap *tap = &doorTaps[requestDoor].tap;
+
+	httpFailures++;
+	PrintConnectionStats();
+	if (requestKind == REQ_SYNC)
+	{
+		requestKind = REQ_NONE;
+		AuthSyncFailed();
+		return;
+	}
+	if (requestKind == REQ_JOURNAL)
+	{
+		requestKind = REQ_NONE;
+		JournalUploadFailed();
+		return;
+	}
+	if (requestKind == REQ_TELEMETRY)
+	{
+		requestKind = REQ_NONE;
+		TelemetryUploadFailed();
+		return;
+	}
+	// The server never saw this tap, keeps it in the journal
+	LogEvent(requestKind == REQ_UNLOCK ? UNLOCK_API : requestKind == REQ_AUTHENTICATE ? AUTH_API : VISITOR_API,
+			 SERVER_UNREACHABLE, tap->door, tap->readerPosition, tap->uid.uidByte, tap->uid.size);
+	// Doesn't try to upload the journal right away, the server is likely down
+	journalRetrying = true;
+	journalFailedAt = millis();
+	FinishRequest(255);
+}
+
+/*
+ *  void RetryOrFail (void);
+ *
+ *  Description:
+ *  - The server closed the kept-alive connection before answering, which is
+ *  expected after it has been idle for a while. The request is sent again once
+ *  over a new connection
+ */
+void RetryOrFail(void)
+{
+	httpClient.stop();
+	if (requestReused && requestAttempt == 0)
+	{
+		requestAttempt++;
+		SendRequestAttempt();
+		return;
+	}
+	FailRequest();
+}
+
+/*
+ *  void CompleteRequest (void);
+ *
+ *  Description:
+ *  - Reads the response of the request in flight once it starts arriving
+ */
+void CompleteRequest(void)
+{
+	if (httpClient.responseStatusCode() < 0)
+	{
+		RetryOrFail();
+		return;
+	}
+	if (requestReused)
+		httpReused++;
+	PrintConnectionStats();
+
+	unsigned long roundTrip = millis() - requestStartedAt;
+	if (requestKind == REQ_UNLOCK)
+		TelemetryRecord(TELEMETRY_UNLOCK_RTT, roundTrip);
+	else if (requestKind == REQ_AUTHENTICATE)
+		TelemetryRecord(TELEMETRY_AUTH_RTT, roundTrip);
+	else if (requestKind == REQ_VISITORS)
+		TelemetryRecord(TELEMETRY_VISITOR_RTT, roundTrip);
+
+	if (requestKind == REQ_SYNC)
+	{
+		requestKind = REQ_NONE;
+		if (ReadResponseBody() < 0)
+			AuthSyncFailed();
+		else
+			ApplyAuthSyncPage(responseBody);
+		return;
+	}
+	if (requestKind == REQ_JOURNAL)
+	{
+		requestKind = REQ_NONE;
+		if (ReadResponseBody() < 0)
+			JournalUploadFailed();
+		else
+			ApplyJournalResponse(responseBody);
+		return;
+	}
+	if (requestKind == REQ_TELEMETRY)
+	{
+		requestKind = REQ_NONE;
+		if (ReadJsonStatus(NULL) != AUTHORIZED)
+			TelemetryUploadFailed();
+		else
+			telemetry.droppedReports = 0;
+		return;
+	}
+	// A password or visitors request that follows presents the session the server opened, if any
+	FinishRequest(ReadStatusResponse(&doorTaps[requestDoor].decisionToken));
+}
+
+/*
+ *  void StartNextRequest (void);
+ *
+ *  Description:
+ *  - Sends the most urgent pending request: the doors' taps first, taking the
+ *  doors in turn, then the journal between taps and, when nothing else is
+ *  going on, the sync and the telemetry
+ */
+void StartNextRequest(void)
+{
+	byte kind = REQ_NONE;
+
+	for (byte i = 0; i < NUM_DOORS && kind == REQ_NONE; i++)
+	{
+		byte door = (nextRequestDoor + i) % NUM_DOORS;
+		if (doorTaps[door].pendingRequest != REQ_NONE)
+		{
+			kind = doorTaps[door].pendingRequest;
+			doorTaps[door].pendingRequest = REQ_NONE;
+			requestDoor = door;
+			nextRequestDoor = (door + 1) % NUM_DOORS;
+		}
+	}
+
+	if (kind == REQ_UNLOCK)
+		BeginRequestUnlock();
+	else if (kind == REQ_AUTHENTICATE)
+		BeginRequestAuthenticate();
+	else if (kind == REQ_VISITORS)
+		BeginRequestVisitors();
+	// Background requests wait for the network
+	else if (networkMode == NET_CONFIG_NONE)
+		return;
+	else if (!TapInProgress() && JournalUploadDue())
+		BeginJsonPost(REQ_JOURNAL, EVENTS_BULK);
+	else if (AllDoorsIdle() && AuthSyncDue())
+		BeginAuthSyncStep();
+	else if (AllDoorsIdle() && TelemetryUploadDue())
+		BeginTelemetryUpload();
+}
+/*
+ *  IPAddress ConfigAddress (const byte *octets);
+ *
+ *  Description:
+ *  - Builds an address stored in a NetConfig
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const byte *octets: its 4 bytes
+ *
+ *  Returns:
+ *  [IPAddress] The address
+ */
+IPAddress ConfigAddress(const byte *octets)
 {
+	return IPAddress(octets[0], octets[1], octets[2], octets[3]);
+}
 
-	// Turn LEDs into FUCHSIA to print that the setup has been going on
-	WriteReaderLED(FUCHSIA);
+/*
+ *  void PrintAddress (void);
+ *
+ *  Description:
+ *  - Prints the address in use and where it came from
+ */
+void PrintAddress(void)
+{
+	Serial.print("- My IP: ");
+	if (networkMode == NET_CONFIG_NONE)
+	{
+		Serial.println("none");
+		return;
+	}
+	Serial.print(Ethernet.localIP());
+	Serial.print(", gateway ");
+	Serial.print(Ethernet.gatewayIP());
+	Serial.print(", mask ");
+	Serial.print(Ethernet.subnetMask());
+	Serial.println(networkMode == NET_CONFIG_STATIC ? " (static)" : dhcpBound ? " (DHCP)" : " (last lease)");
+}
 
-	// Starts serial communication for debugging purposes
+/*
+ *  void PrintMac (void);
+ *
+ *  Description:
+ *  - Prints the MAC address
+ */
+void PrintMac(void)
+{
+	Serial.print("- My MAC: ");
+	for (byte i = 0; i < sizeof(mac); i++)
+	{
+		if (i > 0)
+			Serial.print(":");
+		Serial.print(mac[i], HEX);
+	}
+	Serial.println();
+}
 
-	Serial.begin(SERIAL_SPEED);
+/*
+ *  void PrintNetworkStatus (void);
+ *
+ *  Description:
+ *  - Prints the MAC, the address in use and how long the boot took
+ */
+void PrintNetworkStatus(void)
+{
+	PrintMac();
+	PrintAddress();
+	Serial.print("- Ready ");
+	Serial.print(telemetry.bootTime);
+	Serial.print(" ms after power-on, network ");
+	if (networkMode == NET_CONFIG_NONE)
+		Serial.println("not up yet");
+	else
+	{
+		Serial.print(telemetry.networkTime);
+		Serial.println(" ms");
+	}
+}
 
-	Serial.println("=== Beginning Setup...");
-	Serial.println("-- Setting SPI SS pins...");
+/*
+ *  void NetworkUp (byte mode);
+ *
+ *  Description:
+ *  - The Ethernet module has been given an address. The first time, the time
+ *  since power-on is kept for the telemetry
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte mode: NET_CONFIG_LEASE or NET_CONFIG_STATIC
+ */
+void NetworkUp(byte mode)
+{
+	if (networkMode == NET_CONFIG_NONE)
+		telemetry.networkTime = millis();
+	networkMode = mode;
+	PrintAddress();
+}
 
-	pinMode(SS_PIN_INSIDE, OUTPUT);
-	pinMode(SS_PIN_OUTSIDE, OUTPUT);
+/*
+ *  void ApplyNetConfig (const NetConfig *config);
+ *
+ *  Description:
+ *  - Gives the Ethernet module a stored address, without waiting on the network.
+ *  The server is reached by its IP, so the gateway stands in for the DNS server
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const NetConfig *config: the stored configuration
+ */
+void ApplyNetConfig(const NetConfig *config)
+{
+	IPAddress gateway = ConfigAddress(config->gateway);
 
-	Serial.println("-- Setting LEDs pins as output...");
+	SelectEthernet();
+	Ethernet.begin(mac, ConfigAddress(config->ip), gateway, gateway, ConfigAddress(config->subnet));
+	NetworkUp(config->mode);
+}
 
-	pinMode(LED_IN_R, OUTPUT);
-	pinMode(LED_IN_G, OUTPUT);
-	pinMode(LED_IN_B, OUTPUT);
-	pinMode(LED_OUT_R, OUTPUT);
-	pinMode(LED_OUT_G, OUTPUT);
-	pinMode(LED_OUT_B, OUTPUT);
-	pinMode(DOOR_PIN, OUTPUT);
-	digitalWrite(DOOR_PIN, HIGH);
+/*
+ *  void DhcpAttempt (void);
+ *
+ *  Description:
+ *  - Asks DHCP for an address, blocking for DHCP_TIMEOUT at most. The address
+ *  given is stored as the lease for the next boot. If nobody answers, the
+ *  stored lease is put back and the attempt is retried later, twice as late as
+ *  the last time up to DHCP_RETRY_MAX
+ */
+void DhcpAttempt(void)
+{
+	NetConfig config;
 
-	Serial.println("-- Initializing RFID modules...");
+	Serial.println("-- Requesting an address from DHCP...");
+	// The address is cleared during the attempt, so the kept-alive connection is lost anyway
+	httpClient.stop();
+	SelectEthernet();
+	if (Ethernet.begin(mac, DHCP_TIMEOUT, DHCP_RESPONSE_TIMEOUT) == 0)
+	{
+		dhcpAttemptAt = millis();
+		dhcpRetryDelay = dhcpRetryDelay == 0 ? DHCP_RETRY_MIN : 2 * dhcpRetryDelay;
+		if (dhcpRetryDelay > DHCP_RETRY_MAX)
+			dhcpRetryDelay = DHCP_RETRY_MAX;
+		Serial.print("Failed to configure Ethernet using DHCP, retrying in ");
+		Serial.print(dhcpRetryDelay / 1000);
+		Serial.println(" s");
+		if (NetConfigLoad(&config) != NET_CONFIG_NONE)
+			ApplyNetConfig(&config);
+		else
+			networkMode = NET_CONFIG_NONE;
+		return;
+	}
+	dhcpBound = true;
+	dhcpRetryDelay = 0;
+	NetConfigSave(NET_CONFIG_LEASE, Ethernet.localIP(), Ethernet.gatewayIP(), Ethernet.subnetMask());
+	NetworkUp(NET_CONFIG_LEASE);
+}
 
-	SPI.begin();
-	for (byte i = 0; i < NUM_READERS; i++)
+/*
+ *  void DhcpTick (void);
+ *
+ *  Description:
+ *  - Gets an address from DHCP once it's due, or renews the lease, which blocks
+ *  for DHCP_TIMEOUT at most when it's time to: the Ethernet library has no
+ *  non-blocking DHCP. Only called while idle, and attempts also wait for the
+ *  readers to be quiet for READER_ACTIVE_TIME, which at boot puts the first
+ *  one off until the doors have been working from the cache for that long
+ */
+void DhcpTick(void)
+{
+	if (networkMode == NET_CONFIG_STATIC)
+		return;
+	if (dhcpBound)
 	{
-		digitalWrite(SS_PIN_INSIDE, HIGH);
-		digitalWrite(SS_PIN_OUTSIDE, HIGH);
-		digitalWrite(ssPins[i], LOW);
-		readers[i].PCD_Init(ssPins[i], RST_PIN);
-		Serial.print("-- Reader ");
-		Serial.print(i + 1);
+		byte result = Ethernet.maintain();
+		if (result == DHCP_CHECK_RENEW_OK || result == DHCP_CHECK_REBIND_OK)
+			NetConfigSave(NET_CONFIG_LEASE, Ethernet.localIP(), Ethernet.gatewayIP(), Ethernet.subnetMask());
+		return;
+	}
+	if (dhcpRetryDelay > 0 && millis() - dhcpAttemptAt < dhcpRetryDelay)
+		return;
+	if (millis() - lastTagAt < READER_ACTIVE_TIME)
+		return;
+	DhcpAttempt();
+}
 
-		Serial.print(" initialized!\n- Version: ");
-		readers[i].PCD_DumpVersionToSerial();
+/*
+ *  void NetworkBegin (void);
+ *
+ *  Description:
+ *  - Brings the network up at boot from the stored address, if there is one.
+ *  DHCP is left to the loop, so a DHCP server that is down or slow doesn't
+ *  hold the doors
+ */
+void NetworkBegin(void)
+{
+	NetConfig config;
+
+	PrintMac();
+	if (NetConfigLoad(&config) != NET_CONFIG_NONE)
+		ApplyNetConfig(&config);
+	else
+		Serial.println("- No stored address, waiting for DHCP");
+	httpClient.connectionKeepAlive();
+}
+
+/*
+ *  void NetworkTick (void);
+ *
+ *  Description:
+ *  - Polls the request in flight without waiting for it, or starts the next one.
+ *  DHCP goes in between requests, while idle
+ */
+void NetworkTick(void)
+{
+	if (requestKind == REQ_NONE)
+	{
+		if (AllDoorsIdle())
+			DhcpTick();
+		StartNextRequest();
+		return;
+	}
+	if (requestBroken)
+	{
+		FailRequest();
+		return;
 	}
 
-	Serial.println("-- Initializing Ethernet module...");
+	SelectEthernet();
+	if (ethClient.available())
+		CompleteRequest();
+	else if (!ethClient.connected())
+		RetryOrFail();
+	else if (millis() - requestSentAt >= REQUEST_TIMEOUT)
+	{
+		Serial.println("Request timed out!");
+		httpClient.stop();
+		FailRequest();
+	}
+}
 
-	for (byte i = 0; i < NUM_READERS; i++)
+/*
+ *  void PinTick (void);
+ *
+ *  Description:
+ *  - Reads the keypad for pinDoor while waiting for the password, or while
+ *  REQUEST_UNLOCK is in flight for a room that likely asks for one. Each digit goes into the hash
+ *  as it's typed. Once the password is complete it's submitted, or kept until
+ *  the server asks for it
+ */
+void PinTick(void)
+{
+	char c = keyPad.getKey();
+
+	if (!c)
 	{
-		digitalWrite(ssPins[i], HIGH);
+		// Typing ahead doesn't time out, the server's answer ends it
+		if (doorTaps[pinDoor].state == STATE_AWAITING_PIN && millis() - pinLastKey >= TIMEOUT_PASSWORD)
+		{
+			Serial.println("-- Password timeout");
+			ErrorExit(pinDoor);
+		}
+		return;
 	}
-	digitalWrite(SS_PIN_ETHERNET, LOW);
 
-	if (Ethernet.begin(mac) == 0)
+	pinLastKey = millis();
+	BlinkBuzzer(1, 50);
+	if (c == QUIT_TYPING)
+	{
+		// Typing ahead starts over, the tap goes on
+		if (pinSpeculative)
+			BeginPinCapture(pinDoor, true);
+		else
+			ErrorExit(pinDoor);
+		return;
+	}
+	// Keys past END_OF_PASSWORD wait with it for the server's answer
+	if (pinEntered)
+		return;
+	if (c != END_OF_PASSWORD)
 	{
-		WriteReaderLED(ERROR_COLOR);
-		Serial.println("Failed to configure Ethernet using DHCP");
-		delay(1000);
-		setup();
+		BlinkRGB(pinDoor, 1, 75, BLACK, DO_SOMETHING_COLOR);
+		// Digits past PIN_MAX_SIZE are ignored
+		if (pinLength < PIN_MAX_SIZE)
+		{
+			pinHash.write((uint8_t)c);
+			pinLength++;
+		}
+		return;
 	}
 
-	Serial.print("- My MAC: ");
-	Serial.print(mac[0], HEX);
-	Serial.print(":");
-	Serial.print(mac[1], HEX);
-	Serial.print(":");
-	Serial.print(mac[2], HEX);
-	Serial.print(":");
-	Serial.print(mac[3], HEX);
-	Serial.print(":");
-	Serial.print(mac[4], HEX);
-	Serial.print(":");
-	Serial.print(mac[5], HEX);
-	Serial.println();
-	Serial.print("- My IP: ");
-	Serial.println(Ethernet.localIP());
+	pinEntered = true;
+	LatencyStart(LATENCY_UNLOCK);
+	Serial.println(pinSpeculative ? "-- Password typed ahead" : "-- Password typed");
+	if (!pinSpeculative)
+		SubmitPassword();
+}
 
-	// Initializes the sensor
-	Serial.println("-- Setting sensor pin as input...");
-	pinMode(PIN_SENSOR, INPUT);
-	// Initializes the buzzer
-	Serial.println("-- Setting buzzer pin as output...");
-	pinMode(PIN_BUZZER, OUTPUT);
-	WriteReaderLED(STANDBY_COLOR);
+/*
+ *  void SerialTick (void);
+ *
+ *  Description:
+ *  - Runs the commands typed on the serial monitor: 't' prints the telemetry,
+ *  'l' the latency benchmark results (LATENCY_BENCH builds only) and 'n' the
+ *  network status. 's' keeps the address in use as static and 'd' goes back
+ *  to DHCP, starting from that address
+ */
+void SerialTick(void)
+{
+	switch (Serial.read())
+	{
+	case 'n':
+		PrintNetworkStatus();
+		break;
+	case 's':
+		if (networkMode == NET_CONFIG_NONE)
+			break;
+		NetConfigSave(NET_CONFIG_STATIC, Ethernet.localIP(), Ethernet.gatewayIP(), Ethernet.subnetMask());
+		networkMode = NET_CONFIG_STATIC;
+		dhcpBound = false;
+		PrintAddress();
+		break;
+	case 'd':
+		if (networkMode != NET_CONFIG_STATIC)
+			break;
+		NetConfigSave(NET_CONFIG_LEASE, Ethernet.localIP(), Ethernet.gatewayIP(), Ethernet.subnetMask());
+		networkMode = NET_CONFIG_LEASE;
+		dhcpRetryDelay = 0;
+		PrintAddress();
+		break;
+	case 'l':
+		LatencyReport();
+		break;
+	case 't':
+		PrintTelemetry();
+		break;
+	}
 }
 
 /*
- *  Loop
+ *  void OnTag (byte reader);
+ *
+ *  Description:
+ *  - Handles a tap: unlocks right away if the cache can decide, otherwise asks the server
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] byte reader: the reader that read the card, its position tells if the person is entering or leaving the room
  */
-void loop()
+void OnTag(byte reader)
 {
-	/*  Full code for Arduino Client (still in development) */
-	String pw = "";
-	String tag = "";
-	byte status = 255;
-	String hashed = "";
-	String output = "";
-	byte readerPosition = 255;
-	String postData = "";
-	String employeeTag = "";
-	char entering_or_leaving = 255; //0 (ZERO) indicates entering and 1 (ONE) indicates leaving
-
-	CheckDoorTimeout();
-
-	// Standby mode
-	if (visitor_counter == 0)
-		WriteReaderLED(STANDBY_COLOR);
-	else
+	char tag[UID_HEX_SIZE];
+	byte door = readerConfigs[reader].door;
+	DoorTap *t = &doorTaps[door];
+
+	LatencyStart(LATENCY_UNLOCK);
+	TelemetryCount(&telemetry.taps);
+	lastTagAt = millis();
+	PrintMemoryStats();
+	UID_toStr(readers[reader].uid.uidByte, readers[reader].uid.size, tag);
+	Serial.print("\nUID Tag: ");
+	Serial.println(tag);
+	t->tap.uid = readers[reader].uid;
+	t->tap.reader = reader;
+	t->tap.readerPosition = readerConfigs[reader].position;
+	t->tap.door = door;
+	t->decisionToken = NO_DECISION_TOKEN;
+	CancelPinCapture(door);
+
+	// If the cache can decide, unlocks right away and logs afterwards
+	byte decision = LocalUnlockDecision(t->tap.uid.uidByte, t->tap.uid.size, door, t->tap.readerPosition);
+	if (decision == AUTHORIZED)
 	{
-		WriteReaderLED(DO_SOMETHING_COLOR);
+		Serial.println("-- Authorized by local cache");
+		TelemetryCount(&telemetry.localUnlocks);
+		GrantAccess(door);
+		LogEvent(UNLOCK_API, AUTHORIZED, door, t->tap.readerPosition, t->tap.uid.uidByte, t->tap.uid.size);
+		return;
 	}
 
-	// Starts to read
-	Serial.print("\n=== Starting to read...");
-	while (tag == "")
+	// The server didn't find this card a moment ago, it won't now either
+	uint16_t repeats = decision == ASK_SERVER ? TapFilterRejected(t->tap.uid.uidByte, t->tap.uid.size) : 0;
+	if (repeats > 0)
 	{
-		Serial.print(".");
-		if (visitor_counter > 0)
-			CheckVisitorTimeout();
-		delay(50);
-		tag = ReadRFIDTags(&entering_or_leaving);
+		Serial.print("-- Unknown card, repeat ");
+		Serial.println(repeats);
+		// One event stands for all the repeats until the entry expires
+		if (repeats == 1)
+			LogEvent(UNLOCK_API, RFID_NOT_FOUND, door, t->tap.readerPosition, t->tap.uid.uidByte, t->tap.uid.size);
+		ErrorExit(door);
+		return;
+	}
+
+	// Only the reader that was tapped is used at this door until the tap is handled
+	for (byte i = 0; i < NUM_READERS; i++)
+	{
+		if (readerConfigs[i].door == door)
+			readers_locked[i] = i != reader;
+	}
+	// The password can be checked locally, no need to ask the server for it
+	if (decision == PASSWORD_REQUIRED)
+	{
+		AwaitPassword(door);
+		return;
+	}
+	t->pendingRequest = REQ_UNLOCK;
+	EnterState(door, STATE_AWAITING_SERVER);
+	// The password, if the room asks for one, can be typed while the server answers
+	if (PasswordLikely(&t->tap) && KeypadFree(door))
+		BeginPinCapture(door, true);
+}
+
+/*
+ *  void OnDoorEdge (const DoorEdge *edge);
+ *
+ *  Description:
+ *  - Handles a debounced open/close edge from the door sensor, timing the
+ *  door from the edge rather than from when the loop got to it
+ *
+ *  Inputs/Outputs:
+ *  [INPUT] const DoorEdge *edge: the edge
+ */
+void OnDoorEdge(const DoorEdge *edge)
+{
+	Door *door = &doors[edge->door];
+
+	if (edge->open == door->open)
+		return;
+	if (edge->open)
+	{
+		Serial.print("=== PORTA ABERTA! === ");
+		Serial.println(doorConfigs[edge->door].roomID);
+		door->open = true;
+		door->openedAt = edge->time;
+		LogEvent(JOURNAL_API, DOOR_OPENED, edge->door, 0, NULL, 0);
 	}
-	Serial.print("\nUID Tag: ");
-	Serial.println(tag);
-	// Found an UID. Turns one side to WAITING_MODE and the other to BLOCKED_MODE
-	if (entering_or_leaving == 0)
-		readers_locked[1] = true;
 	else
-		readers_locked[0] = true;
-	WriteReaderLED(WAITING_COLOR);
-	// Generates POST data
-	Serial.println("-- Generating POST data...");
-	postData = GenerateUnlockPostData(tag, WHO_AM_I, entering_or_leaving);
-	Serial.println(postData);
-	// Sends request to REQUEST_UNLOCK and gets response
-	status = SendPostRequest(postData, REQUEST_UNLOCK);
-	Serial.print("-- Status: ");
-	Serial.println(status);
-	// If already authorized, unlocks door
-	if (status == AUTHORIZED)
-	{
-		WriteReaderLED(OK_COLOR);
-		UnlockDoor();
-	}
-	// If needs password, blinks OK_COLOR and asks for typing
-	else if (status == PASSWORD_REQUIRED)
-	{
-		// Copies read tag to employee tag
-		employeeTag = tag;
-		// Blinks DO_SOMETHING_COLOR
-		BlinkRGB(1, 50, BLACK, DO_SOMETHING_COLOR, readerPosition);
-		Serial.println("-- Waiting for password...");
-		// Gets password
-		pw = GetPassword();
-		Serial.print("-- Password: ");
-		Serial.println(pw);
-		if (pw == "")
+	{
+		Serial.print("- Porta fechada... ");
+		Serial.println(doorConfigs[edge->door].roomID);
+		TelemetryRecord(TELEMETRY_DOOR_OPEN, (edge->time - door->openedAt) / 1000);
+		door->open = false;
+		door->alarm = false;
+		Buzz(AnyDoorAlarm());
+		if (door->unlocked)
 		{
-			ErrorExit();
-			return;
+			FastPinWrite(&doorRelays[edge->door], HIGH);
+			door->unlocked = false;
 		}
-		// Blinks WAITING_COLOR once password is read
-		BlinkRGB(2, 250, BLACK, WAITING_COLOR, readerPosition);
-		// Hashes password
-		Serial.println("-- Hashing password...");
-		hashed = HashedPassword(pw);
-		Serial.print("-- Hashed password (SHA-256): ");
-		Serial.println(hashed);
-		// Generates POST data for AUTHENTICATE API
-		Serial.println("-- Generating POST data...");
-		postData = GenerateAuthenticatePostData(tag, hashed, WHO_AM_I);
-		Serial.println(postData);
-		// Sends POST data to AUTHENTICATE API
-		status = SendPostRequest(postData, AUTHENTICATE);
-		Serial.print("-- Status: ");
-		Serial.println(status);
-		// If authorized
-		if (status == AUTHORIZED)
+		if (doorTaps[edge->door].state == STATE_DOOR_OPEN)
+			EnterRestState(edge->door);
+	}
+}
+
+/*
+ *  void DoorTick (void);
+ *
+ *  Description:
+ *  - Handles the door sensor edges, locks each door again after
+ *  DOOR_UNLOCK_TIME and sounds the buzzer, logging OPEN_DOOR_TIMEOUT, when a
+ *  door is left open for TIMEOUT_DOOR. Each door moves its own state machine
+ */
+void DoorTick(void)
+{
+	DoorEdge edge;
+	unsigned long now;
+
+	DoorSensorTick();
+	while (DoorSensorNextEdge(&edge))
+		OnDoorEdge(&edge);
+
+	now = millis();
+	for (byte d = 0; d < NUM_DOORS; d++)
+	{
+		Door *door = &doors[d];
+		byte state = doorTaps[d].state;
+
+		if (door->unlocked && now - door->unlockedAt >= DOOR_UNLOCK_TIME)
 		{
-			Serial.print("Numero do contador: ");
-			Serial.println(visitor_counter);
-			Serial.print("Array: ");
-			for (byte j = 0; j < visitor_counter; j++)
-			{
-				Serial.println(j);
-				Serial.println(tagsArray[j]);
-			}
-			// Checks if there's any visitor on tagsArray
-			if (visitor_counter == 0)
-			{
-				WriteReaderLED(OK_COLOR);
-				UnlockDoor();
-			}
-			// If there are visitor tags
-			else
-			{
-				//	Generating POST data for visitors
-				Serial.println("-- Generating Visitor POST data...");
-				postData = GenerateVisitorPostData(employeeTag, tagsArray, WHO_AM_I);
-				Serial.println(postData);
-				//	Sending POST to visitors API
-				status = SendPostRequest(postData, AUTHORIZE_VISITOR);
-				Serial.print("-- Status: ");
-				Serial.println(status);
-				if (status == VISITOR_AUTHORIZED)
-				{
-					WriteReaderLED(OK_COLOR);
-					UnlockDoor();
-				}
-				else
-				{
-					ErrorExit();
-				}
-			}
+			FastPinWrite(&doorRelays[d], HIGH);
+			door->unlocked = false;
+			if (state == STATE_UNLOCKING)
+				EnterRestState(d);
 		}
-		else
+
+		if (door->open && (state == STATE_IDLE || state == STATE_UNLOCKING || state == STATE_VISITOR_COLLECTION))
+			EnterState(d, STATE_DOOR_OPEN);
+
+		if (door->open && !door->alarm && now - door->openedAt >= TIMEOUT_DOOR)
 		{
-			ErrorExit();
+			Serial.print("=== PORTA ABERTA HA MUITO TEMPO! === ");
+			Serial.println(doorConfigs[d].roomID);
+			door->alarm = true;
+			Buzz(true);
+			LogEvent(JOURNAL_API, OPEN_DOOR_TIMEOUT, d, 0, NULL, 0);
 		}
 	}
-	else if (status == VISITOR_RFID_FOUND)
+}
+
+#ifdef HEAP_SOAK_TEST
+/*
+ *  void RunHeapSoakTest (void);
+ *
+ *  Description:
+ *  - Runs HEAP_SOAK_TAPS simulated taps through the UID, password, payload and
+ *  response handling, printing the heap usage every HEAP_SOAK_REPORT taps. The
+ *  heap must be the same size at the end as it was at the start
+ */
+void RunHeapSoakTest(void)
+{
+	MFRC522::Uid uid;
+	char tag[UID_HEX_SIZE];
+	char hashed[HASH_HEX_SIZE];
+	StatusResponse response;
+	CountingPrint counter;
+	MemoryStats before, after;
+
+	Serial.println("-- Running heap soak test...");
+	MemoryStatsRead(&before);
+	uid.size = 4;
+	for (unsigned long i = 1; i <= HEAP_SOAK_TAPS; i++)
 	{
-		if (visitor_counter < MAX_VISITOR_NUM)
+		memcpy(uid.uidByte, &i, uid.size);
+		UID_toStr(uid.uidByte, uid.size, tag);
+		WriteUnlockPostData(counter, tag, WHO_AM_I, i % 2);
+		HashedPassword("1234", hashed);
+		WriteAuthenticatePostData(counter, tag, hashed, WHO_AM_I, i, MAX_VISITOR_NUM);
+		doorTaps[0].visitorUids[i % MAX_VISITOR_NUM] = uid;
+		WriteVisitorPostData(counter, tag, doorTaps[0].visitorUids, MAX_VISITOR_NUM, WHO_AM_I, i);
+		StatusParserParse("{\"status\":0,\"token\":1}", &response);
+		if (i % HEAP_SOAK_REPORT == 0)
 		{
-			visitorInitTime = millis();
-			Serial.println("Registering visitor...");
-			tagsArray[visitor_counter] = tag;
-			Serial.println(tagsArray[visitor_counter]);
-			visitor_counter++;
+			Serial.print("- Taps: ");
+			Serial.println(i);
+			PrintMemoryStats();
 		}
 	}
-	else
+	MemoryStatsRead(&after);
+	Serial.println(after.heapSize == before.heapSize && after.freeListSize == before.freeListSize ? "-- Heap stayed flat" : "-- Heap changed during soak test!");
+	memset(doorTaps[0].visitorUids, 0, sizeof(doorTaps[0].visitorUids));
+}
+#endif
+
+/*
+ *  Setup
+ */
+void setup()
+{
+
+	// Resolves the pins of the door and reader tables before they're first written
+	for (byte i = 0; i < NUM_READERS; i++)
+	{
+		FastPinInit(&readerSS[i], readerConfigs[i].ssPin);
+		FastRgbInit(&readerLEDs[i], readerConfigs[i].ledPins);
+	}
+	for (byte d = 0; d < NUM_DOORS; d++)
+	{
+		FastPinInit(&doorRelays[d], doorConfigs[d].relayPin);
+		FastPinInit(&doorSensors[d], doorConfigs[d].sensorPin);
+	}
+
+	// Turn LEDs into FUCHSIA to print that the setup has been going on
+	for (byte d = 0; d < NUM_DOORS; d++)
+		WriteDoorLED(d, FUCHSIA);
+
+	// Starts serial communication for debugging purposes
+
+	Serial.begin(SERIAL_SPEED);
+
+	MemoryStatsPaint();
+	TelemetryReset();
+	Serial.println("=== Beginning Setup...");
+	Serial.println("-- Loading authorization cache...");
+	AuthCacheBegin();
+	Serial.println("-- Loading event journal...");
+	JournalBegin();
+	Serial.print("- Events waiting for upload: ");
+	Serial.println(JournalPending());
+#ifdef HEAP_SOAK_TEST
+	RunHeapSoakTest();
+#endif
+	Serial.println("-- Setting SPI SS pins...");
+
+	for (byte i = 0; i < NUM_READERS; i++)
+		pinMode(readerConfigs[i].ssPin, OUTPUT);
+
+	Serial.println("-- Setting LEDs pins as output...");
+
+	for (byte i = 0; i < NUM_READERS; i++)
+	{
+		for (byte j = 0; j < 3; j++)
+			pinMode(readerConfigs[i].ledPins[j], OUTPUT);
+	}
+	for (byte d = 0; d < NUM_DOORS; d++)
+	{
+		pinMode(doorConfigs[d].relayPin, OUTPUT);
+		digitalWrite(doorConfigs[d].relayPin, HIGH);
+	}
+
+	Serial.println("-- Initializing RFID modules...");
+
+	SPI.begin();
+	polledReaders = 0;
+	for (byte i = 0; i < NUM_READERS; i++)
+	{
+		SelectReader(i);
+		readers[i].PCD_Init(readerConfigs[i].ssPin, RST_PIN);
+		// Only REQA and anticollision are sent, which cards answer in about a millisecond
+		readers[i].PCD_WriteRegister(MFRC522::TReloadRegH, READER_TIMER_RELOAD >> 8);
+		readers[i].PCD_WriteRegister(MFRC522::TReloadRegL, READER_TIMER_RELOAD & 0xFF);
+		Serial.print("-- Reader ");
+		Serial.print(i + 1);
+		Serial.print(readerConfigs[i].position == READER_INSIDE ? " (inside " : " (outside ");
+		Serial.print(doorConfigs[readerConfigs[i].door].roomID);
+
+		Serial.print(") initialized!\n- Version: ");
+		readers[i].PCD_DumpVersionToSerial();
+		byte irqPin = readerConfigs[i].irqPin;
+		if (irqPin == NO_IRQ_PIN)
+		{
+			Serial.println("- Polled");
+			polledReaders++;
+			continue;
+		}
+		Serial.print("- IRQ on pin ");
+		Serial.println(irqPin);
+		pinMode(irqPin, INPUT_PULLUP); // The IRQ output is open drain
+		readers[i].PCD_WriteRegister(MFRC522::ComIEnReg, 0xA0); // IRQ active low, only for received frames
+		attachInterrupt(digitalPinToInterrupt(irqPin), readerISRs[i], FALLING);
+		ArmReader(i);
+	}
+
+	// Initializes the sensors
+	Serial.println("-- Setting sensor pins as input...");
+	for (byte d = 0; d < NUM_DOORS; d++)
+		pinMode(doorConfigs[d].sensorPin, INPUT);
+	DoorSensorBegin(doorSensors, NUM_DOORS);
+	// Initializes the buzzer
+	Serial.println("-- Setting buzzer pin as output...");
+	pinMode(PIN_BUZZER, OUTPUT);
+
+	Serial.println("-- Initializing Ethernet module...");
+	NetworkBegin();
+
+	telemetry.bootTime = millis();
+	Serial.print("=== Ready in ");
+	Serial.print(telemetry.bootTime);
+	Serial.println(" ms");
+	for (byte d = 0; d < NUM_DOORS; d++)
+		WriteDoorLED(d, STANDBY_COLOR);
+}
+
+/*
+ *  Loop
+ *
+ *  Every pass only checks what is due and returns, so the readers, the keypad,
+ *  the door sensor and the network are all serviced while a request is in flight
+ */
+void loop()
+{
+	byte reader = NO_READER;
+
+	DoorTick();
+	NetworkTick();
+	AuthCacheTick();
+	UpdateFeedback();
+	SerialTick();
+
+	if (pinDoor != NO_DOOR)
+		PinTick();
+
+	for (byte d = 0; d < NUM_DOORS; d++)
 	{
-		ErrorExit();
+		if (doorTaps[d].visitorCount > 0 && DoorAcceptingTaps(d))
+			CheckVisitorTimeout(d);
 	}
-}
\ No newline at end of file
+
+	if (!ReadersDue())
+		return;
+	unsigned long pollStart = micros();
+	LatencyStart(LATENCY_DETECT);
+	bool tapped = ReadRFIDTags(&reader);
+	TelemetryRecord(TELEMETRY_POLL, micros() - pollStart);
+	if (tapped)
+	{
+		LatencyStop(LATENCY_DETECT);
+		OnTag(reader);
+	}
+}
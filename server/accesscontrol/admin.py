@@ -1,8 +1,12 @@
+import datetime
 from django import forms
 from django.contrib import admin
 from django.contrib.auth.models import User as DjangoAdminUser, Group
 from django.contrib.auth.admin import UserAdmin as BaseUserAdmin
+from django.contrib.admin.views.main import ChangeList, PAGE_VAR
+from django.db.models import Max, Min
 from django.utils import timezone
+from django.utils.html import format_html_join
 from django.utils.translation import ugettext_lazy as _
 from accesscontrol.models import *
 
@@ -108,10 +112,76 @@ class UserAdmin(BaseUserAdmin):
 	ordering = ()
 	filter_horizontal = ()
 
+EPOCH = datetime.datetime(1970, 1, 1, tzinfo=timezone.utc)
+
+class EventChangeList(ChangeList):
+	# Pages through the events by (date, id), newest first, instead of by offset, so an old page
+	# costs as much as the first one: it's a range of the date indexes, written without an OR so
+	# they are read in order. The page parameter holds where the page starts: 'o' and the
+	# date and id of the event the older page follows, or 'n' and those of the event the newer page
+	# comes before. Counts are estimates, see approximate_count
+	def get_results(self, request):
+		cursor = request.GET.get(PAGE_VAR, '')
+		page_size = self.list_per_page
+		queryset = self.queryset
+		try:
+			direction = cursor[0]
+			microseconds, id = (int(part) for part in cursor[1:].split('_'))
+			date = EPOCH + datetime.timedelta(microseconds=microseconds)
+		except (IndexError, ValueError, OverflowError):
+			direction = None
+
+		if direction == 'n':
+			rows = list(queryset.filter(date__gte=date).exclude(date=date, id__lte=id).order_by('date', 'id')[:page_size + 1])
+			has_newer = len(rows) > page_size
+			rows = rows[:page_size][::-1]
+			has_older = True
+		else:
+			if direction == 'o':
+				queryset = queryset.filter(date__lte=date).exclude(date=date, id__gte=id)
+			rows = list(queryset[:page_size + 1])
+			has_older = len(rows) > page_size
+			rows = rows[:page_size]
+			has_newer = direction == 'o'
+
+		self.result_count, self.result_count_capped = self.approximate_count()
+		self.show_full_result_count = False
+		self.show_admin_actions = True
+		self.full_result_count = None
+		self.result_list = rows
+		self.can_show_all = False
+		self.multi_page = has_newer or has_older
+		self.paginator = self.model_admin.get_paginator(request, self.queryset, page_size)
+		self.newer_url = self.page_url('n', rows[0]) if has_newer and rows else None
+		self.older_url = self.page_url('o', rows[-1]) if has_older and rows else None
+
+	def page_url(self, direction, event):
+		microseconds = (event.date - EPOCH) // datetime.timedelta(microseconds=1)
+		return self.get_query_string({PAGE_VAR: '%s%d_%d' % (direction, microseconds, event.id)})
+
+	def approximate_count(self):
+		# Without filters, the span of ids: archived events are the oldest ones, so few are missing
+		# in between. With them, a count of up to EVENT_ADMIN_COUNT_LIMIT events. Returns the count
+		# and whether it stopped at the limit
+		if not self.has_active_filters and not self.query:
+			ids = self.root_queryset.aggregate(first=Min('id'), last=Max('id'))
+			return (ids['last'] - ids['first'] + 1 if ids['last'] else 0), False
+		count = self.queryset.values('id')[:EVENT_ADMIN_COUNT_LIMIT].count()
+		return count, count == EVENT_ADMIN_COUNT_LIMIT
+
 class EventAdmin(admin.ModelAdmin):
 	model = Event
 	list_display = ('date','user', 'room', 'event_type', 'reader_position')
 	list_filter = ['date','user', 'room', 'event_type', 'reader_position']
+	# The user and room can be null, so the admin wouldn't join them by itself
+	list_select_related = ('user', 'room')
+	# Keyset pagination needs this order, so the columns can't be sorted
+	ordering = ('-date', '-id')
+	sortable_by = ()
+	show_full_result_count = False
+
+	def get_changelist(self, request, **kwargs):
+		return EventChangeList
 
 	def get_readonly_fields(self, request, obj=None):
 		return list(self.readonly_fields) + \
@@ -125,7 +195,81 @@ class EventAdmin(admin.ModelAdmin):
 		# Nobody is allowed to delete
 		return False
 
+class TelemetryAdmin(admin.ModelAdmin):
+	model = Telemetry
+	list_display = ('date', 'room', 'uptime', 'boot_time', 'network_time', 'sram_low_water', 'taps', 'failed_requests', 'unlock_p95', 'dropped_reports')
+	list_filter = ['date', 'room']
+	ordering = ('-date', )
+	readonly_fields = ('summary', )
+	exclude = ('status_counts', 'histograms')
+
+	def get_readonly_fields(self, request, obj=None):
+		return list(self.readonly_fields) + [field.name for field in obj._meta.fields]
+
+	def failed_requests(self, obj):
+		return obj.get_status_counts()[-1]
+	failed_requests.short_description = _('failed requests')
+
+	def unlock_p95(self, obj):
+		return self.format_percentile(obj, 1, 95)
+	unlock_p95.short_description = _('request-unlock p95')
+
+	def format_percentile(self, obj, index, percent):
+		name, unit, unit_size = TELEMETRY_HISTOGRAMS[index]
+		value = obj.percentile(index, percent)
+		if value is None:
+			return '-' if sum(obj.get_histograms()[index]) == 0 else '> %d %s' % ((1 << (TELEMETRY_BUCKETS - 1)) * unit_size - 1, unit)
+		return '<= %d %s' % (value, unit)
+
+	def summary(self, obj):
+		lines = ['%s: %s' % (_('responses by status code'), obj.get_status_counts())]
+		for index, (name, unit, unit_size) in enumerate(TELEMETRY_HISTOGRAMS):
+			lines.append('%s: %d samples, p50 %s, p95 %s, p99 %s' % (name, sum(obj.get_histograms()[index]),
+				self.format_percentile(obj, index, 50), self.format_percentile(obj, index, 95), self.format_percentile(obj, index, 99)))
+		return format_html_join('\n', '<div>{}</div>', ((line, ) for line in lines))
+	summary.short_description = _('summary')
+
+	def has_add_permission(self, request):
+		# Reports only come from the clients
+		return False
+
+class EventArchiveAdmin(admin.ModelAdmin):
+	model = EventArchive
+	list_display = ('month', 'file_name', 'events', 'size', 'first_date', 'last_date', 'date')
+	ordering = ('-month', )
+
+	def get_readonly_fields(self, request, obj=None):
+		return list(self.readonly_fields) + [field.name for field in obj._meta.fields]
+
+	def has_add_permission(self, request):
+		# Written by the archive_events command
+		return False
+	def has_delete_permission(self, request, obj=None):
+		return False
+
+class OccupancyAdmin(admin.ModelAdmin):
+	model = Occupancy
+	list_display = ('room', 'user', 'since')
+	list_filter = ['room']
+	ordering = ('room', 'since')
+
+	def get_queryset(self, request):
+		# Only the people in the rooms, the rows of those who left are kept for late events
+		return super().get_queryset(request).filter(present=True).select_related('room', 'user')
+
+	def get_readonly_fields(self, request, obj=None):
+		return list(self.readonly_fields) + [field.name for field in obj._meta.fields]
+
+	def has_add_permission(self, request):
+		# Kept up to date from the events, or rebuilt with the rebuild_occupancy command
+		return False
+	def has_delete_permission(self, request, obj=None):
+		return False
+
 admin.site.register(User, UserAdmin)        
 admin.site.register(Room)
 admin.site.register(RfidTag)
-admin.site.register(Event, EventAdmin)
\ No newline at end of file
+admin.site.register(Event, EventAdmin)
+admin.site.register(EventArchive, EventArchiveAdmin)
+admin.site.register(Telemetry, TelemetryAdmin)
+admin.site.register(Occupancy, OccupancyAdmin)
\ No newline at end of file
@@ -2,3 +2,7 @@ from django.apps import AppConfig
 
 class ApiConfig(AppConfig):
     name = 'accesscontrol'
+
+    def ready(self):
+        # Connects the receivers that keep the authorization index coherent
+        from accesscontrol import services
@@ -14,12 +14,96 @@ ROOM_NOT_FOUND = 8
 OPEN_DOOR_TIMEOUT = 9
 FRONT_DOOR_OPENED = 10
 UNREGISTERED_SIP = 11
+DOOR_OPENED = 12
+SERVER_UNREACHABLE = 13
 
 # Used to store in the database which API triggered the log; for debugging purposes.
 UNLOCK_API = 0
 AUTH_API = 1
 VISITOR_API = 2
 FRONT_DOOR_API = 3
+JOURNAL_API = 4
 
 # Rooms with this level or greater will also need password authentication
-REQUIRE_PASSWORD_LEVEL_THRESHOLD = 3
\ No newline at end of file
+REQUIRE_PASSWORD_LEVEL_THRESHOLD = 3
+
+# Modes sent by the authorization sync API
+SYNC_UNCHANGED = 0
+SYNC_SNAPSHOT = 1
+SYNC_DELTA = 2
+
+# Number of table changes sent per authorization sync page (kept small for the Arduino's RAM)
+AUTH_SYNC_PAGE_SIZE = 8
+# Number of table versions kept in memory to compute deltas against
+AUTH_SYNC_HISTORY_SIZE = 16
+
+# PIN verifiers sent with the authorization table to rooms that ask for a password: the
+# HMAC-SHA256 of the password hash, keyed with a salt derived for the room and truncated.
+# Must match client's src/AuthCache.h
+PIN_SALT_SIZE = 16
+PIN_VERIFIER_SIZE = 7
+
+# Decision sessions: request-unlock answers PASSWORD_REQUIRED with a token the password and
+# visitors requests of the same tap send back, so the server doesn't look the tag owner and the
+# room up again. Tokens are below 2^31 so clients can keep them in a signed long
+DECISION_SESSION_TIMEOUT = 60 # Seconds
+DECISION_SESSION_MAX = 256
+
+# In-memory index of the tag owners and rooms the tap APIs decide from. It's dropped whenever
+# a tag, link, user or room is saved in this process, and rebuilt at least this often so
+# changes made by other server processes are seen too
+AUTH_INDEX_MAX_AGE = 30 # Seconds
+
+# Events are logged by a background writer. It writes up to EVENT_BATCH_MAX queued events per
+# transaction, and checks for expired decision sessions every EVENT_FLUSH_INTERVAL. Requests
+# wait for it only when EVENT_QUEUE_MAX events are queued. A batch that fails is tried
+# EVENT_WRITE_ATTEMPTS times, waiting EVENT_RETRY_DELAY and then twice as long each time
+EVENT_BATCH_MAX = 100
+EVENT_FLUSH_INTERVAL = 1 # Seconds
+EVENT_QUEUE_MAX = 10000
+EVENT_WRITE_ATTEMPTS = 5
+EVENT_RETRY_DELAY = 1 # Seconds
+
+# Events that move people in or out of a room (/api/occupancy). The user, and the visitors of a
+# VISITOR_AUTHORIZED event, enter on the outside reader and leave on the inside one
+OCCUPANCY_EVENT_TYPES = (AUTHORIZED, VISITOR_AUTHORIZED)
+
+# The Event table only keeps recent events: archive_events moves those older than the last
+# EVENT_RETENTION_MONTHS whole months to settings.EVENT_ARCHIVE_DIR, and deletes up to
+# EVENT_ARCHIVE_CHUNK of them per query. The admin counts at most EVENT_ADMIN_COUNT_LIMIT
+# events matching its filters
+EVENT_RETENTION_MONTHS = 12
+EVENT_ARCHIVE_CHUNK = 500
+EVENT_ADMIN_COUNT_LIMIT = 10000
+
+# Maximum number of events accepted per /api/events/bulk request
+EVENTS_BULK_MAX_SIZE = 32
+
+# Client telemetry (/api/telemetry). Histograms are sent in this order, as (name, unit, unit size).
+# Bucket i counts values from 2^(i-1) to 2^i - 1 units, bucket 0 counts zeros and the last one
+# everything above. Status counts are indexed by status code, the last one counts failed requests.
+# Must match client's src/Telemetry.h
+TELEMETRY_HISTOGRAMS = (
+    ('reader poll', 'us', 16),
+    ('request-unlock round-trip', 'ms', 1),
+    ('authenticate round-trip', 'ms', 1),
+    ('authorize-visitor round-trip', 'ms', 1),
+    ('response parse', 'us', 16),
+    ('door open', 's', 1),
+)
+TELEMETRY_BUCKETS = 12
+TELEMETRY_STATUS_CODES = 16
+
+# Compact binary protocol (/api/bin/*). Requests start with a fixed header:
+# version, api module (UNLOCK_API, AUTH_API or VISITOR_API), reader position, UID size
+# and the room ID padded with zeros, followed by the raw UID bytes. AUTH_API appends the
+# raw SHA-256 of the password, VISITOR_API appends the number of visitors and then each
+# visitor UID prefixed by its size; both may end with a decision session token (0 for none).
+# AUTH_API may follow it with the number of visitors the client will send next.
+# Responses are the version followed by the signed status and, while a decision session is
+# open, its token.
+BINARY_PROTOCOL_VERSION = 1
+BINARY_HEADER_FORMAT = '<BBBB15s'
+BINARY_RESPONSE_FORMAT = '<Bb'
+BINARY_TOKEN_FORMAT = '<I'
+BINARY_PASSWORD_SIZE = 32
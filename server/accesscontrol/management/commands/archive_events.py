@@ -0,0 +1,85 @@
+import datetime
+import gzip
+import itertools
+import os
+from django.conf import settings
+from django.core.management.base import BaseCommand
+from django.db import transaction
+from django.utils import timezone
+from accesscontrol.consts import *
+from accesscontrol.models import *
+from accesscontrol.services import EVENT_ARCHIVE_FIELDS, event_archive_entry
+
+def month_start(month):
+    # Midnight of the first day of a month counted from year 0, in local time
+    return timezone.make_aware(datetime.datetime(month // 12, month % 12 + 1, 1))
+
+class Command(BaseCommand):
+    help = ('Moves the events older than the last whole months kept to a gzipped file per month '
+            'in EVENT_ARCHIVE_DIR, so the Event table the APIs write to stays small')
+
+    def add_arguments(self, parser):
+        parser.add_argument('--months', type=int, default=EVENT_RETENTION_MONTHS,
+                            help='Whole months of events kept in the table, besides the current one')
+        parser.add_argument('--dry-run', action='store_true',
+                            help='Only list the months that would be archived')
+
+    def handle(self, *args, **options):
+        now = timezone.localtime()
+        cutoff = now.year * 12 + now.month - 1 - options['months']
+        months = sorted({date.year * 12 + date.month - 1 for date in
+                         Event.objects.filter(date__lt=month_start(cutoff)).datetimes('date', 'month')})
+        if not months:
+            self.stdout.write('Nothing to archive before %s' % month_start(cutoff).date())
+            return
+        if not options['dry_run']:
+            os.makedirs(settings.EVENT_ARCHIVE_DIR, exist_ok=True)
+        for month in months:
+            events = Event.objects.filter(date__gte=month_start(month), date__lt=month_start(month + 1))
+            if options['dry_run']:
+                self.stdout.write('%s: %d events' % (month_start(month).strftime('%Y-%m'), events.count()))
+            else:
+                self.archive(month, events)
+
+    def file_name(self, month):
+        # events-YYYY-MM.jsonl.gz, or with a number after it if that month was archived before
+        base = month_start(month).strftime('events-%Y-%m')
+        for part in itertools.count(1):
+            name = '%s%s.jsonl.gz' % (base, '-%d' % part if part > 1 else '')
+            if not EventArchive.objects.filter(file_name=name).exists() and \
+               not os.path.exists(os.path.join(settings.EVENT_ARCHIVE_DIR, name)):
+                return name
+
+    def archive(self, month, events):
+        name = self.file_name(month)
+        path = os.path.join(settings.EVENT_ARCHIVE_DIR, name)
+        ids = []
+        first_date = last_date = None
+
+        # The events come once per visitor, in a single pass ordered by date
+        rows = events.order_by('date', 'id').values('date', 'visitors', *EVENT_ARCHIVE_FIELDS)
+        with gzip.open(path + '.tmp', 'wt') as archive:
+            for id, group in itertools.groupby(rows.iterator(), key=lambda row: row['id']):
+                group = list(group)
+                visitors = [row['visitors'] for row in group if row['visitors'] is not None]
+                archive.write(event_archive_entry(group[0], visitors))
+                ids.append(id)
+                first_date = first_date or group[0]['date']
+                last_date = group[0]['date']
+        if not ids:
+            os.remove(path + '.tmp')
+            return
+        os.replace(path + '.tmp', path)
+
+        # Only the events written to the file are deleted, not those logged since
+        try:
+            with transaction.atomic():
+                EventArchive.objects.create(month=month_start(month).date(), file_name=name, events=len(ids),
+                                            size=os.path.getsize(path), first_date=first_date, last_date=last_date)
+                for start in range(0, len(ids), EVENT_ARCHIVE_CHUNK):
+                    Event.objects.filter(pk__in=ids[start:start + EVENT_ARCHIVE_CHUNK]).delete()
+        except:
+            os.remove(path)
+            raise
+        self.stdout.write('%s: %d events moved to %s (%d bytes)' % (
+            month_start(month).strftime('%Y-%m'), len(ids), name, os.path.getsize(path)))
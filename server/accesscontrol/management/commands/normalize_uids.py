@@ -0,0 +1,30 @@
+from django.core.management.base import BaseCommand
+from django.db import transaction
+from django.db.models import Count
+from accesscontrol.models import *
+
+class Command(BaseCommand):
+    help = ('Rewrites RFID tag UIDs in the normalized form the server looks them up by, and lists '
+            'duplicated room IDs. Run it before migrating to unique room IDs')
+
+    def handle(self, *args, **options):
+        taken = set(RfidTag.objects.values_list('uid', flat=True))
+        normalized = 0
+        conflicts = 0
+        with transaction.atomic():
+            for tag in RfidTag.objects.all():
+                uid = normalize_uid(tag.uid)
+                if uid == tag.uid:
+                    continue
+                if uid in taken:
+                    self.stderr.write('Tag %s (id %d) is also registered as %s, merge their links by hand' % (tag.uid, tag.pk, uid))
+                    conflicts += 1
+                    continue
+                taken.discard(tag.uid)
+                taken.add(uid)
+                tag.save(update_fields=['uid'])
+                normalized += 1
+        self.stdout.write('%d tags normalized, %d left as they are' % (normalized, conflicts))
+
+        for duplicate in Room.objects.values('name').annotate(count=Count('id')).filter(count__gt=1):
+            self.stderr.write('Room ID %s is used by %d rooms, rename all but one' % (duplicate['name'], duplicate['count']))
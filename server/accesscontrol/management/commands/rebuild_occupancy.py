@@ -0,0 +1,63 @@
+from django.core.management.base import BaseCommand
+from django.db import transaction
+from django.utils import timezone
+from accesscontrol.consts import *
+from accesscontrol.models import *
+from accesscontrol.services import occupancy_change, read_event_archives
+
+class Command(BaseCommand):
+    help = ('Rebuilds the room occupancy from the event history, in a single pass over the '
+            'archived events and then the Event table. Rows written by newer events while it runs '
+            'are kept')
+
+    def add_arguments(self, parser):
+        parser.add_argument('--chunk-size', type=int, default=2000,
+                            help='Events read from the database at a time')
+
+    def handle(self, *args, **options):
+        started = timezone.now()
+
+        # One row per event, or per visitor of the events with visitors
+        history = Event.objects.filter(
+            event_type__in=OCCUPANCY_EVENT_TYPES, room__isnull=False, user__isnull=False
+        ).values_list('room_id', 'user_id', 'reader_position', 'date', 'visitors')
+        changes = {}
+        count = 0
+        for entry in read_event_archives():
+            if entry['event_type'] in OCCUPANCY_EVENT_TYPES and entry['room_id'] and entry['user_id']:
+                for user_id in [entry['user_id']] + entry['visitors']:
+                    occupancy_change(changes, entry['room_id'], user_id, entry['reader_position'], entry['date'])
+                count += 1
+        for room_id, user_id, reader_position, date, visitor_id in history.iterator(chunk_size=options['chunk_size']):
+            occupancy_change(changes, room_id, user_id, reader_position, date)
+            if visitor_id is not None:
+                occupancy_change(changes, room_id, visitor_id, reader_position, date)
+            count += 1
+
+        # Archived events may name rooms and users deleted since
+        rooms = set(Room.objects.values_list('id', flat=True))
+        users = set(User.objects.values_list('id', flat=True))
+        changes = {key: change for key, change in changes.items() if key[0] in rooms and key[1] in users}
+
+        with transaction.atomic():
+            rows = {(row.room_id, row.user_id): row for row in Occupancy.objects.select_for_update()}
+            created = []
+            updated = []
+            for (room_id, user_id), (present, date) in changes.items():
+                row = rows.pop((room_id, user_id), None)
+                if row is None:
+                    created.append(Occupancy(room_id=room_id, user_id=user_id, present=present, since=date))
+                elif row.present != present or row.since != date:
+                    if row.since > started:
+                        continue
+                    row.present = present
+                    row.since = date
+                    updated.append(row)
+            Occupancy.objects.bulk_create(created, batch_size=options['chunk_size'])
+            Occupancy.objects.bulk_update(updated, ['present', 'since'], batch_size=options['chunk_size'])
+            # Rows the history doesn't back, unless an event logged meanwhile wrote them
+            removed = [row.pk for row in rows.values() if row.since <= started]
+            Occupancy.objects.filter(pk__in=removed).delete()
+
+        self.stdout.write('%d events read, %d rows created, %d updated, %d removed, %d people inside' % (
+            count, len(created), len(updated), len(removed), sum(present for present, date in changes.values())))
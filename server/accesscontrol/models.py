@@ -1,3 +1,4 @@
+import json
 from django.utils import timezone
 from django.db import models
 from django.contrib.auth.models import AbstractBaseUser, BaseUserManager
@@ -14,7 +15,12 @@ ACCESS_LEVEL_CHOICES = (
   (5, _('level 5').title()),
 )
 
+def normalize_uid(uid):
+  # Lowercase hex, as the clients send UIDs
+  return str(uid).strip().lower()
+
 class RfidTag(models.Model):
+  # Stored normalized, so lookups match it exactly against the unique index
   uid = models.CharField(
     verbose_name=_('RFID tag UID'), 
     max_length=256, 
@@ -30,6 +36,14 @@ class RfidTag(models.Model):
   def __str__(self):
     return self.uid
 
+  def clean(self):
+    # Before the uniqueness check, so a UID differing only in case is reported as taken
+    self.uid = normalize_uid(self.uid)
+
+  def save(self, *args, **kwargs):
+    self.uid = normalize_uid(self.uid)
+    super().save(*args, **kwargs)
+
 class UserManager(BaseUserManager):
   def create_user(self, email, date_added=None, password=None):
     if not email:
@@ -136,6 +150,7 @@ class RfidTagUserLink(models.Model):
 class Room(models.Model):
   name = models.CharField(
     max_length=15, 
+    unique=True,
     verbose_name=_('room ID')
     )
   description = models.TextField(
@@ -168,6 +183,8 @@ class Event(models.Model):
     (ROOM_NOT_FOUND, _('room not found').capitalize()),
     (FRONT_DOOR_OPENED, _('front door opened').capitalize()),
     (UNREGISTERED_SIP, _('unregistered SIP').capitalize()),
+    (DOOR_OPENED, _('door opened').capitalize()),
+    (SERVER_UNREACHABLE, _('server unreachable').capitalize()),
   )
 
   READER_POSITION_CHOICES = ((0, _('outside').capitalize()),(1, _('inside').capitalize()))
@@ -177,6 +194,7 @@ class Event(models.Model):
     (UNLOCK_API, '/api/request-unlock/'),
     (VISITOR_API, '/api/authorize-visitor'),
     (FRONT_DOOR_API, '/api/request-front-door-unlock'),
+    (JOURNAL_API, '/api/events/bulk'),
   )
 
   user = models.ForeignKey(
@@ -224,7 +242,7 @@ class Event(models.Model):
     verbose_name=_('room')
     )
   date = models.DateTimeField(
-    auto_now_add=True,
+    default=timezone.now,
     verbose_name=_('date ocurred')
     )
   visitors = models.ManyToManyField(
@@ -234,10 +252,174 @@ class Event(models.Model):
     blank=True, 
     verbose_name=_('visitors')
     )
+  # Where a journal event came from: the door index on its controller and the journal's
+  # sequence number. Null for the events of the other APIs
+  door = models.IntegerField(
+    null=True,
+    blank=True,
+    verbose_name=_('door')
+    )
+  sequence = models.BigIntegerField(
+    null=True,
+    blank=True,
+    verbose_name=_('journal sequence')
+    )
 
   def __str__(self):
     return (
       self.get_event_type_display() + ' - ' + self.date.strftime('%Y-%m-%d %H:%M:%S')
     )
   class Meta:
-    verbose_name = _('event')
\ No newline at end of file
+    verbose_name = _('event')
+    # The admin lists events newest first, filtered by room, user or type
+    indexes = [
+      models.Index(fields=['-date'], name='event_date_idx'),
+      models.Index(fields=['room', '-date'], name='event_room_date_idx'),
+      models.Index(fields=['user', '-date'], name='event_user_date_idx'),
+      models.Index(fields=['event_type', '-date'], name='event_type_date_idx'),
+    ]
+    # A journal upload retried after its response was lost logs nothing twice
+    constraints = [
+      models.UniqueConstraint(fields=['room', 'door', 'sequence'], name='event_journal_unique'),
+    ]
+
+class EventArchive(models.Model):
+  # A file of events the archive_events command moved out of the Event table, all from the same
+  # month. Gzipped JSON lines, see event_archive_entry in services.py
+  month = models.DateField(
+    verbose_name=_('month')
+    )
+  file_name = models.CharField(
+    max_length=255,
+    unique=True,
+    verbose_name=_('file name')
+    )
+  events = models.IntegerField(
+    verbose_name=_('events')
+    )
+  size = models.IntegerField(
+    verbose_name=_('size (bytes)')
+    )
+  first_date = models.DateTimeField(
+    verbose_name=_('first event')
+    )
+  last_date = models.DateTimeField(
+    verbose_name=_('last event')
+    )
+  date = models.DateTimeField(
+    default=timezone.now,
+    verbose_name=_('date archived')
+    )
+
+  def __str__(self):
+    return self.file_name
+  class Meta:
+    verbose_name = _('event archive')
+
+class Occupancy(models.Model):
+  # Who is in each room, kept up to date by the event writer from the authorized taps. A row
+  # holds the last enter or exit of a user, so late journal events don't undo newer ones
+  room = models.ForeignKey(
+    Room,
+    on_delete=models.CASCADE,
+    related_name='occupancy',
+    verbose_name=_('room')
+    )
+  user = models.ForeignKey(
+    User,
+    on_delete=models.CASCADE,
+    related_name='occupancy',
+    verbose_name=_('user')
+    )
+  present = models.BooleanField(
+    default=False,
+    verbose_name=_('present')
+    )
+  since = models.DateTimeField(
+    verbose_name=_('since')
+    )
+
+  def __str__(self):
+    return '%s - %s' % (self.room, self.user)
+  class Meta:
+    verbose_name = _('occupancy')
+    verbose_name_plural = _('occupancy')
+    constraints = [
+      models.UniqueConstraint(fields=['room', 'user'], name='occupancy_room_user_unique'),
+    ]
+    indexes = [
+      models.Index(fields=['room', 'present'], name='occupancy_room_present_idx'),
+    ]
+
+class Telemetry(models.Model):
+  room = models.ForeignKey(
+    Room,
+    on_delete=models.CASCADE,
+    related_name='telemetry',
+    verbose_name=_('room')
+    )
+  date = models.DateTimeField(
+    default=timezone.now,
+    verbose_name=_('date received')
+    )
+  uptime = models.IntegerField(
+    verbose_name=_('uptime (s)')
+    )
+  period = models.IntegerField(
+    verbose_name=_('period (s)')
+    )
+  sram_low_water = models.IntegerField(
+    verbose_name=_('free SRAM low-water mark (bytes)')
+    )
+  taps = models.IntegerField(
+    verbose_name=_('taps')
+    )
+  local_unlocks = models.IntegerField(
+    verbose_name=_('local unlocks')
+    )
+  dropped_reports = models.IntegerField(
+    verbose_name=_('dropped reports')
+    )
+  boot_time = models.IntegerField(
+    verbose_name=_('boot to ready (ms)')
+    )
+  network_time = models.IntegerField(
+    verbose_name=_('boot to network up (ms)')
+    )
+  # JSON lists, see TELEMETRY_* in consts.py
+  status_counts = models.TextField(
+    verbose_name=_('responses by status code')
+    )
+  histograms = models.TextField(
+    verbose_name=_('histograms')
+    )
+
+  def get_status_counts(self):
+    return json.loads(self.status_counts)
+
+  def get_histograms(self):
+    return json.loads(self.histograms)
+
+  def percentile(self, index, percent):
+    # Upper bound of the bucket holding the percentile, in the histogram's unit. None if empty
+    # or above the last bucket's bound
+    buckets = self.get_histograms()[index]
+    rank = sum(buckets) * percent / 100.0
+    if rank == 0:
+      return None
+    seen = 0
+    for bucket, count in enumerate(buckets):
+      seen += count
+      if seen >= rank:
+        if bucket == TELEMETRY_BUCKETS - 1:
+          return None
+        return (1 << bucket) * TELEMETRY_HISTOGRAMS[index][2] - 1
+
+  def __str__(self):
+    return '%s - %s' % (self.room, self.date.strftime('%Y-%m-%d %H:%M:%S'))
+  class Meta:
+    verbose_name = _('telemetry report')
+    indexes = [
+      models.Index(fields=['-date'], name='telemetry_date_idx'),
+      models.Index(fields=['room', '-date'], name='telemetry_room_date_idx'),
+    ]
@@ -1,21 +1,603 @@
+import atexit
+import copy
 import datetime
+import gzip
+import hashlib
+import hmac
+import json
+import logging
+import os
+import queue
+import secrets
+import struct
+import threading
+import time
+import zlib
+from collections import OrderedDict
+from django.conf import settings
+from django.utils import timezone
+from django.db import DatabaseError, transaction
 from django.db.models import Q
 from django.http import HttpResponse
-from django.db.models.signals import pre_save
+from django.db.models.signals import m2m_changed, post_delete, post_save
 from django.dispatch import receiver
 from accesscontrol.models import *
 from accesscontrol.consts import *
 
+logger = logging.getLogger(__name__)
+
+def _tag_links():
+    # {uid: [(user, expire_date)]} of the links not expired yet
+    valid_links = RfidTagUserLink.objects.filter(
+        Q(expire_date__gte=datetime.date.today()) | Q(expire_date__isnull=True)
+    ).select_related('rfid_tag', 'user')
+    tags = {}
+    for link in valid_links:
+        tags.setdefault(normalize_uid(link.rfid_tag.uid), []).append((link.user, link.expire_date))
+    return tags
+
+def _rooms():
+    # {name: room}
+    return {room.name: room for room in Room.objects.all()}
+
+class AuthIndex:
+    # Process-local copy of a query the tap APIs decide from, so they don't run it on every
+    # request. Built on first use and dropped by the receivers below whenever a tag, link, user
+    # or room is saved or deleted. Other processes, and queryset update(), send no signal here,
+    # so it's also rebuilt once it's AUTH_INDEX_MAX_AGE old
+    instances = []
+
+    def __init__(self, build):
+        self.build = build
+        self.lock = threading.Lock()
+        self.data = None
+        self.built_at = 0
+        self.generation = 0
+        AuthIndex.instances.append(self)
+
+    def get(self):
+        with self.lock:
+            if self.data is not None and time.monotonic() - self.built_at < AUTH_INDEX_MAX_AGE:
+                return self.data
+            generation = self.generation
+        built_at = time.monotonic()
+        data = self.build()
+        # An index built while a change came in is used, but not kept
+        with self.lock:
+            if generation == self.generation:
+                self.data = data
+                self.built_at = built_at
+        return data
+
+    def drop(self):
+        with self.lock:
+            self.data = None
+            self.generation += 1
+
+    @classmethod
+    def drop_all(cls):
+        for index in cls.instances:
+            index.drop()
+
+_tag_index = AuthIndex(_tag_links)
+_room_index = AuthIndex(_rooms)
+
+@receiver(post_save, sender=RfidTag)
+@receiver(post_delete, sender=RfidTag)
+@receiver(post_save, sender=RfidTagUserLink)
+@receiver(post_delete, sender=RfidTagUserLink)
+@receiver(post_save, sender=User)
+@receiver(post_delete, sender=User)
+@receiver(m2m_changed, sender=User.rfid_tag.through)
+@receiver(post_save, sender=Room)
+@receiver(post_delete, sender=Room)
+def _auth_index_changed(sender, **kwargs):
+    # Dropped again on commit, in case a request rebuilt it from the data before the change
+    AuthIndex.drop_all()
+    transaction.on_commit(AuthIndex.drop_all, using=kwargs.get('using'))
+
+def _valid_owners(links):
+    # The distinct owners of the links not expired yet, as {pk: user}. A link is valid until the
+    # start of the day after its expire date is reached, as with expire_date__gte=date.today()
+    today = datetime.datetime.combine(datetime.date.today(), datetime.time())
+    if settings.USE_TZ:
+        today = timezone.make_aware(today)
+    return {user.pk: user for user, expire_date in links if expire_date is None or expire_date >= today}
+
 def get_current_tag_owner(uid):
-    not_expired_users = User.objects.filter(rfidtaguserlink__expire_date__gte=datetime.date.today())
-    never_expire_users = User.objects.filter(rfidtaguserlink__expire_date__isnull=True)
-    all_valid_users = not_expired_users | never_expire_users
-    return all_valid_users.get(rfid_tag__uid__iexact=uid)
+    # The only valid owner of a tag. Raises User.DoesNotExist, or User.MultipleObjectsReturned if
+    # the tag is linked to more than one
+    owners = _valid_owners(_tag_index.get().get(normalize_uid(uid), ()))
+    if not owners:
+        raise User.DoesNotExist('No valid owner for tag %s' % uid)
+    if len(owners) > 1:
+        raise User.MultipleObjectsReturned('More than one valid owner for tag %s' % uid)
+    return next(iter(owners.values()))
+
+def get_room(name):
+    # Same as Room.objects.get(name=name), from the index
+    room = _room_index.get().get(name)
+    if room is None:
+        raise Room.DoesNotExist('No room %s' % name)
+    return room
+
+# Recent versions of the authorization table, used to send deltas to the clients
+_auth_table_history = OrderedDict()
+_auth_table_lock = threading.Lock()
+
+def _uid_sort_key(uid):
+    # Same ordering the client uses for its binary search: byte by byte, shorter first
+    return bytes.fromhex(uid)
+
+def _expire_timestamp(expire_date):
+    # get_current_tag_owner accepts a tag until the end of its expire day
+    if expire_date is None:
+        return 0
+    expire_day = timezone.localtime(expire_date).date() + datetime.timedelta(days=1)
+    midnight = datetime.datetime.combine(expire_day, datetime.time())
+    return int(timezone.make_aware(midnight).timestamp())
+
+def _auth_table():
+    # Every UID with exactly one valid owner, as {uid: [access_level, expire_timestamp, password]}.
+    # The password hash is only kept to compute PIN verifiers, see rooms_auth_entry
+    valid_links = RfidTagUserLink.objects.filter(
+        Q(expire_date__gte=datetime.date.today()) | Q(expire_date__isnull=True)
+    ).select_related('rfid_tag', 'user')
+    table = {}
+    duplicated = set()
+    for link in valid_links:
+        uid = normalize_uid(link.rfid_tag.uid)
+        try:
+            if len(bytes.fromhex(uid)) == 0:
+                continue
+        except ValueError:
+            continue
+        if uid in table:
+            duplicated.add(uid)
+        table[uid] = [link.user.access_level, _expire_timestamp(link.expire_date), link.user.password]
+    # Ambiguous tags are left for the server to decide
+    for uid in duplicated:
+        del table[uid]
+
+    version = zlib.crc32(repr(sorted(table.items())).encode()) or 1
+    with _auth_table_lock:
+        _auth_table_history[version] = table
+        _auth_table_history.move_to_end(version)
+        while len(_auth_table_history) > AUTH_SYNC_HISTORY_SIZE:
+            _auth_table_history.popitem(last=False)
+    return version, table
+
+_auth_table_index = AuthIndex(_auth_table)
+
+def get_auth_table():
+    # The current (version, table) of _auth_table, from the index so the journal uploads of every
+    # controller coming back from an outage don't each rebuild it. Must not be modified
+    return _auth_table_index.get()
+
+def get_auth_sync_changes(base_version, target_version=0):
+    # Returns (mode, version, changes), changes being sorted [uid, access_level, expire, password]
+    # additions and [uid] removals. Raises KeyError if target_version isn't known anymore
+    if target_version:
+        with _auth_table_lock:
+            table = _auth_table_history[target_version]
+        version = target_version
+    else:
+        version, table = get_auth_table()
+    if base_version == version:
+        return SYNC_UNCHANGED, version, []
+
+    with _auth_table_lock:
+        base = _auth_table_history.get(base_version) if base_version else None
+    if base is None:
+        mode = SYNC_SNAPSHOT
+        changes = [[uid] + entry for uid, entry in table.items()]
+    else:
+        mode = SYNC_DELTA
+        changes = [[uid] + entry for uid, entry in table.items() if base.get(uid) != entry]
+        changes += [[uid] for uid in base if uid not in table]
+    changes.sort(key=lambda change: _uid_sort_key(change[0]))
+    return mode, version, changes
+
+def rooms_pin_salt(rooms):
+    # Salt of the PIN verifiers sent to a controller, derived from the secret key and the rooms of
+    # its doors, in order. It only makes verifiers differ between controllers: the controller
+    # stores it next to them, and a 4-digit PIN takes 10^4 tries, so anyone who dumps its EEPROM
+    # recovers every cached user's PIN. That PIN works at every room and at /api/authenticate.
+    # Local PIN checks only guard against casual access
+    message = ('pin-salt:%s' % ','.join(room.name for room in rooms)).encode()
+    return hmac.new(settings.SECRET_KEY.encode(), message, hashlib.sha256).digest()[:PIN_SALT_SIZE]
+
+def pin_verifier(salt, password):
+    # Hex verifier of a 'sha256$$<hex digest>' password (see hashers.py), None for other hashers
+    algorithm, _, digest = (password or '').partition('$$')
+    try:
+        digest = bytes.fromhex(digest)
+    except ValueError:
+        return None
+    if algorithm != 'sha256' or len(digest) != hashlib.sha256().digest_size:
+        return None
+    return hmac.new(salt, digest, hashlib.sha256).digest()[:PIN_VERIFIER_SIZE].hex()
+
+def rooms_auth_entry(rooms, salt, change):
+    # An addition from get_auth_sync_changes as sent to a controller: [uid, access_level, expire],
+    # plus the PIN verifier if one of its rooms asks for a password and the user is allowed in.
+    # The controller still checks the access level of each door's room before using it
+    uid, access_level, expire, password = change
+    entry = [uid, access_level, expire]
+    if any(room.access_level >= REQUIRE_PASSWORD_LEVEL_THRESHOLD and access_level >= room.access_level
+           for room in rooms):
+        verifier = pin_verifier(salt, password)
+        if verifier:
+            entry.append(verifier)
+    return entry
+
+# Events waiting to be written, as (event, visitors). A background thread writes them in batches,
+# one transaction each, so the responses to the clients don't wait on the database. Visitors are
+# None for the copies queue_occupancy adds, which only update the occupancy
+_event_queue = queue.Queue(maxsize=EVENT_QUEUE_MAX)
+_event_writer = None
+_event_writer_lock = threading.Lock()
+# Held while events are written. SQLite fails a transaction that reads before it writes at once,
+# without waiting, if another thread is writing, so journal uploads and the writer take turns
+_event_save_lock = threading.RLock()
+
+def queue_event(event, visitors=()):
+    # Logs a fully populated event. Blocks only if the writer has fallen EVENT_QUEUE_MAX behind
+    _queue((event, list(visitors)))
+
+def queue_occupancy(event):
+    # Counts an event that will be logged later in the occupancy already, as it is now
+    _queue((copy.copy(event), None))
+
+def _queue(entry):
+    _event_queue.put(entry)
+    _start_event_writer()
+
+def _start_event_writer():
+    # The writer also closes expired decision sessions, so it's started by the first session too
+    global _event_writer
+    with _event_writer_lock:
+        if _event_writer is None or not _event_writer.is_alive():
+            _event_writer = threading.Thread(target=_write_events, name='event-writer', daemon=True)
+            _event_writer.start()
+
+def _take_events(timeout=None):
+    # Up to EVENT_BATCH_MAX queued events, waiting up to timeout for the first one
+    batch = []
+    try:
+        batch.append(_event_queue.get(timeout=timeout) if timeout else _event_queue.get_nowait())
+        while len(batch) < EVENT_BATCH_MAX:
+            batch.append(_event_queue.get_nowait())
+    except queue.Empty:
+        pass
+    return batch
+
+def occupancy_change(changes, room_id, user_id, reader_position, date):
+    # Adds an enter or exit to {(room_id, user_id): (present, date)}, keeping the newest one
+    key = (room_id, user_id)
+    if key not in changes or changes[key][1] <= date:
+        changes[key] = (reader_position == 0, date)
+
+def _update_occupancy(batch):
+    changes = {}
+    for event, visitors in batch:
+        if event.event_type in OCCUPANCY_EVENT_TYPES and event.room_id and event.user_id:
+            occupancy_change(changes, event.room_id, event.user_id, event.reader_position, event.date)
+            for visitor in visitors or ():
+                occupancy_change(changes, event.room_id, visitor.pk, event.reader_position, event.date)
+    if not changes:
+        return
+
+    rows = Occupancy.objects.filter(
+        room_id__in={room_id for room_id, user_id in changes},
+        user_id__in={user_id for room_id, user_id in changes}
+    )
+    rows = {(row.room_id, row.user_id): row for row in rows}
+    created = []
+    updated = []
+    for (room_id, user_id), (present, date) in changes.items():
+        row = rows.get((room_id, user_id))
+        if row is None:
+            created.append(Occupancy(room_id=room_id, user_id=user_id, present=present, since=date))
+        elif row.since <= date:
+            row.present = present
+            row.since = date
+            updated.append(row)
+    Occupancy.objects.bulk_create(created)
+    Occupancy.objects.bulk_update(updated, ['present', 'since'])
+
+# Fields of the events kept in the archives, besides their date and visitors. The user's email and
+# the room's name are there for whoever reads the files, in case their ids are gone by then
+EVENT_ARCHIVE_FIELDS = ('id', 'user_id', 'user__email', 'room_id', 'room__name', 'event_type',
+                        'reader_position', 'api_module', 'uid', 'sip')
+
+def event_archive_entry(values, visitors):
+    # A line of an event archive, from the Event.objects.values() of an event and its visitors' ids
+    entry = {field: values[field] for field in EVENT_ARCHIVE_FIELDS}
+    entry['date'] = values['date'].isoformat()
+    entry['visitors'] = visitors
+    return json.dumps(entry) + '\n'
+
+def read_event_archives():
+    # Streams the archived events, oldest file first, as the dicts event_archive_entry wrote with
+    # their date parsed back
+    for archive in EventArchive.objects.order_by('month', 'id'):
+        with gzip.open(os.path.join(settings.EVENT_ARCHIVE_DIR, archive.file_name), 'rt') as lines:
+            for line in lines:
+                entry = json.loads(line)
+                entry['date'] = datetime.datetime.fromisoformat(entry['date'])
+                yield entry
+
+def get_occupants(room):
+    # Occupancy rows of the people in a room, the earliest to enter first
+    return list(Occupancy.objects.filter(room=room, present=True).select_related('user').order_by('since'))
+
+def _save_event_batch(batch):
+    # bulk_create doesn't give the events their ids on every database, so the few with visitors
+    # are saved one by one, still in the same transaction. The occupancy is updated in a savepoint
+    # of it: if that fails the events are still logged, and rebuild_occupancy puts it right.
+    # Raises DatabaseError if the events couldn't be logged
+    with _event_save_lock, transaction.atomic():
+        Event.objects.bulk_create([event for event, visitors in batch if visitors == []])
+        for event, visitors in batch:
+            if visitors:
+                event.save()
+                event.visitors.add(*visitors)
+        try:
+            with transaction.atomic():
+                _update_occupancy(batch)
+        except DatabaseError:
+            logger.exception('Occupancy not updated, run rebuild_occupancy')
+
+def _write_event_batch(batch):
+    # Retried with a growing delay, since SQLite fails writes when the database is busy. A batch
+    # that still fails is written one event at a time, so only the events that can't be logged
+    # are lost, each reported in full to be entered by hand. Events queued meanwhile wait
+    delay = EVENT_RETRY_DELAY
+    for attempt in range(1, EVENT_WRITE_ATTEMPTS + 1):
+        try:
+            _save_event_batch(batch)
+            return
+        except DatabaseError:
+            if attempt == EVENT_WRITE_ATTEMPTS:
+                logger.exception('%d events not logged after %d attempts, writing them one by one',
+                                 len(batch), attempt)
+                break
+            logger.warning('%d events not logged, retrying in %d s', len(batch), delay, exc_info=True)
+        _forget_ids(batch)
+        time.sleep(delay)
+        delay *= 2
+
+    for entry in batch:
+        _forget_ids([entry])
+        try:
+            _save_event_batch([entry])
+        except DatabaseError:
+            _report_lost_event(*entry)
+
+def _forget_ids(batch):
+    # The ids the rolled back transaction gave the events, so the next try inserts them again
+    for event, visitors in batch:
+        event.pk = None
+
+def _report_lost_event(event, visitors):
+    # Occupancy copies aren't events, rebuild_occupancy recounts them
+    if visitors is None:
+        logger.error('Occupancy not updated, run rebuild_occupancy')
+        return
+    logger.error('Lost event: %s', json.dumps({
+        'date': event.date.isoformat(),
+        'user_id': event.user_id,
+        'room_id': event.room_id,
+        'event_type': event.event_type,
+        'reader_position': event.reader_position,
+        'api_module': event.api_module,
+        'uid': event.uid,
+        'sip': event.sip,
+        'visitors': [visitor.pk for visitor in visitors],
+    }))
+
+def _write_events():
+    while True:
+        batch = _take_events(EVENT_FLUSH_INTERVAL)
+        batch += _close_decision_sessions(expired_only=True)
+        if batch:
+            _write_event_batch(batch)
+
+def flush_events():
+    # Writes everything queued so far, from the calling thread
+    batch = _take_events() + _close_decision_sessions(expired_only=True)
+    while batch:
+        _write_event_batch(batch)
+        batch = _take_events()
+
+@atexit.register
+def _flush_events_at_exit():
+    # Open sessions are logged as they are. Failed writes are retried here too, holding the exit
+    batch = _close_decision_sessions(expired_only=False)
+    if batch:
+        _write_event_batch(batch)
+    flush_events()
+
+# Open decision sessions, as {token: (expire_time, event)}. The event is the one request-unlock
+# built, with its user and room. The requests that follow update it instead of logging new ones,
+# and it's queued once the session is closed or expires
+_decision_sessions = OrderedDict()
+_decision_lock = threading.Lock()
+
+def _close_decision_sessions(expired_only):
+    # Removes the expired sessions, or all of them, and returns their events as (event, visitors)
+    now = time.monotonic()
+    events = []
+    with _decision_lock:
+        while _decision_sessions and (not expired_only or next(iter(_decision_sessions.values()))[0] < now):
+            events.append((_decision_sessions.popitem(last=False)[1][1], []))
+    return events
+
+def open_decision_session(log):
+    # Returns the token of a new session for a tap whose unlock needs more requests
+    token = secrets.randbelow(2 ** 31 - 1) + 1
+    now = time.monotonic()
+    evicted = []
+    with _decision_lock:
+        while _decision_sessions and (len(_decision_sessions) >= DECISION_SESSION_MAX or
+                next(iter(_decision_sessions.values()))[0] < now):
+            evicted.append(_decision_sessions.popitem(last=False)[1][1])
+        _decision_sessions[token] = (now + DECISION_SESSION_TIMEOUT, log)
+    for event in evicted:
+        queue_event(event)
+    _start_event_writer()
+    return token
+
+def get_decision_session(token, uid, room_id):
+    # Event of the open session with this token, None if there's none for this tap and room
+    if not token:
+        return None
+    with _decision_lock:
+        session = _decision_sessions.get(token)
+    if session is None:
+        return None
+    expire_time, log = session
+    if expire_time < time.monotonic() or normalize_uid(uid) != normalize_uid(log.uid) or room_id != log.room.name:
+        return None
+    return log
+
+def close_decision_session(token, visitors=()):
+    # Queues the session's event, once its event_type is the tap's outcome
+    with _decision_lock:
+        session = _decision_sessions.pop(token, None)
+    if session is not None:
+        queue_event(session[1], visitors)
 
 def check_password(user, password):
     if (user.password.lower() == ("%s%s" % ("sha256$$", password)).lower()):
         return True
     return False
 
+def get_tag_owners(uids):
+    # Same as get_current_tag_owner for many UIDs, as {normalized uid: user}. UIDs with no owner
+    # or more than one are left out
+    tags = _tag_index.get()
+    owners = {}
+    for uid in uids:
+        uid_owners = _valid_owners(tags.get(normalize_uid(uid), ()))
+        if len(uid_owners) == 1:
+            owners[normalize_uid(uid)] = next(iter(uid_owners.values()))
+    return owners
+
+def journal_events(room, door, entries):
+    # Builds, without saving, the Events uploaded from a client's offline journal for one of its
+    # doors. Each entry is [sequence, timestamp, api_module, event_type, reader_position, uid];
+    # timestamp is 0 when the client didn't know the time. Raises ValueError, TypeError or
+    # LookupError if malformed
+    if not isinstance(entries, list) or len(entries) > EVENTS_BULK_MAX_SIZE:
+        raise ValueError('Too many events')
+    if int(door) < 0:
+        raise ValueError('Unexpected door')
+    owners = get_tag_owners([str(entry[5]) for entry in entries if entry[5]])
+    api_modules = dict(Event.API_MODULE_CHOICES)
+    event_types = dict(Event.EVENT_TYPE_CHOICES)
+    now = timezone.now()
+    events = []
+    for sequence, timestamp, api_module, event_type, reader_position, uid in entries:
+        if int(api_module) not in api_modules or int(reader_position) not in (0, 1) or int(sequence) <= 0:
+            raise ValueError('Unexpected event')
+        uid = str(uid) if uid else None
+        events.append(Event(
+            room=room,
+            user=owners.get(normalize_uid(uid)) if uid else None,
+            uid=uid,
+            date=datetime.datetime.fromtimestamp(int(timestamp), timezone.utc) if timestamp else now,
+            api_module=int(api_module),
+            event_type=int(event_type) if int(event_type) in event_types else UNEXPECTED_ERROR,
+            reader_position=int(reader_position),
+            door=int(door),
+            sequence=int(sequence),
+            ))
+    return events
+
+def save_journal_events(room, door, events):
+    # Logs the events of a journal upload before it's answered, since the client drops them from
+    # its journal once it is. Those an earlier try of the same upload logged are skipped. Returns
+    # how many were new. Raises DatabaseError, including when a concurrent try logged them first
+    with _event_save_lock, transaction.atomic():
+        logged = set(Event.objects.filter(
+            room=room, door=door, sequence__in=[event.sequence for event in events]
+        ).values_list('sequence', flat=True))
+        new_events = {}
+        for event in events:
+            if event.sequence not in logged:
+                new_events.setdefault(event.sequence, event)
+        _save_event_batch([(event, []) for event in new_events.values()])
+    return len(new_events)
+
+def telemetry_report(room, data):
+    # Builds, without saving, the Telemetry sent by a client. Raises ValueError, TypeError or
+    # LookupError if malformed
+    status_counts = [int(count) for count in data['statusCounts']]
+    histograms = [[int(count) for count in histogram] for histogram in data['histograms']]
+    if len(status_counts) != TELEMETRY_STATUS_CODES or len(histograms) != len(TELEMETRY_HISTOGRAMS) or \
+            any(len(histogram) != TELEMETRY_BUCKETS for histogram in histograms):
+        raise ValueError('Unexpected telemetry format')
+    return Telemetry(
+        room=room,
+        uptime=int(data['uptime']),
+        period=int(data['period']),
+        sram_low_water=int(data['sramLow']),
+        taps=int(data['taps']),
+        local_unlocks=int(data['localUnlocks']),
+        dropped_reports=int(data['dropped']),
+        boot_time=int(data['bootTime']),
+        network_time=int(data['networkTime']),
+        status_counts=json.dumps(status_counts),
+        histograms=json.dumps(histograms),
+        )
+
+_binary_header = struct.Struct(BINARY_HEADER_FORMAT)
+_binary_response = struct.Struct(BINARY_RESPONSE_FORMAT)
+_binary_token = struct.Struct(BINARY_TOKEN_FORMAT)
+
+def decode_binary_request(body, api_module):
+    # Returns the same fields sent by the JSON APIs. Raises ValueError if malformed
+    if len(body) < _binary_header.size:
+        raise ValueError('Binary request too short')
+    version, request_api_module, reader_position, uid_size, room_id = _binary_header.unpack_from(body)
+    if version != BINARY_PROTOCOL_VERSION or request_api_module != api_module:
+        raise ValueError('Unexpected binary request')
+    offset = _binary_header.size
+    data = {
+        'uid': body[offset:offset + uid_size].hex(),
+        'roomID': room_id.rstrip(b'\0').decode(),
+        'readerPosition': reader_position,
+    }
+    offset += uid_size
+    if api_module == AUTH_API:
+        data['password'] = body[offset:offset + BINARY_PASSWORD_SIZE].hex()
+        offset += BINARY_PASSWORD_SIZE
+    elif api_module == VISITOR_API:
+        data['visitorsUids'] = []
+        visitor_count = body[offset] if offset < len(body) else 0
+        offset += 1
+        for i in range(visitor_count):
+            visitor_size = body[offset] if offset < len(body) else 0
+            data['visitorsUids'].append(body[offset + 1:offset + 1 + visitor_size].hex())
+            offset += 1 + visitor_size
+    if offset > len(body):
+        raise ValueError('Binary request too short')
+    data['token'] = 0
+    data['visitors'] = 0
+    if api_module != UNLOCK_API and len(body) - offset >= _binary_token.size:
+        data['token'], = _binary_token.unpack_from(body, offset)
+        offset += _binary_token.size
+    if api_module == AUTH_API and offset < len(body):
+        data['visitors'] = body[offset]
+    return data
+
+def binary_response(status, token=0):
+    body = _binary_response.pack(BINARY_PROTOCOL_VERSION, status)
+    if token:
+        body += _binary_token.pack(token)
+    return HttpResponse(body, content_type='application/octet-stream')
+
 def malformed_post():
     return HttpResponse("Malformed POST request. Please check documentation.")
\ No newline at end of file
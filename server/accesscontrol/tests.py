@@ -1,3 +1,265 @@
+import datetime
+import hashlib
+import json
+from unittest import mock
 from django.test import TestCase
+from django.utils import timezone
+from accesscontrol import services
+from accesscontrol.consts import *
+from accesscontrol.models import *
+from accesscontrol.services import AuthIndex, flush_events, get_current_tag_owner, get_room
 
-# Create your tests here.
\ No newline at end of file
+def hashed(pin):
+    # The password as the clients send it, see HashedPassword in the client
+    return hashlib.sha256(pin.encode()).hexdigest()
+
+class ApiTestCase(TestCase):
+    # Events are written by flush_events from the test's thread: the background writer would use
+    # another connection, outside the test's transaction
+
+    @classmethod
+    def setUpTestData(cls):
+        cls.room = Room.objects.create(name='ENSAIOS_REP', access_level=3)
+        cls.lab = Room.objects.create(name='ENSAIOS_LAB', access_level=1)
+        cls.user = cls.create_user('a@b.c', 3, '1234', 'deadbeef', '1')
+        cls.other = cls.create_user('c@b.c', 3, '9999', 'cafebabe', '2')
+        cls.visitor = cls.create_user('v@b.c', 0, None, 'abcd1234', '3')
+
+    @classmethod
+    def create_user(cls, email, access_level, pin, uid, cpf):
+        user = User.objects.create(email=email, first_name='A', last_name='B', access_level=access_level, cpf=cpf)
+        if pin:
+            user.set_password(pin)
+            user.save()
+        RfidTagUserLink.objects.create(rfid_tag=RfidTag.objects.create(uid=uid), user=user)
+        return user
+
+    def setUp(self):
+        patcher = mock.patch('accesscontrol.services._start_event_writer')
+        patcher.start()
+        self.addCleanup(patcher.stop)
+        self.addCleanup(self.drop_pending)
+        self.drop_pending()
+
+    def drop_pending(self):
+        # Other tests' sessions and queued events, and indexes built from their data
+        services._close_decision_sessions(expired_only=False)
+        while services._take_events():
+            pass
+        AuthIndex.drop_all()
+
+    def post(self, path, data):
+        response = self.client.post('/api/' + path, json.dumps(data), content_type='application/json')
+        self.assertEqual(response.status_code, 200)
+        return response
+
+    def post_json(self, path, data):
+        return self.post(path, data).json()
+
+    def unlock(self, uid='deadbeef', room='ENSAIOS_REP', position=0):
+        return self.post_json('request-unlock', {'uid': uid, 'roomID': room, 'readerPosition': position})
+
+    def authenticate(self, token=0, visitors=0, uid='deadbeef', pin='1234', room='ENSAIOS_REP'):
+        return self.post_json('authenticate', {'uid': uid, 'password': hashed(pin), 'roomID': room,
+                                               'token': token, 'visitors': visitors})
+
+    def authorize_visitors(self, token=0, uid='deadbeef', visitors=('abcd1234',), room='ENSAIOS_REP'):
+        return self.post_json('authorize-visitor', {'uid': uid, 'visitorsUids': list(visitors), 'roomID': room,
+                                                    'token': token})
+
+class DecisionSessionTests(ApiTestCase):
+
+    def test_flow_with_token(self):
+        response = self.unlock()
+        self.assertEqual(response['status'], PASSWORD_REQUIRED)
+        token = response['token']
+
+        # With visitors to follow, the session is kept open and its token sent back
+        self.assertEqual(self.authenticate(token, visitors=1), {'status': AUTHORIZED, 'token': token})
+        self.assertEqual(self.authorize_visitors(token), {'status': VISITOR_AUTHORIZED})
+
+        flush_events()
+        event = Event.objects.get()
+        self.assertEqual(event.event_type, VISITOR_AUTHORIZED)
+        self.assertEqual(event.api_module, VISITOR_API)
+        self.assertEqual(event.user, self.user)
+        self.assertEqual(event.room, self.room)
+        self.assertEqual(list(event.visitors.all()), [self.visitor])
+
+    def test_flow_without_token(self):
+        self.assertEqual(self.unlock()['status'], PASSWORD_REQUIRED)
+        self.assertEqual(self.authenticate(visitors=1), {'status': AUTHORIZED})
+        self.assertEqual(self.authorize_visitors(), {'status': VISITOR_AUTHORIZED})
+
+        # request-unlock's session is left to expire, the other two are logged on their own
+        flush_events()
+        self.assertEqual(sorted(Event.objects.values_list('api_module', 'event_type')),
+                         [(AUTH_API, AUTHORIZED), (VISITOR_API, VISITOR_AUTHORIZED)])
+
+    def test_password_closes_session_without_visitors(self):
+        token = self.unlock()['token']
+        self.assertEqual(self.authenticate(token), {'status': AUTHORIZED})
+
+        flush_events()
+        event = Event.objects.get()
+        self.assertEqual((event.api_module, event.event_type), (AUTH_API, AUTHORIZED))
+        # The session is gone, the visitors request is decided from the database
+        self.assertEqual(self.authorize_visitors(token), {'status': VISITOR_AUTHORIZED})
+        flush_events()
+        self.assertEqual(Event.objects.count(), 2)
+
+    def test_wrong_password_with_token(self):
+        token = self.unlock()['token']
+        self.assertEqual(self.authenticate(token, visitors=1, pin='0000'), {'status': WRONG_PASSWORD})
+
+        flush_events()
+        self.assertEqual(Event.objects.get().event_type, WRONG_PASSWORD)
+
+    def test_wrong_token(self):
+        token = self.unlock()['token']
+        wrong = token % (2 ** 31 - 1) + 1
+
+        # Decided from the database: no token comes back, and the session stays open
+        self.assertEqual(self.authenticate(wrong, visitors=1), {'status': AUTHORIZED})
+        self.assertEqual(self.authenticate(wrong, pin='0000'), {'status': WRONG_PASSWORD})
+        self.assertEqual(self.authenticate(token, visitors=1), {'status': AUTHORIZED, 'token': token})
+
+    def test_expired_token(self):
+        with mock.patch('accesscontrol.services.DECISION_SESSION_TIMEOUT', -1):
+            token = self.unlock()['token']
+        self.assertEqual(self.authenticate(token, visitors=1), {'status': AUTHORIZED})
+
+        # The expired session is logged as it was left, next to the request decided without it
+        flush_events()
+        self.assertEqual(sorted(Event.objects.values_list('api_module', 'event_type')),
+                         [(UNLOCK_API, PASSWORD_REQUIRED), (AUTH_API, AUTHORIZED)])
+
+    def test_foreign_token(self):
+        token = self.unlock()['token']
+
+        # Another card or another room can't use this tap's session
+        self.assertEqual(self.authenticate(token, visitors=1, uid='cafebabe', pin='9999'), {'status': AUTHORIZED})
+        self.assertEqual(self.authenticate(token, visitors=1, uid='cafebabe', pin='1234'), {'status': WRONG_PASSWORD})
+        self.assertEqual(self.authenticate(token, visitors=1, room='ENSAIOS_LAB'), {'status': AUTHORIZED})
+        self.assertEqual(self.authorize_visitors(token, uid='cafebabe'), {'status': VISITOR_AUTHORIZED})
+        # It still works for its own tap
+        self.assertEqual(self.authenticate(token), {'status': AUTHORIZED})
+
+        flush_events()
+        event = Event.objects.get(api_module=AUTH_API, user=self.user, room=self.room)
+        self.assertEqual(event.event_type, AUTHORIZED)
+        self.assertEqual(Event.objects.filter(user=self.other).count(), 3)
+
+class EventTests(ApiTestCase):
+
+    def assertPopulated(self, event, user, room, uid, api_module, event_type, reader_position=0):
+        self.assertEqual((event.user, event.room, event.uid, event.api_module, event.event_type, event.reader_position),
+                         (user, room, uid, api_module, event_type, reader_position))
+        self.assertIsNotNone(event.date)
+
+    def test_one_event_per_request(self):
+        requests = [
+            (lambda: self.unlock(position=1), (self.user, self.room, 'deadbeef', UNLOCK_API, AUTHORIZED, 1)),
+            (lambda: self.unlock(room='ENSAIOS_LAB'), (self.user, self.lab, 'deadbeef', UNLOCK_API, AUTHORIZED)),
+            (lambda: self.unlock(uid='abcd1234'), (self.visitor, self.room, 'abcd1234', UNLOCK_API, VISITOR_UID_FOUND)),
+            (lambda: self.authenticate(), (self.user, self.room, 'deadbeef', AUTH_API, AUTHORIZED)),
+            (lambda: self.authenticate(pin='0000'), (self.user, self.room, 'deadbeef', AUTH_API, WRONG_PASSWORD)),
+            (lambda: self.authorize_visitors(), (self.user, self.room, 'deadbeef', VISITOR_API, VISITOR_AUTHORIZED)),
+        ]
+        for request, expected in requests:
+            with self.subTest(expected=expected):
+                Event.objects.all().delete()
+                request()
+                flush_events()
+                self.assertPopulated(Event.objects.get(), *expected)
+
+    def test_one_event_per_session(self):
+        token = self.unlock()['token']
+        self.authenticate(token)
+        flush_events()
+        self.assertPopulated(Event.objects.get(), self.user, self.room, 'deadbeef', AUTH_API, AUTHORIZED)
+
+    def test_unknown_tag(self):
+        self.assertEqual(self.unlock(uid='01020304')['status'], UNREGISTERED_UID)
+        flush_events()
+        event = Event.objects.get()
+        self.assertEqual((event.user, event.uid, event.event_type), (None, '01020304', UNREGISTERED_UID))
+
+class AuthIndexTests(ApiTestCase):
+
+    def test_link_saved(self):
+        self.assertEqual(get_current_tag_owner('deadbeef'), self.user)
+        with self.assertRaises(User.DoesNotExist):
+            get_current_tag_owner('01020304')
+
+        link = RfidTagUserLink.objects.create(rfid_tag=RfidTag.objects.create(uid='01020304'), user=self.other)
+        self.assertEqual(get_current_tag_owner('01020304'), self.other)
+
+        link.expire_date = timezone.now() - datetime.timedelta(days=2)
+        link.save()
+        with self.assertRaises(User.DoesNotExist):
+            get_current_tag_owner('01020304')
+
+    def test_link_saved_changes_decision(self):
+        self.assertEqual(self.unlock(uid='01020304')['status'], UNREGISTERED_UID)
+        RfidTagUserLink.objects.create(rfid_tag=RfidTag.objects.create(uid='01020304'), user=self.other)
+        self.assertEqual(self.unlock(uid='01020304')['status'], PASSWORD_REQUIRED)
+
+    def test_room_saved(self):
+        self.assertEqual(get_room('ENSAIOS_LAB').access_level, 1)
+        with self.assertRaises(Room.DoesNotExist):
+            get_room('ENSAIOS_NEW')
+
+        self.lab.access_level = 4
+        self.lab.save()
+        Room.objects.create(name='ENSAIOS_NEW', access_level=1)
+        self.assertEqual(get_room('ENSAIOS_LAB').access_level, 4)
+        self.assertEqual(get_room('ENSAIOS_NEW').access_level, 1)
+        self.assertEqual(self.unlock(room='ENSAIOS_LAB')['status'], INSUFFICIENT_PRIVILEGES)
+
+class EventsBulkTests(ApiTestCase):
+
+    def upload(self, events, door=0, room='ENSAIOS_REP'):
+        return self.post('events/bulk', {'roomID': room, 'door': door, 'events': events})
+
+    def test_upload(self):
+        events = [[1, 1700000000, UNLOCK_API, AUTHORIZED, 0, 'deadbeef'], [2, 0, JOURNAL_API, DOOR_OPENED, 0, '']]
+        self.assertEqual(self.upload(events).json()['status'], AUTHORIZED)
+        # Logged before the response, and only once when sent again
+        self.assertEqual(Event.objects.count(), 2)
+        self.upload(events)
+        self.assertEqual(Event.objects.count(), 2)
+        self.upload(events, door=1)
+        self.assertEqual(Event.objects.filter(door=1).count(), 2)
+
+        event = Event.objects.get(door=0, sequence=1)
+        self.assertEqual((event.user, event.room, event.event_type), (self.user, self.room, AUTHORIZED))
+        self.assertEqual(event.date, datetime.datetime.fromtimestamp(1700000000, datetime.timezone.utc))
+
+    def test_malformed(self):
+        valid = [1, 1700000000, UNLOCK_API, AUTHORIZED, 0, 'deadbeef']
+        uploads = [
+            {'events': 'not a list'},
+            {'events': [valid[:5]]},
+            {'events': [valid + [0]]},
+            {'events': [[0] + valid[1:]]},
+            {'events': [[-1] + valid[1:]]},
+            {'events': [['x'] + valid[1:]]},
+            {'events': [valid[:2] + [99] + valid[3:]]},
+            {'events': [valid[:4] + [2] + valid[5:]]},
+            {'events': [valid], 'door': -1},
+            {'events': [[i + 1] + valid[1:] for i in range(EVENTS_BULK_MAX_SIZE + 1)]},
+            {'door': 0},
+        ]
+        for upload in uploads:
+            with self.subTest(upload=upload):
+                response = self.post('events/bulk', dict({'roomID': 'ENSAIOS_REP'}, **upload))
+                self.assertEqual(response.content, services.malformed_post().content)
+        # A bad entry turns down the whole upload
+        response = self.upload([valid, [2] + valid[1:4] + [2, 'deadbeef']])
+        self.assertEqual(response.content, services.malformed_post().content)
+        self.assertEqual(Event.objects.count(), 0)
+
+    def test_unknown_room(self):
+        self.assertEqual(self.upload([[1, 0, UNLOCK_API, AUTHORIZED, 0, '']], room='NOWHERE').json()['status'],
+                         ROOM_NOT_FOUND)
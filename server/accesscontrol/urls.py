@@ -7,4 +7,11 @@ urlpatterns = [
     path('authenticate', views.authenticate),
     path('authorize-visitor', views.authorize_visitor),
     path('request-front-door-unlock', views.request_front_door_unlock),
+    path('auth-sync', views.auth_sync),
+    path('events/bulk', views.events_bulk),
+    path('telemetry', views.telemetry),
+    path('occupancy', views.occupancy),
+    path('bin/request-unlock', views.binary_request_unlock),
+    path('bin/authenticate', views.binary_authenticate),
+    path('bin/authorize-visitor', views.binary_authorize_visitor),
 ]
@@ -1,6 +1,8 @@
 import json
-import datetime
+import time
 from django.http import HttpResponse
+from django.utils import timezone
+from django.db import DatabaseError
 from django.views.decorators.csrf import csrf_exempt
 from django.http import JsonResponse
 from accesscontrol.services import *
@@ -11,6 +13,185 @@ from django.utils.translation import ugettext_lazy as _
 def index(request):
 	return HttpResponse(_('Access control api is online! It is accessible through POST requests.'))
 
+# unlock_status and authenticate_status also return the token of the tap's decision session,
+# 0 if it has none. Each request queues a single event, with its outcome
+def unlock_status(request_uid, request_room_id, request_reader_position):
+	log = Event()
+	log.uid = request_uid
+	log.reader_position = request_reader_position
+	log.date = timezone.now()
+	log.api_module = UNLOCK_API
+
+	try:
+		user = get_current_tag_owner(request_uid)
+		room = get_room(request_room_id)
+	except Room.DoesNotExist:
+		log.event_type = ROOM_NOT_FOUND
+		queue_event(log)
+		return ROOM_NOT_FOUND, 0
+	except User.DoesNotExist:
+		log.event_type = UNREGISTERED_UID
+		queue_event(log)
+		return UNREGISTERED_UID, 0
+	except:
+		log.event_type = UNEXPECTED_ERROR
+		queue_event(log)
+		return UNEXPECTED_ERROR, 0
+
+	log.room = room
+	log.user = user
+
+	# Always authorize from inside
+	if (request_reader_position == 1):
+		log.event_type = AUTHORIZED
+		queue_event(log)
+		return AUTHORIZED, 0
+
+	# Checks if UID is from a visitor
+	if (user.access_level == 0):
+		log.event_type = VISITOR_UID_FOUND
+		queue_event(log)
+		return VISITOR_UID_FOUND, 0
+
+	# Checks if permission should be denied
+	if user.access_level < room.access_level:
+		log.event_type = INSUFFICIENT_PRIVILEGES
+		queue_event(log)
+		return INSUFFICIENT_PRIVILEGES, 0
+
+	# Checks if room needs password. The event is queued when the session closes
+	if (room.access_level >= REQUIRE_PASSWORD_LEVEL_THRESHOLD):
+		log.event_type = PASSWORD_REQUIRED
+		return PASSWORD_REQUIRED, open_decision_session(log)
+	
+	# If reaches this point, authorize unlock
+	log.event_type = AUTHORIZED
+	queue_event(log)
+	return AUTHORIZED, 0
+
+def authenticate_status(request_uid, request_password, request_room_id, request_token=0, request_visitors=0):
+	# Within a decision session the owner and the room are known, and request-unlock's event is
+	# updated instead of logging another. It's closed once the password is checked, unless the
+	# client says visitors follow: then the owner is counted in the occupancy before it's logged
+	log = get_decision_session(request_token, request_uid, request_room_id)
+	if log is not None:
+		log.api_module = AUTH_API
+		if (not check_password(log.user, request_password)):
+			log.event_type = WRONG_PASSWORD
+			close_decision_session(request_token)
+			return WRONG_PASSWORD, 0
+		log.event_type = AUTHORIZED
+		if (not request_visitors):
+			close_decision_session(request_token)
+			return AUTHORIZED, 0
+		queue_occupancy(log)
+		return AUTHORIZED, request_token
+
+	log = Event()
+	log.reader_position = 0
+	log.uid = request_uid
+	log.date = timezone.now()
+	log.api_module = AUTH_API
+	
+	try:
+		user = get_current_tag_owner(request_uid)
+		room = get_room(request_room_id)
+	except Room.DoesNotExist:
+		log.event_type = ROOM_NOT_FOUND
+		queue_event(log)
+		return ROOM_NOT_FOUND, 0
+	except User.DoesNotExist:
+		log.event_type = UNREGISTERED_UID
+		queue_event(log)
+		return UNREGISTERED_UID, 0
+	except:
+		log.event_type = UNEXPECTED_ERROR
+		queue_event(log)
+		return UNEXPECTED_ERROR, 0
+
+	log.user = user
+	log.room = room
+
+	if (not check_password(user, request_password)):
+		log.event_type = WRONG_PASSWORD
+		queue_event(log)
+		return WRONG_PASSWORD, 0
+
+	log.event_type = AUTHORIZED
+	queue_event(log)
+	return AUTHORIZED, 0
+
+def authorize_visitor_status(request_uid, request_visitor_array, request_room_id, request_token=0):
+	log = get_decision_session(request_token, request_uid, request_room_id)
+	if log is not None:
+		status, visitor_list = session_visitor_status(log, request_visitor_array)
+		close_decision_session(request_token, visitor_list)
+		return status
+
+	log = Event()
+	log.uid = request_uid
+	log.date = timezone.now()
+	log.reader_position = 0
+	log.api_module = VISITOR_API
+
+	try:
+		room = get_room(request_room_id)
+		user = get_current_tag_owner(request_uid)
+	except User.DoesNotExist:
+		log.event_type = UNREGISTERED_UID
+		queue_event(log)
+		return UNREGISTERED_UID
+	except:
+		log.event_type = ROOM_NOT_FOUND
+		queue_event(log)
+		return ROOM_NOT_FOUND
+	
+	log.user = user
+	log.room = room
+	
+	if (user.access_level == 0): 
+		log.event_type = INSUFFICIENT_PRIVILEGES
+		queue_event(log)
+		return INSUFFICIENT_PRIVILEGES
+
+	visitor_list = []
+
+	for visitor_uid in request_visitor_array:
+		try:
+			visitor_list.append(get_current_tag_owner(visitor_uid))
+		except:
+			log.event_type = UNREGISTERED_VISITOR_UID
+			queue_event(log)
+			return UNREGISTERED_VISITOR_UID
+
+	log.event_type = VISITOR_AUTHORIZED
+	queue_event(log, visitor_list)
+	return VISITOR_AUTHORIZED
+
+def session_visitor_status(log, request_visitor_array):
+	# authorize_visitor_status within a decision session: the visitors are looked up at once.
+	# Returns the status and the visitors to log with the session's event
+	log.api_module = VISITOR_API
+	if (log.user.access_level == 0):
+		log.event_type = INSUFFICIENT_PRIVILEGES
+		return INSUFFICIENT_PRIVILEGES, []
+
+	owners = get_tag_owners(request_visitor_array)
+	visitor_list = [owners.get(normalize_uid(visitor_uid)) for visitor_uid in request_visitor_array]
+	if (None in visitor_list):
+		log.event_type = UNREGISTERED_VISITOR_UID
+		return UNREGISTERED_VISITOR_UID, []
+
+	log.event_type = VISITOR_AUTHORIZED
+	return VISITOR_AUTHORIZED, visitor_list
+
+def status_response(status, token=0):
+	response = {}
+	response['status'] = status
+	if token:
+		response['token'] = token
+	return JsonResponse(response)
+
 @csrf_exempt # Disables CSRF verification for this method
 def request_unlock(request):
 	if request.method == 'GET':
@@ -25,185 +206,235 @@ def request_unlock(request):
 		except:
 			return malformed_post()
 
-		response = {}
-		log = Event()
-		log.uid = request_uid
-		log.reader_position = request_reader_position
-		log.date = datetime.datetime.now()
-		log.api_module = UNLOCK_API
+		return status_response(*unlock_status(request_uid, request_room_id, request_reader_position))
 
+@csrf_exempt # Disables CSRF verification for this method
+def authenticate(request):
+	if request.method == 'GET':
+		return index(request)
+	
+	elif request.method == 'POST':
 		try:
-			user = get_current_tag_owner(request_uid)
-			room = Room.objects.get(name=request_room_id)
-		except Room.DoesNotExist:
-			log.event_type = ROOM_NOT_FOUND
-			response['status'] =  ROOM_NOT_FOUND
-			return JsonResponse(response)
-		except User.DoesNotExist:
-			log.event_type = UNREGISTERED_UID
-			log.uids = {request_uid}
-			response['status'] = UNREGISTERED_UID
-			return JsonResponse(response)
+			data = json.loads(request.body)
+			request_password = data['password']
+			request_uid = data['uid']
+			request_room_id = data['roomID']
+			request_token = int(data.get('token', 0))
+			request_visitors = int(data.get('visitors', 0))
 		except:
-			log.event_type = UNEXPECTED_ERROR
-			response['status'] = UNEXPECTED_ERROR
-			return JsonResponse(response)
-		finally:
-			log.save()
-		
-		log.room = room
-		log.user = user
-		log.save()
+			return malformed_post()
 
-		# Always authorize from inside
-		if (request_reader_position == 1):
-			log.event_type = AUTHORIZED
-			log.save()
-			response['status'] = AUTHORIZED
-			return JsonResponse(response)
+		return status_response(*authenticate_status(request_uid, request_password, request_room_id, request_token, request_visitors))
 
-		# Checks if UID is from a visitor
-		if (user.access_level == 0):
-			log.event_type = VISITOR_UID_FOUND
-			log.save()
-			response['status'] = VISITOR_UID_FOUND
-			return JsonResponse(response)
+@csrf_exempt # Disables CSRF verification for this method
+def authorize_visitor(request):
+	if request.method == 'GET':
+		return index(request)
+	
+	elif request.method == 'POST':
+		request_visitor_array = []
+		try:
+			data = json.loads(request.body)
+			request_uid = data['uid']
+			request_visitor_array = data['visitorsUids']
+			request_room_id = data['roomID']
+			request_token = int(data.get('token', 0))
+		except:
+			return malformed_post()
 
-		# Checks if permission should be denied
-		if user.access_level < room.access_level:
-			log.event_type = INSUFFICIENT_PRIVILEGES
-			log.save()
-			response['status'] = INSUFFICIENT_PRIVILEGES
+		return status_response(authorize_visitor_status(request_uid, request_visitor_array, request_room_id, request_token))
+
+@csrf_exempt # Disables CSRF verification for this method
+def binary_request_unlock(request):
+	if request.method == 'GET':
+		return index(request)
+	
+	elif request.method == 'POST':
+		try:
+			data = decode_binary_request(request.body, UNLOCK_API)
+		except ValueError:
+			return malformed_post()
+
+		return binary_response(*unlock_status(data['uid'], data['roomID'], data['readerPosition']))
+
+@csrf_exempt # Disables CSRF verification for this method
+def binary_authenticate(request):
+	if request.method == 'GET':
+		return index(request)
+	
+	elif request.method == 'POST':
+		try:
+			data = decode_binary_request(request.body, AUTH_API)
+		except ValueError:
+			return malformed_post()
+
+		return binary_response(*authenticate_status(data['uid'], data['password'], data['roomID'], data['token'], data['visitors']))
+
+@csrf_exempt # Disables CSRF verification for this method
+def binary_authorize_visitor(request):
+	if request.method == 'GET':
+		return index(request)
+	
+	elif request.method == 'POST':
+		try:
+			data = decode_binary_request(request.body, VISITOR_API)
+		except ValueError:
+			return malformed_post()
+
+		return binary_response(authorize_visitor_status(data['uid'], data['visitorsUids'], data['roomID'], data['token']))
+
+@csrf_exempt # Disables CSRF verification for this method
+def auth_sync(request):
+	if request.method == 'GET':
+		return index(request)
+	
+	elif request.method == 'POST':
+		try:
+			data = json.loads(request.body)
+			request_room_id = data['roomID']
+			# The rooms of all the controller's doors, in order. Older clients only send their own
+			request_room_ids = data.get('rooms', [request_room_id])
+			request_version = int(data['version'])
+			request_target = int(data.get('target', 0))
+			request_offset = int(data.get('offset', 0))
+			if not isinstance(request_room_ids, list) or not request_room_ids or \
+					not all(isinstance(room_id, str) for room_id in request_room_ids):
+				raise ValueError('Bad room list')
+		except:
+			return malformed_post()
+
+		response = {}
+
+		try:
+			room = get_room(request_room_id)
+			rooms = [get_room(room_id) for room_id in request_room_ids]
+		except Room.DoesNotExist:
+			response['status'] = ROOM_NOT_FOUND
 			return JsonResponse(response)
 
-		# Checks if room needs password
-		if (room.access_level >= REQUIRE_PASSWORD_LEVEL_THRESHOLD):
-			log.event_type = PASSWORD_REQUIRED
-			log.save()
-			response['status'] = PASSWORD_REQUIRED
+		try:
+			mode, version, changes = get_auth_sync_changes(request_version, request_target)
+		except KeyError:
+			# Target version was dropped from history, client must start over
+			response['status'] = UNEXPECTED_ERROR
 			return JsonResponse(response)
-		
-		# If reaches this point, authorize unlock
-		log.event_type = AUTHORIZED
-		log.save()
+
+		page = changes[request_offset:request_offset + AUTH_SYNC_PAGE_SIZE]
+		next_offset = request_offset + len(page)
+		pin_salt = rooms_pin_salt(rooms)
+
 		response['status'] = AUTHORIZED
+		response['mode'] = mode
+		response['version'] = version
+		response['roomLevel'] = room.access_level
+		response['passwordRequired'] = room.access_level >= REQUIRE_PASSWORD_LEVEL_THRESHOLD
+		response['rooms'] = [[r.access_level, r.access_level >= REQUIRE_PASSWORD_LEVEL_THRESHOLD] for r in rooms]
+		response['serverTime'] = int(time.time())
+		response['pinSalt'] = pin_salt.hex()
+		response['add'] = [rooms_auth_entry(rooms, pin_salt, change) for change in page if len(change) > 1]
+		response['del'] = [change[0] for change in page if len(change) == 1]
+		response['next'] = next_offset if next_offset < len(changes) else -1
 		return JsonResponse(response)
 
 @csrf_exempt # Disables CSRF verification for this method
-def authenticate(request):
+def events_bulk(request):
 	if request.method == 'GET':
 		return index(request)
 	
 	elif request.method == 'POST':
 		try:
 			data = json.loads(request.body)
-			request_password = data['password']
-			request_uid = data['uid']
 			request_room_id = data['roomID']
+			request_door = int(data.get('door', 0))
+			request_events = data['events']
 		except:
 			return malformed_post()
-				
+
 		response = {}
-		log = Event()
-		log.reader_position = 0
-		log.uid = request_uid
-		log.date = datetime.datetime.now()
-		log.api_module = AUTH_API
-		
+
 		try:
-			user = get_current_tag_owner(request_uid)
-			room = Room.objects.get(name=request_room_id)
+			room = get_room(request_room_id)
 		except Room.DoesNotExist:
-			log.event_type = ROOM_NOT_FOUND
-			response['status'] =  ROOM_NOT_FOUND
-			return JsonResponse(response)
-		except User.DoesNotExist:
-			log.event_type = UNREGISTERED_UID
-			response['status'] =  UNREGISTERED_UID
-			return JsonResponse(response)
-		except:
-			log.event_type = UNEXPECTED_ERROR
-			response['status'] = UNEXPECTED_ERROR
+			response['status'] = ROOM_NOT_FOUND
 			return JsonResponse(response)
-		finally:
-			log.save()
 
-		log.user = user
-		log.room = room
-		log.save()
+		try:
+			events = journal_events(room, request_door, request_events)
+		except (ValueError, TypeError, LookupError):
+			return malformed_post()
 
-		if (not check_password(user, request_password)):
-			log.event_type = WRONG_PASSWORD
-			response['status'] = WRONG_PASSWORD
-			log.save()
+		# Written before answering, not queued: the client keeps the events until it's told they're logged
+		try:
+			save_journal_events(room, request_door, events)
+		except DatabaseError:
+			response['status'] = UNEXPECTED_ERROR
 			return JsonResponse(response)
 
-		log.event_type = AUTHORIZED
-		log.save()
+		# Lets the client know if its authorization cache fell behind
+		version, table = get_auth_table()
+
 		response['status'] = AUTHORIZED
+		response['count'] = len(events)
+		response['version'] = version
 		return JsonResponse(response)
 
 @csrf_exempt # Disables CSRF verification for this method
-def authorize_visitor(request):
+def telemetry(request):
 	if request.method == 'GET':
 		return index(request)
 	
 	elif request.method == 'POST':
-		request_visitor_array = []
 		try:
 			data = json.loads(request.body)
-			request_uid = data['uid']
-			request_visitor_array = data['visitorsUids']
 			request_room_id = data['roomID']
 		except:
 			return malformed_post()
 
 		response = {}
-		log = Event()
-		log.uid = request_uid
-		log.date = datetime.datetime.now()
-		log.reader_position = 0
-		log.api_module = VISITOR_API
 
 		try:
-			room = Room.objects.get(name=request_room_id)
-			user = get_current_tag_owner(request_uid)
-		except User.DoesNotExist:
-			log.event_type = UNREGISTERED_UID
-			response['status'] =  UNREGISTERED_UID
+			room = get_room(request_room_id)
+		except Room.DoesNotExist:
+			response['status'] = ROOM_NOT_FOUND
 			return JsonResponse(response)
+
+		try:
+			report = telemetry_report(room, data)
+		except (ValueError, TypeError, LookupError):
+			return malformed_post()
+
+		report.save()
+		response['status'] = AUTHORIZED
+		return JsonResponse(response)
+
+@csrf_exempt # Disables CSRF verification for this method
+def occupancy(request):
+	if request.method == 'GET':
+		return index(request)
+	
+	elif request.method == 'POST':
+		try:
+			data = json.loads(request.body)
+			request_room_id = data['roomID']
 		except:
-			log.event_type = ROOM_NOT_FOUND
-			response['status'] =  ROOM_NOT_FOUND
-			return JsonResponse(response)
-		finally:
-			log.save()
-		
-		log.user = user
-		log.room = room
-		log.save()
-		
-		if (user.access_level == 0): 
-			response['status'] = INSUFFICIENT_PRIVILEGES
+			return malformed_post()
+
+		response = {}
+
+		try:
+			room = get_room(request_room_id)
+		except Room.DoesNotExist:
+			response['status'] = ROOM_NOT_FOUND
 			return JsonResponse(response)
 
-		visitor_list = []
-
-		for visitor_uid in request_visitor_array:
-			try:
-				visitor_list.append(get_current_tag_owner(visitor_uid))
-			except:
-				log.event_type = UNREGISTERED_VISITOR_UID
-				response['status'] = UNREGISTERED_VISITOR_UID
-				return JsonResponse(response)
-			finally:
-				log.save()
-
-		log.event_type = VISITOR_AUTHORIZED
-		log.visitors.add(*visitor_list)
-		log.save()
-		
-		response['status'] = VISITOR_AUTHORIZED
+		occupants = get_occupants(room)
+		response['status'] = AUTHORIZED
+		response['count'] = len(occupants)
+		response['occupants'] = [{
+			'name': row.user.get_full_name(),
+			'email': row.user.email,
+			'since': int(row.since.timestamp()),
+		} for row in occupants]
 		return JsonResponse(response)
 
 @csrf_exempt
@@ -221,7 +452,7 @@ def request_front_door_unlock(request):
 		response = {}
 		log = Event()
 		log.sip = request_sip_id
-		log.date = datetime.datetime.now()
+		log.date = timezone.now()
 		log.reader_position = 0
 		log.api_module = FRONT_DOOR_API
 
@@ -229,25 +460,24 @@ def request_front_door_unlock(request):
 			user = User.objects.get(sip=request_sip_id)
 		except User.DoesNotExist:
 			log.event_type = UNREGISTERED_SIP
+			queue_event(log)
 			response['status'] =  UNREGISTERED_SIP
 			return JsonResponse(response)
 		except:
 			log.event_type = UNEXPECTED_ERROR
+			queue_event(log)
 			response['status'] = UNEXPECTED_ERROR
 			return JsonResponse(response)
-		finally:
-			log.save()
 		
 		log.user = user
-		log.save()
 		
 		if (user.access_level == 0): 
 			response['status'] = INSUFFICIENT_PRIVILEGES
 			log.event_type = INSUFFICIENT_PRIVILEGES
-			log.save()
+			queue_event(log)
 			return JsonResponse(response)
 
 		log.event_type = FRONT_DOOR_OPENED
-		log.save()
+		queue_event(log)
 		response['status'] = FRONT_DOOR_OPENED
 		return JsonResponse(response)
\ No newline at end of file
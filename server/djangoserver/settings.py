@@ -56,7 +56,7 @@ TEMPLATES = [
 WSGI_APPLICATION = 'djangoserver.wsgi.application'
 
 # Database
-# https://docs.djangoproject.com/en/1.11/ref/settings/#databases
+# https://docs.djangoproject.com/en/2.2/ref/settings/#databases
 
 DATABASES = {
     'default': {
@@ -65,6 +65,10 @@ DATABASES = {
     }
 }
 
+# Where the archive_events command moves old events to, as a gzipped file per month
+
+EVENT_ARCHIVE_DIR = os.path.join(BASE_DIR, 'event-archive')
+
 # NOTE: Custom hasher was added to match arduino-client SHA-256 algorithm
 
 PASSWORD_HASHERS = [
@@ -77,7 +81,7 @@ PASSWORD_HASHERS = [
 ]
 
 # Password validation
-# https://docs.djangoproject.com/en/1.11/ref/settings/#auth-password-validators
+# https://docs.djangoproject.com/en/2.2/ref/settings/#auth-password-validators
 
 AUTH_PASSWORD_VALIDATORS = [
     {
@@ -96,7 +100,7 @@ AUTH_PASSWORD_VALIDATORS = [
 
 
 # Internationalization
-# https://docs.djangoproject.com/en/1.11/topics/i18n/
+# https://docs.djangoproject.com/en/2.2/topics/i18n/
 
 LANGUAGE_CODE = 'pt-BR'
 
@@ -113,7 +117,7 @@ USE_L10N = True
 USE_TZ = True
 
 # Static files (CSS, JavaScript, Images)
-# https://docs.djangoproject.com/en/1.11/howto/static-files/
+# https://docs.djangoproject.com/en/2.2/howto/static-files/
 
 STATIC_URL = '/static/'
 PROJECT_DIR = os.path.dirname(os.path.abspath(__file__))